@@ -0,0 +1,179 @@
+#include "BackgroundReceiver.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *BackgroundReceiverThread(void *input);
+static void CopyFromRing(BackgroundReceiver *r, uint64_t position, void *data, uint64_t n);
+static void CopyToRing(BackgroundReceiver *r, uint64_t position, const void *data, uint64_t n);
+
+
+int StartBackgroundReceiver(BackgroundReceiver *r, Supersocket *s, uint64_t capacity)
+{
+	memset(r, 0, sizeof(BackgroundReceiver));
+	r->s 		= s;
+	r->capacity = capacity;
+	r->ring 	= malloc(capacity);
+	if(r->ring == NULL)
+	{
+		DisplayError("[%s] Unable to allocate %llu bytes for the BackgroundReceiver", s->name, (unsigned long long) capacity);
+		return -1;
+	}
+
+	pthread_mutex_init(&r->lock, NULL);
+	r->running = 1;
+	if(pthread_create(&r->thread, NULL, &BackgroundReceiverThread, r) != 0)
+	{
+		DisplayError("[%s] Unable to start the BackgroundReceiver thread", s->name);
+		free(r->ring);
+		r->ring 	= NULL;
+		r->running 	= 0;
+		return -1;
+	}
+
+	Display("[%s] BackgroundReceiver started with %llu bytes", s->name, (unsigned long long) capacity);
+	return 0;
+}
+
+int StopBackgroundReceiver(BackgroundReceiver *r)
+{
+	if(r->running == 0)
+		return -1;
+
+	// The thread notices within BACKGROUND_RECEIVER_POLL_TIME
+	r->running = 0;
+	pthread_join(r->thread, NULL);
+	pthread_mutex_destroy(&r->lock);
+
+	free(r->ring);
+	r->ring = NULL;
+
+	Display("[%s] BackgroundReceiver stopped: %llu received, %llu dropped",
+		r->s->name, (unsigned long long) r->nReceived, (unsigned long long) r->nDropped);
+	return 0;
+}
+
+int ReadBackgroundReceiver(BackgroundReceiver *r, void *data, int capacity, int *lengths, int maxMessages)
+{
+	pthread_mutex_lock(&r->lock);
+	uint64_t head = r->head;
+	uint64_t tail = r->tail;
+	pthread_mutex_unlock(&r->lock);
+
+	// Only we move the tail and the thread never writes behind it, so everything
+	// between tail and head can be copied out without holding the lock.
+	int nMessages 	= 0;
+	int nBytes 		= 0;
+	while(tail < head && nMessages < maxMessages)
+	{
+		uint32_t length;
+		CopyFromRing(r, tail, &length, sizeof(length));
+		if(length > capacity - nBytes)
+			break;
+
+		CopyFromRing(r, tail + sizeof(length), (uint8_t *) data + nBytes, length);
+		lengths[nMessages++] 	= length;
+		nBytes 					+= length;
+		tail 					+= sizeof(length) + length;
+	}
+
+	pthread_mutex_lock(&r->lock);
+	r->tail = tail;
+	pthread_mutex_unlock(&r->lock);
+
+	return nMessages;
+}
+
+uint64_t BackgroundReceiverPending(BackgroundReceiver *r, int *nMessages)
+{
+	pthread_mutex_lock(&r->lock);
+	uint64_t head = r->head;
+	uint64_t tail = r->tail;
+	pthread_mutex_unlock(&r->lock);
+
+	uint64_t nBytes = 0;
+	int n = 0;
+	while(tail < head)
+	{
+		uint32_t length;
+		CopyFromRing(r, tail, &length, sizeof(length));
+		nBytes 	+= length;
+		tail 	+= sizeof(length) + length;
+		n++;
+	}
+
+	if(nMessages != NULL)
+		*nMessages = n;
+	return nBytes;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+
+/**
+The thread receives into a buffer of its own and only takes the lock to see if
+there is room and to publish the new head, so the owner is never held up by a
+system call.
+*/
+static void *BackgroundReceiverThread(void *input)
+{
+	BackgroundReceiver *r = (BackgroundReceiver *) input;
+
+	uint8_t *buffer = malloc(BACKGROUND_RECEIVER_MAX_DATAGRAM);
+	if(buffer == NULL)
+	{
+		DisplayError("[%s] BackgroundReceiver could not allocate its receive buffer", r->s->name);
+		return NULL;
+	}
+
+	while(r->running)
+	{
+		int bytesRead = ReceiveDataTimeout(r->s, buffer, BACKGROUND_RECEIVER_MAX_DATAGRAM, BACKGROUND_RECEIVER_POLL_TIME, NULL);
+		if(bytesRead <= 0)
+			continue;
+
+		uint32_t length = bytesRead;
+
+		pthread_mutex_lock(&r->lock);
+		uint64_t head = r->head;
+		int fits = (head - r->tail + sizeof(length) + length <= r->capacity);
+		if(fits == 0)
+			r->nDropped++;
+		pthread_mutex_unlock(&r->lock);
+
+		if(fits == 0)
+			continue;
+
+		CopyToRing(r, head, &length, sizeof(length));
+		CopyToRing(r, head + sizeof(length), buffer, length);
+
+		pthread_mutex_lock(&r->lock);
+		r->head = head + sizeof(length) + length;
+		r->nReceived++;
+		pthread_mutex_unlock(&r->lock);
+	}
+
+	free(buffer);
+	return NULL;
+}
+
+static void CopyFromRing(BackgroundReceiver *r, uint64_t position, void *data, uint64_t n)
+{
+	uint64_t offset = position % r->capacity;
+	uint64_t first 	= (n < r->capacity - offset) ? n : r->capacity - offset;
+
+	memcpy(data, r->ring + offset, first);
+	memcpy((uint8_t *) data + first, r->ring, n - first);
+}
+
+static void CopyToRing(BackgroundReceiver *r, uint64_t position, const void *data, uint64_t n)
+{
+	uint64_t offset = position % r->capacity;
+	uint64_t first 	= (n < r->capacity - offset) ? n : r->capacity - offset;
+
+	memcpy(r->ring + offset, data, first);
+	memcpy(r->ring, (const uint8_t *) data + first, n - first);
+}
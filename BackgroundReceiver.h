@@ -0,0 +1,90 @@
+/**
+@file
+@brief Receive on a thread of its own, into a ring buffer
+
+Some environments (Matlab, mostly) can only get around to reading their sockets
+every so often. Whatever arrives in between waits in the kernel's socket buffer,
+and once that fills up, datagrams are thrown away without anyone finding out.
+
+A BackgroundReceiver starts a thread that does nothing but drain the bound sockets
+of a Supersocket into a ring buffer in memory, which can be as large as you like.
+The owner then pulls everything that has piled up in one go.
+
+@code
+	BackgroundReceiver r = {0};
+	StartBackgroundReceiver(&r, &s, 16 * 1024 * 1024);
+
+	// ... later, as often as is convenient
+	int lengths[100];
+	int n = ReadBackgroundReceiver(&r, buffer, sizeof(buffer), lengths, 100);
+
+	StopBackgroundReceiver(&r);
+@endcode
+
+Datagrams are kept whole, and in the order they arrived. When the ring is full,
+new datagrams are dropped and counted in nDropped, so that what the owner does
+get is never torn or reordered. While the BackgroundReceiver is running it is
+the only thing that should receive on the Supersocket.
+
+All memory comes from malloc(), since the thread can't use the Matlab allocator.
+
+@authors David Brandman and Benjamin Shanahan
+*/
+
+#pragma once
+
+#include "Supersocket.h"
+
+/** Largest datagram we can receive */
+#define BACKGROUND_RECEIVER_MAX_DATAGRAM 65507
+
+/** How often the thread looks up from poll() to see if it's been asked to stop */
+#define BACKGROUND_RECEIVER_POLL_TIME 100 //Milliseconds
+
+/**
+@brief Definition of the BackgroundReceiver structure
+
+The ring holds records of a uint32_t length followed by that many bytes. head and
+tail are byte counts that only ever go up; their difference is how full the ring is.
+*/
+typedef struct
+{
+	Supersocket *s;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	volatile int running;
+
+	uint8_t *ring;
+	uint64_t capacity;
+	uint64_t head; // Where the thread writes next
+	uint64_t tail; // Where the owner reads next
+
+	uint64_t nReceived;
+	uint64_t nDropped;
+
+} BackgroundReceiver;
+
+/**
+@brief Allocate a ring of capacity bytes and start draining s into it
+*/
+int StartBackgroundReceiver(BackgroundReceiver *r, Supersocket *s, uint64_t capacity);
+
+/**
+@brief Stop the thread and free the ring. Anything not yet read is lost.
+*/
+int StopBackgroundReceiver(BackgroundReceiver *r);
+
+/**
+@brief Take up to maxMessages datagrams out of the ring
+
+They are copied one after another into data, which is capacity bytes long, and
+their lengths go into lengths[]. Returns how many datagrams were copied, which is 0
+if the ring was empty. Datagrams that don't fit stay in the ring for next time.
+*/
+int ReadBackgroundReceiver(BackgroundReceiver *r, void *data, int capacity, int *lengths, int maxMessages);
+
+/**
+@brief Number of bytes of datagrams waiting in the ring, and how many datagrams
+*/
+uint64_t BackgroundReceiverPending(BackgroundReceiver *r, int *nMessages);
@@ -0,0 +1,221 @@
+#define _GNU_SOURCE // For memfd_create() and file sealing
+#include "BufferHandle.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** What the data of a Message was before it was pointed at a mapping */
+typedef struct BufferHandleMapping
+{
+	void *mapping;
+	uint32_t length;
+	void *buffer;
+	uint32_t capacity;
+	struct BufferHandleMapping *next;
+
+} BufferHandleMapping;
+
+static int WriteSealedBuffer(void *data, uint32_t dlen);
+static int MapBufferHandle(Supersocket *s, Message *m, int fd, int capacity);
+
+static pthread_mutex_t mappingsLock 	= PTHREAD_MUTEX_INITIALIZER;
+static BufferHandleMapping *mappings 	= NULL;
+
+
+int SendBufferHandle(Supersocket *s, int target, Message *m)
+{
+	if(m->dlen == 0)
+	{
+		DisplayError("[%s] SendBufferHandle: There is no data to send", s->name);
+		return -1;
+	}
+
+	int fd = WriteSealedBuffer(m->data, m->dlen);
+	if(fd < 0)
+	{
+		DisplayError("[%s] SendBufferHandle: Unable to put %u bytes in a memfd: %s", s->name, m->dlen, strerror(errno));
+		return -1;
+	}
+
+	// The header says how big the buffer is, and no data follows it
+	Message header 	= *m;
+	header.flags 	|= MESSAGE_FLAG_BUFFER_HANDLE;
+
+	struct iovec messageContents[MESSAGE_NUM_IOVECS];
+	PopulateIOvec(messageContents, &header);
+	messageContents[MESSAGE_NUM_IOVECS - 1].iov_len = 0;
+
+	MessagingOptions options = {.fds = &fd, .nFds = 1};
+
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+
+	int val = -1;
+	if (target < 0 || target >= table->nSockets)
+		DisplayError("SendBufferHandle: Target number exceeds number of sockets!");
+	else if(table->socketWrapper[target].domain != AF_UNIX)
+		DisplayError("[%s] SendBufferHandle: %s is not on this computer", s->name, table->socketWrapper[target].name);
+	else
+		val = SendIOvecToSocketWrapper(&table->socketWrapper[target], messageContents, MESSAGE_NUM_IOVECS, &options);
+
+	ReleaseSupersocketTable(s, epoch);
+
+	// The receiver has its own copy of the descriptor now
+	close(fd);
+	return val;
+}
+
+int ReceiveBufferHandle(Supersocket *s, Message *m, int milliseconds)
+{
+	ReleaseBufferHandle(m);
+	int capacity = m->dlen;
+
+	struct iovec messageContents[MESSAGE_NUM_IOVECS];
+	PopulateIOvec(messageContents, m);
+
+	int fd = -1;
+	MessagingOptions options = {.fds = &fd, .nFds = 1};
+
+	int bytesRead = ReceiveIOvecSupersocketTimeout(s, messageContents, MESSAGE_NUM_IOVECS, milliseconds, &options);
+	if(bytesRead <= 0)
+		return bytesRead;
+
+	if((m->flags & MESSAGE_FLAG_BUFFER_HANDLE) == 0)
+	{
+		if(options.nFds > 0)
+			close(fd);
+
+		bytesRead = CheckReceivedMessage(m, bytesRead, capacity);
+		if(bytesRead > 0)
+			RefreshSocketWrapper(s, m->from, -1);
+		return bytesRead;
+	}
+
+	if(options.nFds == 0 || bytesRead != MESSAGE_HEADER_LENGTH)
+	{
+		DisplayWarning("[%s] Buffer handle from %s arrived without its file descriptor", s->name, m->from);
+		if(options.nFds > 0)
+			close(fd);
+		return -1;
+	}
+
+	return MapBufferHandle(s, m, fd, capacity);
+}
+
+int ReleaseBufferHandle(Message *m)
+{
+	if((m->flags & MESSAGE_FLAG_BUFFER_HANDLE) == 0)
+		return 0;
+
+	pthread_mutex_lock(&mappingsLock);
+	BufferHandleMapping **link = &mappings;
+	while(*link != NULL && (*link)->mapping != m->data)
+		link = &(*link)->next;
+
+	BufferHandleMapping *found = *link;
+	if(found != NULL)
+		*link = found->next;
+	pthread_mutex_unlock(&mappingsLock);
+
+	// Flagged, but never mapped by us, so there is nothing to give back
+	if(found == NULL)
+		return 0;
+
+	munmap(found->mapping, found->length);
+	m->data 	= found->buffer;
+	m->dlen 	= found->capacity;
+	m->flags 	&= ~MESSAGE_FLAG_BUFFER_HANDLE;
+	free(found);
+
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+
+/**
+The one copy the data ever gets. The seals mean nobody, us included, can change or
+resize the file afterwards, which is what lets the receiver map it without worrying
+that it will shrink underneath it.
+*/
+static int WriteSealedBuffer(void *data, uint32_t dlen)
+{
+	int fd = memfd_create("SupersocketBufferHandle", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if(fd < 0)
+		return -1;
+
+	uint32_t written = 0;
+	while(written < dlen)
+	{
+		ssize_t n = write(fd, (char *) data + written, dlen - written);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+		{
+			close(fd);
+			return -1;
+		}
+		written += n;
+	}
+
+	if(fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+Only a memfd that can no longer be written to or shrunk is mapped, since otherwise
+the sender could change the data while we read it, or truncate it and have us fault.
+*/
+static int MapBufferHandle(Supersocket *s, Message *m, int fd, int capacity)
+{
+	int required 	= F_SEAL_SHRINK | F_SEAL_WRITE;
+	int seals 		= fcntl(fd, F_GET_SEALS);
+
+	struct stat status;
+	if(seals < 0 || (seals & required) != required || fstat(fd, &status) < 0 || status.st_size != m->dlen)
+	{
+		DisplayWarning("[%s] Buffer handle from %s is not sealed or is not %u bytes", s->name, m->from, m->dlen);
+		close(fd);
+		return -1;
+	}
+
+	void *mapping = mmap(NULL, m->dlen, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	BufferHandleMapping *entry = malloc(sizeof(BufferHandleMapping));
+	if(mapping == MAP_FAILED || entry == NULL)
+	{
+		DisplayWarning("[%s] Unable to map the buffer handle from %s: %s", s->name, m->from, strerror(errno));
+		if(mapping != MAP_FAILED)
+			munmap(mapping, m->dlen);
+		free(entry);
+		return -1;
+	}
+
+	entry->mapping 	= mapping;
+	entry->length 	= m->dlen;
+	entry->buffer 	= m->data;
+	entry->capacity = capacity;
+
+	pthread_mutex_lock(&mappingsLock);
+	entry->next = mappings;
+	mappings 	= entry;
+	pthread_mutex_unlock(&mappingsLock);
+
+	m->data = mapping;
+	RefreshSocketWrapper(s, m->from, -1);
+
+	return (int) MESSAGE_HEADER_LENGTH + m->dlen;
+}
@@ -0,0 +1,68 @@
+/**
+@file
+@brief Hand large buffers to a process on the same computer without copying them
+
+Sending a Message over AF_UNIX copies its data into the kernel and back out again on
+the other side, and it has to fit in one datagram. For buffers of many megabytes that
+is most of the cost. A buffer handle instead writes the data once into a memfd (an
+anonymous file that lives in memory), seals it so that it can't change any more, and
+passes the file descriptor along with an otherwise empty Message. The receiver maps
+the file read-only, and the Message it gets back has its data pointing straight at the
+mapping.
+
+@code
+	Message m = CreateMessage("Alice", 0, frame, frameBytes);
+	SendBufferHandle(&alice, aliceToBob, &m);
+@endcode
+
+And to receive it:
+
+@code
+	Message r = CreateMessageBuffer(1024);
+	if(ReceiveBufferHandle(&bob, &r, -1) > 0)
+	{
+		UseFrame(r.data, r.dlen);
+		ReleaseBufferHandle(&r);
+	}
+@endcode
+
+Ordinary Messages arrive through ReceiveBufferHandle() too, in r.data as usual, and
+ReleaseBufferHandle() leaves those alone. Only the receiver's AF_UNIX socket can be
+given a file descriptor, so target must be a contact on this computer. ReceiveMessage()
+and friends can't take the file descriptor, so they discard a buffer handle with a
+warning and return -1.
+
+@authors David Brandman and Benjamin Shanahan
+*/
+
+#pragma once
+
+#include "Supersocket.h"
+
+/**
+@brief Send m->data to target by handing it a sealed memfd holding it
+
+target has to be an AF_UNIX contact. The .from field is sent as it is in m, and the
+Message goes out uncompressed, whatever SetSupersocketCompression() says. Once this
+returns the memfd belongs to the receiver, and m can be reused.
+*/
+int SendBufferHandle(Supersocket *s, int target, Message *m);
+
+/**
+@brief Receive a Message, mapping its data if it came as a buffer handle
+
+Waits up to milliseconds (forever if negative). For a buffer handle, m->data points at
+a read-only mapping of m->dlen bytes, MESSAGE_FLAG_BUFFER_HANDLE is set in m->flags, and
+the mapping stays until ReleaseBufferHandle(). Anything else is received into m->data
+just like ReceiveMessage() would. Returns MESSAGE_HEADER_LENGTH plus the number of bytes
+of data, 0 on timeout, or -1.
+*/
+int ReceiveBufferHandle(Supersocket *s, Message *m, int milliseconds);
+
+/**
+@brief Unmap the data of a Message from ReceiveBufferHandle()
+
+m->data and m->dlen go back to the buffer it had before, ready to receive again. Does
+nothing to a Message that isn't a buffer handle.
+*/
+int ReleaseBufferHandle(Message *m);
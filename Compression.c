@@ -0,0 +1,227 @@
+#include "Compression.h"
+#include <inttypes.h>
+#include <stdlib.h> // For realloc()
+#include <string.h> // For memcpy()
+
+
+static uint32_t Read32(const uint8_t *p);
+static uint32_t HashSequence(uint32_t sequence);
+static uint8_t *WriteLength(uint8_t *op, int length);
+
+// Each thread owns one scratch buffer that only ever grows. See Compression.h
+static __thread void *scratchBuffer       = NULL;
+static __thread int   scratchBufferLength = 0;
+
+
+/**
+@brief Compress a block
+
+We walk through the source four bytes at a time and look up where we last saw
+the same four bytes in a small hash table. If the bytes really match, we extend
+the match as far as it goes and emit a sequence of (literals, match). Otherwise
+we move on, and the longer we go without finding a match the faster we skip
+ahead, which keeps incompressible data from costing very much.
+*/
+int CompressBuffer(const void *source, int sourceLength, void *destination, int destinationCapacity)
+{
+	const uint8_t *src 			= source;
+	const uint8_t *ip 			= src;
+	const uint8_t *anchor 		= src;
+	const uint8_t *end 			= src + sourceLength;
+	const uint8_t *matchLimit 	= end - COMPRESSION_LAST_LITERALS;
+	const uint8_t *startLimit 	= end - COMPRESSION_MATCH_LIMIT;
+
+	uint8_t *op 	= destination;
+	uint8_t *oend 	= op + destinationCapacity;
+
+	if(sourceLength < 0 || destinationCapacity < 0)
+		return -1;
+
+	if(sourceLength >= COMPRESSION_MATCH_LIMIT)
+	{
+		int32_t table[1 << COMPRESSION_HASH_LOG];
+		memset(table, 0, sizeof(table));
+
+		ip++;
+		while(ip < startLimit)
+		{
+			uint32_t sequence 	= Read32(ip);
+			uint32_t h 			= HashSequence(sequence);
+			const uint8_t *ref 	= src + table[h];
+			table[h] 			= (int32_t) (ip - src);
+
+			if(ref >= ip || ip - ref > COMPRESSION_MAX_OFFSET || Read32(ref) != sequence)
+			{
+				ip += 1 + ((ip - anchor) >> 6);
+				continue;
+			}
+
+			// We have a match. Extend it forward as far as it goes.
+			const uint8_t *m = ip + COMPRESSION_MIN_MATCH;
+			const uint8_t *r = ref + COMPRESSION_MIN_MATCH;
+			while(m < matchLimit && *m == *r)
+			{
+				m++;
+				r++;
+			}
+
+			int literalLength 	= (int) (ip - anchor);
+			int matchLength 	= (int) (m - ip) - COMPRESSION_MIN_MATCH;
+			int offset 			= (int) (ip - ref);
+
+			// Worst case for this sequence: token, literal length bytes, literals,
+			// offset, match length bytes.
+			if(op + 1 + literalLength / 255 + 1 + literalLength + 2 + matchLength / 255 + 1 > oend)
+				return -1;
+
+			uint8_t *token = op++;
+			*token = (uint8_t) (((literalLength < 15 ? literalLength : 15) << 4) | (matchLength < 15 ? matchLength : 15));
+			if(literalLength >= 15)
+				op = WriteLength(op, literalLength - 15);
+			memcpy(op, anchor, literalLength);
+			op += literalLength;
+
+			*op++ = (uint8_t) (offset & 0xFF);
+			*op++ = (uint8_t) (offset >> 8);
+
+			if(matchLength >= 15)
+				op = WriteLength(op, matchLength - 15);
+
+			ip = anchor = m;
+		}
+	}
+
+	// Whatever remains gets written out as one final run of literals.
+	int literalLength = (int) (end - anchor);
+	if(op + 1 + literalLength / 255 + 1 + literalLength > oend)
+		return -1;
+
+	*op++ = (uint8_t) ((literalLength < 15 ? literalLength : 15) << 4);
+	if(literalLength >= 15)
+		op = WriteLength(op, literalLength - 15);
+	memcpy(op, anchor, literalLength);
+	op += literalLength;
+
+	return (int) (op - (uint8_t *) destination);
+}
+
+/**
+@brief Decompress a block
+
+Every read and write is checked against the ends of the source and destination,
+since the source came from the network and we don't trust it.
+*/
+int DecompressBuffer(const void *source, int sourceLength, void *destination, int destinationCapacity)
+{
+	const uint8_t *ip 	= source;
+	const uint8_t *iend = ip + sourceLength;
+	uint8_t *op 		= destination;
+	uint8_t *oend 		= op + destinationCapacity;
+
+	if(sourceLength <= 0 || destinationCapacity < 0)
+		return -1;
+
+	while(ip < iend)
+	{
+		int token = *ip++;
+
+		int literalLength = token >> 4;
+		if(literalLength == 15)
+		{
+			int s;
+			do
+			{
+				if(ip >= iend)
+					return -1;
+				s = *ip++;
+				literalLength += s;
+			} while(s == 255);
+		}
+
+		if(literalLength > iend - ip || literalLength > oend - op)
+			return -1;
+
+		memcpy(op, ip, literalLength);
+		op += literalLength;
+		ip += literalLength;
+
+		// The last sequence is only literals
+		if(ip == iend)
+			break;
+
+		if(iend - ip < 2)
+			return -1;
+		int offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		if(offset == 0 || offset > op - (uint8_t *) destination)
+			return -1;
+
+		int matchLength = token & 0x0F;
+		if(matchLength == 15)
+		{
+			int s;
+			do
+			{
+				if(ip >= iend)
+					return -1;
+				s = *ip++;
+				matchLength += s;
+			} while(s == 255);
+		}
+		matchLength += COMPRESSION_MIN_MATCH;
+
+		if(matchLength > oend - op)
+			return -1;
+
+		// Matches may overlap the bytes being written, so copy one at a time
+		const uint8_t *ref = op - offset;
+		for(int i = 0; i < matchLength; i++)
+			*op++ = *ref++;
+	}
+
+	return (int) (op - (uint8_t *) destination);
+}
+
+void *GetCompressionScratch(int length)
+{
+	if(length > scratchBufferLength)
+	{
+		void *output = realloc(scratchBuffer, length);
+		if(output == NULL)
+			return NULL;
+
+		scratchBuffer 		= output;
+		scratchBufferLength = length;
+	}
+	return scratchBuffer;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+
+static uint32_t Read32(const uint8_t *p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint32_t HashSequence(uint32_t sequence)
+{
+	return (sequence * 2654435761U) >> (32 - COMPRESSION_HASH_LOG);
+}
+
+static uint8_t *WriteLength(uint8_t *op, int length)
+{
+	while(length >= 255)
+	{
+		*op++ = 255;
+		length -= 255;
+	}
+	*op++ = (uint8_t) length;
+	return op;
+}
@@ -0,0 +1,77 @@
+/**
+@file
+@brief A small LZ4-style block codec for compressing Message payloads
+
+Supersocket has no external dependencies, so rather than linking against
+liblz4 we carry our own byte-oriented LZ77 codec that uses the same block
+layout as LZ4: a token byte holding the literal and match lengths, the
+literals themselves, and a 2-byte little-endian back-reference offset.
+It's not as clever as the real thing, but it's fast, simple, and large
+array payloads with lots of repeated structure shrink quite a bit.
+
+The usual way to use these functions is indirectly through
+SetSupersocketCompression(), which will compress outgoing Messages above a
+size threshold and set MESSAGE_FLAG_COMPRESSED in the header. The receiving
+side decompresses directly into the caller's Message buffer, so nothing
+changes for the person calling ReceiveMessage().
+
+@code
+	char source[4096] = {0};
+	char compressed[CompressBound(4096)];
+	char restored[4096];
+
+	int n = CompressBuffer(source, 4096, compressed, sizeof(compressed));
+	int m = DecompressBuffer(compressed, n, restored, sizeof(restored));
+@endcode
+
+@authors David Brandman and Benjamin Shanahan
+*/
+
+#pragma once
+
+/** Matches shorter than this aren't worth encoding */
+#define COMPRESSION_MIN_MATCH 4
+
+/** The last bytes of a block are always literals, which keeps the decoder simple */
+#define COMPRESSION_LAST_LITERALS 5
+
+/** No match may start this close to the end of the source */
+#define COMPRESSION_MATCH_LIMIT 12
+
+/** Number of bits used to index the hash table of previously seen positions */
+#define COMPRESSION_HASH_LOG 12
+
+/** Back-references are stored in two bytes */
+#define COMPRESSION_MAX_OFFSET 65535
+
+/**
+@brief Worst case size of a compressed block for a given input length
+*/
+#define CompressBound(length) ((length) + (length) / 255 + 16)
+
+/**
+@brief Compress sourceLength bytes into destination
+
+Returns the number of bytes written to destination, or -1 if the result
+would not fit in destinationCapacity bytes. Passing a capacity smaller than
+sourceLength is the easy way of asking "only compress if it helps".
+*/
+int CompressBuffer(const void *source, int sourceLength, void *destination, int destinationCapacity);
+
+/**
+@brief Decompress a block produced by CompressBuffer()
+
+Returns the number of bytes written to destination, or -1 if the block
+is malformed or would not fit in destinationCapacity bytes.
+*/
+int DecompressBuffer(const void *source, int sourceLength, void *destination, int destinationCapacity);
+
+/**
+@brief Return a per-thread scratch buffer of at least the requested length
+
+The compression path needs somewhere to put the compressed bytes on the way
+out, and a place to park them on the way in while they are decompressed into
+the caller's buffer. Rather than calling malloc() for every Message, each thread
+keeps one buffer that only grows.
+*/
+void *GetCompressionScratch(int length);
@@ -0,0 +1,270 @@
+#define _GNU_SOURCE // For clock_gettime() under -std=c11
+#include "DirectoryServer.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static void HandleDirectoryMessage(DirectoryServer *d, Message *m);
+static void Register(DirectoryServer *d, Message *m);
+static void LookUp(DirectoryServer *d, DiscoveryRecord *request, char *name, DiscoveryRequestOptions *options);
+static DirectoryServerEntry *FindRegistration(DirectoryServer *d, DiscoveryRecord *record);
+static int ReadRecord(Message *m, DiscoveryRecord *record);
+static double NowMilliseconds(void);
+
+
+int InitializeDirectoryServer(DirectoryServer *d, char *ip, int port)
+{
+	memset(d, 0, sizeof(DirectoryServer));
+	d->outgoingSocket = -1;
+
+	if(InitializeSupersocket(&d->s, DIRECTORY_SERVER_NAME, ip, port) < 0)
+		return -1;
+
+	d->outgoingSocket 	= socket(AF_INET, SOCK_DGRAM, 0);
+	d->buffer 			= CreateMessageBuffer(DISCOVERY_REQUEST_BUFFER_SIZE);
+	d->entries 			= malloc(DIRECTORY_SERVER_INITIAL_ENTRIES * sizeof(DirectoryServerEntry));
+	d->maxEntries 		= DIRECTORY_SERVER_INITIAL_ENTRIES;
+	if(d->outgoingSocket < 0 || d->entries == NULL)
+	{
+		DisplayError("[%s] Unable to set up the directory server: %s", DIRECTORY_SERVER_NAME, strerror(errno));
+		CloseDirectoryServer(d);
+		return -1;
+	}
+
+	Display("[%s] Serving the directory on %s:%d", DIRECTORY_SERVER_NAME, ip, port);
+	return 0;
+}
+
+int ServeDirectory(DirectoryServer *d, int milliseconds)
+{
+	double deadline = NowMilliseconds() + milliseconds;
+	int nHandled 	= 0;
+	while(1)
+	{
+		int wait = -1;
+		if(milliseconds >= 0)
+		{
+			wait = (int) (deadline - NowMilliseconds());
+			if(wait <= 0)
+				break;
+		}
+
+		int val = PollSockets(&d->s, wait);
+		if(val < 0)
+			return -1;
+		if(val == 0)
+			continue;
+
+		// Anything that doesn't hold together is dropped on receipt, and it's no reason to stop serving
+		d->buffer.dlen = DISCOVERY_REQUEST_BUFFER_SIZE;
+		if(ReceiveMessageTimeout(&d->s, &d->buffer, 0) <= 0)
+			continue;
+
+		HandleDirectoryMessage(d, &d->buffer);
+		nHandled++;
+	}
+
+	return nHandled;
+}
+
+int CloseDirectoryServer(DirectoryServer *d)
+{
+	if(d->outgoingSocket >= 0)
+		close(d->outgoingSocket);
+	d->outgoingSocket = -1;
+
+	DestroyMessageBuffer(&d->buffer);
+	free(d->entries);
+	d->entries 		= NULL;
+	d->nEntries 	= 0;
+	d->maxEntries 	= 0;
+
+	return CloseSupersocket(&d->s);
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+
+/**
+Registrations are announcements sent to us rather than to the multicast, and lookups
+are the same requests the listeners get. Anything else isn't for us.
+*/
+static void HandleDirectoryMessage(DirectoryServer *d, Message *m)
+{
+	DiscoveryRecord request;
+	DiscoveryRequestOptions options;
+	if(m->id != ID_SUPERSOCKET_SOCKETWRAPPER_ANNOUNCE && ReadRecord(m, &request) < 0)
+		return;
+
+	switch (m->id)
+	{
+		case ID_SUPERSOCKET_SOCKETWRAPPER_ANNOUNCE:
+
+			Register(d, m);
+			break;
+
+		case ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND:
+		{
+			int hasOptions = (m->dlen >= sizeof(DiscoveryRecord) + sizeof(options));
+			if(hasOptions)
+				memcpy(&options, (char *) m->data + sizeof(DiscoveryRecord), sizeof(options));
+
+			LookUp(d, &request, request.name, hasOptions ? &options : NULL);
+			break;
+		}
+
+		case ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND_MANY:
+		{
+			uint32_t nNames;
+			size_t headerLength = sizeof(DiscoveryRecord) + sizeof(nNames);
+			if(m->dlen < headerLength)
+				break;
+
+			memcpy(&nNames, (char *) m->data + sizeof(DiscoveryRecord), sizeof(nNames));
+			if(nNames > (m->dlen - headerLength) / PROCESS_MAX_CHARS)
+				break;
+
+			size_t optionsAt 	= headerLength + nNames * PROCESS_MAX_CHARS;
+			int hasOptions 		= (m->dlen >= optionsAt + sizeof(options));
+			if(hasOptions)
+				memcpy(&options, (char *) m->data + optionsAt, sizeof(options));
+
+			char *names = (char *) m->data + headerLength;
+			for(uint32_t i = 0; i < nNames; i++)
+			{
+				names[(i + 1) * PROCESS_MAX_CHARS - 1] = '\0';
+				LookUp(d, &request, &names[i * PROCESS_MAX_CHARS], hasOptions ? &options : NULL);
+			}
+			break;
+		}
+	}
+}
+
+/**
+Take on, renew or drop the registration in an announcement. A registration is the same
+one if it has the same name, address and port, so replicas each get their own.
+*/
+static void Register(DirectoryServer *d, Message *m)
+{
+	uint32_t lease;
+	DiscoveryRecord record;
+	if(m->dlen < sizeof(DiscoveryRecord) + sizeof(lease) || ReadRecord(m, &record) < 0)
+		return;
+
+	memcpy(&lease, (char *) m->data + sizeof(DiscoveryRecord), sizeof(lease));
+	if(lease > DIRECTORY_SERVER_MAX_LEASE)
+		lease = DIRECTORY_SERVER_MAX_LEASE;
+
+	DirectoryServerEntry *entry = FindRegistration(d, &record);
+	if(lease == 0)
+	{
+		if(entry != NULL)
+		{
+			Display("[%s] %s has gone away", DIRECTORY_SERVER_NAME, record.name);
+			*entry = d->entries[--d->nEntries];
+		}
+		return;
+	}
+
+	if(entry == NULL && d->nEntries == d->maxEntries)
+	{
+		DirectoryServerEntry *entries = realloc(d->entries, 2 * d->maxEntries * sizeof(DirectoryServerEntry));
+		if(entries == NULL)
+		{
+			DisplayWarning("[%s] Unable to make room for %s", DIRECTORY_SERVER_NAME, record.name);
+			return;
+		}
+		d->entries 		= entries;
+		d->maxEntries 	*= 2;
+	}
+
+	if(entry == NULL)
+	{
+		Display("[%s] Registering %s for %u ms", DIRECTORY_SERVER_NAME, record.name, lease);
+		entry = &d->entries[d->nEntries++];
+	}
+
+	entry->record 	= record;
+	entry->expires 	= NowMilliseconds() + lease;
+}
+
+/**
+Answer for every live registration of name, or of every name starting with it if it
+ends in '*', up to the request's maxReplies. Each answer says how much of its lease is
+left. Registrations whose lease has run out are thrown away as we go.
+*/
+static void LookUp(DirectoryServer *d, DiscoveryRecord *request, char *name, DiscoveryRequestOptions *options)
+{
+	size_t length 	= strlen(name);
+	int isPrefix 	= length > 0 && name[length - 1] == '*';
+	int maxReplies 	= options != NULL ? ntohs(options->maxReplies) : 0;
+	uint32_t nonce 	= options != NULL ? options->nonce : 0;
+
+	SocketWrapper replyTo = {0};
+	replyTo.inetStruct.sin_family 		= AF_INET;
+	replyTo.inetStruct.sin_addr.s_addr 	= request->address;
+	replyTo.inetStruct.sin_port 		= request->port;
+
+	double now 	 = NowMilliseconds();
+	int nReplies = 0;
+	for(int i = 0; i < d->nEntries && (maxReplies == 0 || nReplies < maxReplies); i++)
+	{
+		DirectoryServerEntry *entry = &d->entries[i];
+		if(entry->expires <= now)
+		{
+			d->entries[i--] = d->entries[--d->nEntries];
+			continue;
+		}
+
+		if(isPrefix ? strncmp(entry->record.name, name, length - 1) != 0 : strcmp(entry->record.name, name) != 0)
+			continue;
+
+		uint32_t lease = (uint32_t) (entry->expires - now);
+		char payload[sizeof(DiscoveryRecord) + 2 * sizeof(uint32_t)];
+		memcpy(payload, &entry->record, sizeof(DiscoveryRecord));
+		memcpy(payload + sizeof(DiscoveryRecord), &nonce, sizeof(nonce));
+		memcpy(payload + sizeof(DiscoveryRecord) + sizeof(nonce), &lease, sizeof(lease));
+
+		Display("[%s] Telling [%s] where %s is", DIRECTORY_SERVER_NAME, request->name, entry->record.name);
+		Message reply = CreateMessage(entry->record.name, ID_SUPERSOCKET_SOCKETWRAPPER_REPLY_DISCOVERBIND, payload, sizeof(payload));
+		ReplyToSocketWrapper(d->outgoingSocket, &replyTo, &reply);
+		nReplies++;
+	}
+}
+
+static DirectoryServerEntry *FindRegistration(DirectoryServer *d, DiscoveryRecord *record)
+{
+	for(int i = 0; i < d->nEntries; i++)
+	{
+		DiscoveryRecord *r = &d->entries[i].record;
+		if(r->address == record->address && r->port == record->port && strcmp(r->name, record->name) == 0)
+			return &d->entries[i];
+	}
+	return NULL;
+}
+
+/** The DiscoveryRecord at the start of m, as long as it's one we understand */
+static int ReadRecord(Message *m, DiscoveryRecord *record)
+{
+	if(m->dlen < sizeof(DiscoveryRecord))
+		return -1;
+
+	memcpy(record, m->data, sizeof(DiscoveryRecord));
+	if(record->version != DISCOVERY_RECORD_VERSION)
+		return -1;
+
+	record->name[PROCESS_MAX_CHARS - 1] = '\0';
+	return 0;
+}
+
+static double NowMilliseconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
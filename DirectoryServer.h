@@ -0,0 +1,90 @@
+/**
+@file
+@brief A directory of who is bound where, for networks that don't let multicast through
+
+DiscoverSupersocket() and the SupersocketListener normally find each other on the
+multicast network. Where that is blocked or rate-limited, a DirectoryServer can stand
+in for it: every process is pointed at the same one with SetSupersocketDirectoryServer(),
+and after that they register and look up names with the server over unicast UDP.
+
+The server speaks the listeners' own language. A listener registers each of its bound
+AF_INET SocketWrappers by sending it an ID_SUPERSOCKET_SOCKETWRAPPER_ANNOUNCE, whose
+lifetime is the lease it wants, and renews it well before the lease runs out. A lifetime
+of 0 takes the registration away again, and anything that isn't renewed in time is
+forgotten. Lookups are ordinary discovery requests, by name, by prefix or many names at
+once, and each answer is an ordinary reply followed by the nonce of the request (0 if it
+had none) and a uint32_t of how many milliseconds are left on the lease, which is how
+long the client caches it for.
+
+	@code
+		DirectoryServer d = {0};
+		InitializeDirectoryServer(&d, "0.0.0.0", DIRECTORY_SERVER_DEFAULT_PORT);
+		while(1)
+			ServeDirectory(&d, -1);
+	@endcode
+
+Tools/SupersocketDirectory.c is a program that does just that. For testing, a
+DirectoryServer can just as well be served from a thread of the process being tested.
+
+@authors David Brandman and Benjamin Shanahan
+*/
+
+#pragma once
+
+#include "SupersocketListener.h"
+
+/** The name of the server's own Supersocket */
+#define DIRECTORY_SERVER_NAME "SupersocketDirectory"
+
+/** Where the server listens unless it is told otherwise */
+#define DIRECTORY_SERVER_DEFAULT_PORT 5100
+
+/** The longest lease the server will give out, whatever it's asked for */
+#define DIRECTORY_SERVER_MAX_LEASE 300000 //Milliseconds
+
+/** How many registrations there is room for to start with. It doubles whenever it's full. */
+#define DIRECTORY_SERVER_INITIAL_ENTRIES 64
+
+/** One registered bound socket, and when its lease runs out (CLOCK_MONOTONIC, in milliseconds) */
+typedef struct
+{
+	DiscoveryRecord record;
+	double expires;
+
+} DirectoryServerEntry;
+
+/**
+@brief A directory server
+
+s is the server's own Supersocket, bound where the clients send to. Answers go out on
+outgoingSocket, to wherever each request says to send them.
+*/
+typedef struct
+{
+	Supersocket s;
+	int outgoingSocket;
+	Message buffer;
+
+	int nEntries;
+	int maxEntries;
+	DirectoryServerEntry *entries;
+
+} DirectoryServer;
+
+/**
+@brief Bind the server to ip and port, ready to be served
+*/
+int InitializeDirectoryServer(DirectoryServer *d, char *ip, int port);
+
+/**
+@brief Answer registrations and lookups for milliseconds (forever, if negative)
+
+Returns how many messages were handled, or -1 if the server couldn't poll its sockets.
+Messages that are cut short or malformed are dropped and don't count.
+*/
+int ServeDirectory(DirectoryServer *d, int milliseconds);
+
+/**
+@brief Close the server's sockets and forget everything registered with it
+*/
+int CloseDirectoryServer(DirectoryServer *d);
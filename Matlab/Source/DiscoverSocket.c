@@ -11,6 +11,12 @@
 static void ValidateInputs( int nlhs,       mxArray *plhs[],
                             int nrhs, const mxArray *prhs[]);
 
+/*
+ target = DiscoverSocket(supersocket, name, timeoutMs)
+
+ Blocks until name is found, or for at most timeoutMs if it's given, in which
+ case target is -1 when name wasn't found in time.
+*/
 void mexFunction( int nlhs,       mxArray *plhs[],
                   int nrhs, const mxArray *prhs[])
 {
@@ -20,9 +26,12 @@ void mexFunction( int nlhs,       mxArray *plhs[],
 
     Supersocket *s = mexGetSupersocketPointer(prhs[0]);
     char *name    = mxArrayToString(prhs[1]);
+    int timeout   = (nrhs > 2) ? (int) mxGetScalar(prhs[2]) : -1;
 
-    DiscoverSocket(s, name);
+    int target = DiscoverSupersocketTimeout(s, name, timeout);
+    mxFree(name);
 
+    plhs[0] = mxCreateDoubleScalar(target);
     return;
 }
 
@@ -30,8 +39,14 @@ void mexFunction( int nlhs,       mxArray *plhs[],
 static void ValidateInputs( int nlhs,       mxArray *plhs[],
                             int nrhs, const mxArray *prhs[])
 {
-  ConfirmNumInputs(nrhs, 2);
+  ConfirmAtLeastNumInputs(nrhs, 2);
+  if(nrhs > 3)
+    mexErrMsgIdAndTxt( "MATLAB:DiscoverSocket:invalidNumInputs",
+            "Function takes at most 3 inputs.");
+
   ConfirmIsInt64(prhs[0], 0);  // Pointer to supersocket
   ConfirmIsString(prhs[1], 1); // Name of supersocket to discover
+  if(nrhs > 2)
+    ConfirmIsDouble(prhs[2], 2); // Timeout, in milliseconds
   
 }
@@ -9,6 +9,12 @@
 static void ValidateInputs( int nlhs,       mxArray *plhs[],
                             int nrhs, const mxArray *prhs[]);
 
+/*
+ InitializeSupersocketListener(supersocket, announcePeriodMs)
+
+ If announcePeriodMs is given, the listener also announces the Supersocket to
+ everyone on the network about that often, starting straight away.
+*/
 void mexFunction( int nlhs,       mxArray *plhs[],
                   int nrhs, const mxArray *prhs[])
 {
@@ -17,6 +23,9 @@ void mexFunction( int nlhs,       mxArray *plhs[],
     ValidateInputs(nlhs, plhs, nrhs, prhs);
     Supersocket *s = mexGetSupersocketPointer(prhs[0]);
 
+    if(nrhs > 1)
+        EnableSupersocketAnnouncements(s, (int) mxGetScalar(prhs[1]));
+
     InitializeSupersocketListener(s);
 
 
@@ -27,6 +36,12 @@ void mexFunction( int nlhs,       mxArray *plhs[],
 static void ValidateInputs( int nlhs,       mxArray *plhs[],
                             int nrhs, const mxArray *prhs[])
 {
-  ConfirmNumInputs(nrhs, 1);
+  ConfirmAtLeastNumInputs(nrhs, 1);
+  if(nrhs > 2)
+    mexErrMsgIdAndTxt( "MATLAB:InitializeSupersocketListener:invalidNumInputs",
+            "Function takes at most 2 inputs.");
+
   ConfirmIsInt64(prhs[0], 0); // Pointer to supersocket
+  if(nrhs > 1)
+    ConfirmIsDouble(prhs[1], 1); // Announcement period, in milliseconds
 }
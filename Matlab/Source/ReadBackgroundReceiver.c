@@ -0,0 +1,73 @@
+#include "mex.h"
+#include "Display.h"
+#include "Supersocket.h"
+#include "BackgroundReceiver.h"
+#include "string.h"
+#include "SupersocketMatlabHeader.h"
+
+static void ValidateInputs( int nlhs,       mxArray *plhs[],
+                            int nrhs, const mxArray *prhs[]);
+
+/*
+ [data, lengths, nDropped, nReceived] = ReadBackgroundReceiver(receiver, maxMessages)
+
+ Collects everything the background receiver has buffered (or the first
+ maxMessages datagrams). data is a uint8 row vector with all of the datagrams
+ one after another and lengths says how long each one is, so 
+ mat2cell(data, 1, lengths) splits them up. nDropped is how many datagrams 
+ were thrown away since the start because the ring was full, and nReceived 
+ how many made it into the ring.
+*/
+void mexFunction( int nlhs,       mxArray *plhs[],
+                  int nrhs, const mxArray *prhs[])
+{
+    INITIALIZE_DISPLAY
+
+    ValidateInputs(nlhs, plhs, nrhs, prhs);
+
+    BackgroundReceiver *r = mexGetBackgroundReceiverPointer(prhs[0]);
+
+    int nPending;
+    uint64_t nBytes = BackgroundReceiverPending(r, &nPending);
+
+    int maxMessages = (nrhs > 1) ? (int) mxGetScalar(prhs[1]) : nPending;
+    if(maxMessages > nPending)
+      maxMessages = nPending;
+
+    /* Anything that arrives after we looked stays in the ring for next time */
+    plhs[0]     = mxCreateNumericMatrix(1, nBytes, mxUINT8_CLASS, mxREAL);
+    int *lengths = mxMalloc((maxMessages > 0 ? maxMessages : 1) * sizeof(int));
+
+    int n = ReadBackgroundReceiver(r, mxGetData(plhs[0]), (int) nBytes, lengths, maxMessages);
+
+    int nRead = 0;
+    plhs[1] = mxCreateDoubleMatrix(1, n, mxREAL);
+    double *output = mxGetPr(plhs[1]);
+    for(int i = 0; i < n; i++)
+    {
+      output[i] = lengths[i];
+      nRead     += lengths[i];
+    }
+    mxSetN(plhs[0], nRead);
+    mxFree(lengths);
+
+    if(nlhs > 2)
+      plhs[2] = mxCreateDoubleScalar((double) r->nDropped);
+    if(nlhs > 3)
+      plhs[3] = mxCreateDoubleScalar((double) r->nReceived);
+    return;
+}
+
+
+static void ValidateInputs( int nlhs,       mxArray *plhs[],
+                            int nrhs, const mxArray *prhs[])
+{
+  ConfirmAtLeastNumInputs(nrhs, 1);
+  if(nrhs > 2)
+    mexErrMsgIdAndTxt( "MATLAB:ReadBackgroundReceiver:invalidNumInputs",
+            "Function takes at most 2 inputs.");
+
+  ConfirmIsInt64(prhs[0], 0); // Pointer to the background receiver
+  if(nrhs > 1)
+    ConfirmIsDouble(prhs[1], 1); // Largest number of messages to return
+}
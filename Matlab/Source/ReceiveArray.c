@@ -0,0 +1,73 @@
+#include "mex.h"
+#include "Display.h"
+#include "SocketWrapper.h"
+#include "Supersocket.h"
+#include "TypedArray.h"
+#include "string.h"
+#include "SupersocketMatlabHeader.h"
+
+static void ValidateInputs( int nlhs,       mxArray *plhs[],
+                            int nrhs, const mxArray *prhs[]);
+
+/*
+ array = ReceiveArray(supersocket)
+
+ Receives a typed array and returns it with its own class and shape, so there
+ is no typecast() or reshape() to do afterwards. The elements are received
+ straight into the memory that becomes the output mxArray.
+
+ Matlab is column-major. An array that was sent row-major (from C or numpy)
+ comes back with its dimensions reversed, which is the same elements viewed
+ the Matlab way: a 3x4 numpy array arrives as its 4x3 transpose.
+*/
+void mexFunction( int nlhs,       mxArray *plhs[],
+                  int nrhs, const mxArray *prhs[])
+{
+    INITIALIZE_DISPLAY
+
+    ValidateInputs(nlhs, plhs, nrhs, prhs);
+
+    Supersocket *s  = mexGetSupersocketPointer(prhs[0]);
+
+    Message m = {0};
+    m.dlen    = ARRAY_MAX_BYTES;
+    m.data    = mxMalloc(m.dlen);
+
+    ArrayHeader h;
+    int nBytes = ReceiveArray(s, &m, &h);
+    if(nBytes < 0)
+    {
+      mxFree(m.data);
+      mexErrMsgIdAndTxt( "MATLAB:ReceiveArray:receiveFailed",
+              "Unable to receive a typed array.");
+    }
+
+    mxClassID classID = mexArrayDtypeToClassID(h.dtype);
+
+    /* Matlab arrays have at least two dimensions, so a vector becomes a row */
+    mwSize ndim = h.ndim < 2 ? 2 : h.ndim;
+    mwSize dims[ARRAY_MAX_DIMS] = {1, 1};
+    if(h.ndim == 1)
+      dims[1] = h.shape[0];
+    else
+      for(int i = 0; i < h.ndim; i++)
+        dims[i] = (h.order == ARRAY_ORDER_COLUMN_MAJOR) ? h.shape[i] : h.shape[h.ndim - 1 - i];
+
+    if(classID == mxLOGICAL_CLASS)
+      plhs[0] = mxCreateLogicalMatrix(0, 0);
+    else
+      plhs[0] = mxCreateNumericMatrix(0, 0, classID, mxREAL);
+
+    /* Point mxArray at the elements we just received */
+    mxSetData(plhs[0], mxRealloc(m.data, nBytes > 0 ? nBytes : 1));
+    mxSetDimensions(plhs[0], dims, ndim);
+    return;
+}
+
+
+static void ValidateInputs( int nlhs,       mxArray *plhs[],
+                            int nrhs, const mxArray *prhs[])
+{
+  ConfirmNumInputs(nrhs, 1);
+  ConfirmIsInt64(prhs[0], 0); // Pointer to supersocket
+}
@@ -11,6 +11,13 @@
 static void ValidateInputs( int nlhs,       mxArray *plhs[],
                             int nrhs, const mxArray *prhs[]);
 
+/*
+ data = ReceiveData(supersocket, timeoutMs)
+
+ Blocks until a datagram arrives, or for at most timeoutMs if it's given, in
+ which case data comes back empty when nothing arrived. See 
+ ReceiveDataBatch() for reading many datagrams at once.
+*/
 void mexFunction( int nlhs,       mxArray *plhs[],
                   int nrhs, const mxArray *prhs[])
 {
@@ -19,9 +26,10 @@ void mexFunction( int nlhs,       mxArray *plhs[],
     ValidateInputs(nlhs, plhs, nrhs, prhs);
 
     Supersocket *s  = mexGetSupersocketPointer(prhs[0]);
+    int timeout     = (nrhs > 1) ? (int) mxGetScalar(prhs[1]) : -1;
     void *data      = mxCalloc(1, DEFAULT_BUFFER_SIZE); 
 
-    int readSize = ReceiveData(s, data, DEFAULT_BUFFER_SIZE, 0);
+    int readSize = ReceiveDataTimeout(s, data, DEFAULT_BUFFER_SIZE, timeout, 0);
 
     if(readSize < 0)
     {
@@ -29,9 +37,12 @@ void mexFunction( int nlhs,       mxArray *plhs[],
       return;
     }
 
-
-
     plhs[0] = mxCreateNumericMatrix(1, readSize, mxUINT8_CLASS, mxREAL);
+    if(readSize == 0)
+    {
+      mxFree(data);
+      return;
+    }
 
     data = mxRealloc(data, readSize);
 
@@ -44,8 +55,14 @@ void mexFunction( int nlhs,       mxArray *plhs[],
 static void ValidateInputs( int nlhs,       mxArray *plhs[],
                             int nrhs, const mxArray *prhs[])
 {
-  ConfirmNumInputs(nrhs, 1);
+  ConfirmAtLeastNumInputs(nrhs, 1);
+  if(nrhs > 2)
+    mexErrMsgIdAndTxt( "MATLAB:ReceiveData:invalidNumInputs",
+            "Function takes at most 2 inputs.");
+
   ConfirmIsInt64(prhs[0], 0); // Pointer to supersocket
+  if(nrhs > 1)
+    ConfirmIsDouble(prhs[1], 1); // Timeout, in milliseconds
 
   
 }
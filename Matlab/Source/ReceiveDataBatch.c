@@ -0,0 +1,97 @@
+#include "mex.h"
+#include "Display.h"
+#include "SocketWrapper.h"
+#include "Supersocket.h"
+#include "SupersocketListener.h"
+#include "string.h"
+#include "SupersocketMatlabHeader.h"
+
+/* The pool is kept between calls, so we never allocate while receiving */
+#define BATCH_POOL_SIZE     (4 * 1024 * 1024)
+#define MAX_DATAGRAM_SIZE   65507
+#define BATCH_MAX_MESSAGES  4096
+
+static void ValidateInputs( int nlhs,       mxArray *plhs[],
+                            int nrhs, const mxArray *prhs[]);
+static void FreePool(void);
+
+static void *pool = NULL;
+
+/*
+ [data, lengths] = ReceiveDataBatch(supersocket, maxMessages, timeoutMs)
+
+ Receives everything that is waiting, in one call. data is a uint8 row 
+ vector holding all of the datagrams one after another, and lengths says
+ how long each one is, so mat2cell(data, 1, lengths) splits them up.
+
+ Waits up to timeoutMs for the first datagram (forever if it's negative or
+ left out) and then takes whatever else is already pending without waiting,
+ until there is nothing left or maxMessages (at most 4096) have been read. 
+ On a timeout both outputs are empty.
+*/
+void mexFunction( int nlhs,       mxArray *plhs[],
+                  int nrhs, const mxArray *prhs[])
+{
+    INITIALIZE_DISPLAY
+
+    ValidateInputs(nlhs, plhs, nrhs, prhs);
+
+    Supersocket *s  = mexGetSupersocketPointer(prhs[0]);
+    int maxMessages = (nrhs > 1) ? (int) mxGetScalar(prhs[1]) : BATCH_MAX_MESSAGES;
+    int timeout     = (nrhs > 2) ? (int) mxGetScalar(prhs[2]) : -1;
+
+    if(pool == NULL)
+    {
+        pool = mxMalloc(BATCH_POOL_SIZE);
+        mexMakeMemoryPersistent(pool);
+        mexAtExit(FreePool);
+    }
+
+    if(maxMessages > BATCH_MAX_MESSAGES)
+        maxMessages = BATCH_MAX_MESSAGES;
+    double *lengths = mxMalloc((maxMessages > 0 ? maxMessages : 1) * sizeof(double));
+
+    int nMessages   = 0;
+    int nBytes      = 0;
+    while(nMessages < maxMessages && BATCH_POOL_SIZE - nBytes >= MAX_DATAGRAM_SIZE)
+    {
+        // Only the first datagram is waited for; the rest are already here or not at all
+        int wait = (nMessages == 0) ? timeout : 0;
+        int readSize = ReceiveDataTimeout(s, (char *) pool + nBytes, MAX_DATAGRAM_SIZE, wait, NULL);
+        if(readSize <= 0)
+            break;
+
+        lengths[nMessages++]    = readSize;
+        nBytes                  += readSize;
+    }
+
+    plhs[0] = mxCreateNumericMatrix(1, nBytes, mxUINT8_CLASS, mxREAL);
+    memcpy(mxGetData(plhs[0]), pool, nBytes);
+
+    plhs[1] = mxCreateDoubleMatrix(1, 0, mxREAL);
+    mxSetData(plhs[1], mxRealloc(lengths, (nMessages > 0 ? nMessages : 1) * sizeof(double)));
+    mxSetN(plhs[1], nMessages);
+    return;
+}
+
+
+static void ValidateInputs( int nlhs,       mxArray *plhs[],
+                            int nrhs, const mxArray *prhs[])
+{
+  ConfirmAtLeastNumInputs(nrhs, 1);
+  if(nrhs > 3)
+    mexErrMsgIdAndTxt( "MATLAB:ReceiveDataBatch:invalidNumInputs",
+            "Function takes at most 3 inputs.");
+
+  ConfirmIsInt64(prhs[0], 0); // Pointer to supersocket
+  if(nrhs > 1)
+    ConfirmIsDouble(prhs[1], 1); // Largest number of messages to return
+  if(nrhs > 2)
+    ConfirmIsDouble(prhs[2], 2); // Timeout, in milliseconds
+}
+
+static void FreePool(void)
+{
+    mxFree(pool);
+    pool = NULL;
+}
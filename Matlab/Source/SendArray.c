@@ -0,0 +1,62 @@
+#include "mex.h"
+#include "Display.h"
+#include "SocketWrapper.h"
+#include "Supersocket.h"
+#include "TypedArray.h"
+#include "string.h"
+#include "SupersocketMatlabHeader.h"
+
+static void ValidateInputs( int nlhs,       mxArray *plhs[],
+                            int nrhs, const mxArray *prhs[]);
+
+/*
+ SendArray(supersocket, target, array)
+
+ Sends a numeric or logical array as a typed array. Matlab stores arrays
+ column-major, and that's what goes in the header, so numpy on the other end
+ gets back an array with the same shape.
+*/
+void mexFunction( int nlhs,       mxArray *plhs[],
+                  int nrhs, const mxArray *prhs[])
+{
+    INITIALIZE_DISPLAY
+
+    ValidateInputs(nlhs, plhs, nrhs, prhs);
+
+    Supersocket *s = mexGetSupersocketPointer(prhs[0]);
+    int target     = (int) mxGetScalar(prhs[1]);
+
+    int dtype = mexClassIDToArrayDtype(mxGetClassID(prhs[2]));
+    if(dtype == ARRAY_DTYPE_UNDEFINED)
+      mexErrMsgIdAndTxt( "MATLAB:SendArray:invalidClass",
+              "Input (2) must be a real numeric or logical array.");
+
+    mwSize ndim         = mxGetNumberOfDimensions(prhs[2]);
+    const mwSize *dims  = mxGetDimensions(prhs[2]);
+    if(ndim > ARRAY_MAX_DIMS)
+      mexErrMsgIdAndTxt( "MATLAB:SendArray:tooManyDimensions",
+              "Input (2) can have at most %d dimensions.", ARRAY_MAX_DIMS);
+
+    uint32_t shape[ARRAY_MAX_DIMS];
+    for(mwSize i = 0; i < ndim; i++)
+      shape[i] = (uint32_t) dims[i];
+
+    ArrayHeader h;
+    PopulateArrayHeader(&h, dtype, ARRAY_ORDER_COLUMN_MAJOR, (int) ndim, shape);
+
+    SendArray(s, target, 0, &h, mxGetData(prhs[2]));
+
+    return;
+}
+
+
+static void ValidateInputs( int nlhs,       mxArray *plhs[],
+                            int nrhs, const mxArray *prhs[])
+{
+  ConfirmNumInputs(nrhs, 3);
+  ConfirmIsInt64(prhs[0], 0);  // Pointer to supersocket
+  ConfirmIsDouble(prhs[1], 1); // Target
+  if(mxIsComplex(prhs[2]))
+    mexErrMsgIdAndTxt( "MATLAB:SendArray:invalidClass",
+            "Input (2) must be a real numeric or logical array.");
+}
@@ -9,6 +9,11 @@
 static void ValidateInputs( int nlhs,       mxArray *plhs[],
                             int nrhs, const mxArray *prhs[]);
 
+/*
+ SendData(supersocket, data, dlen, name)
+
+ Sends to the contact called name, or to every contact if name isn't given.
+*/
 void mexFunction( int nlhs,       mxArray *plhs[],
                   int nrhs, const mxArray *prhs[])
 {
@@ -20,7 +25,14 @@ void mexFunction( int nlhs,       mxArray *plhs[],
     void *data 		 = mxGetData(prhs[1]);
     int dlen   		 = (int) mxGetScalar(prhs[2]); 
 
-    SendData(s, data, dlen, 0);
+    if(nrhs > 3)
+    {
+        char *name = mxArrayToString(prhs[3]);
+        SendDataByName(s, name, data, dlen, 0);
+        mxFree(name);
+    }
+    else
+        SendDataToAll(s, data, dlen, 0);
 
 
     return;
@@ -30,10 +42,16 @@ void mexFunction( int nlhs,       mxArray *plhs[],
 static void ValidateInputs( int nlhs,       mxArray *plhs[],
                             int nrhs, const mxArray *prhs[])
 {
-  ConfirmNumInputs(nrhs, 3);
+  ConfirmAtLeastNumInputs(nrhs, 3);
+  if(nrhs > 4)
+    mexErrMsgIdAndTxt( "MATLAB:SendData:invalidNumInputs",
+            "Function takes at most 4 inputs.");
+
   ConfirmIsInt64(prhs[0], 0); // Pointer to supersocket
   // NO CONFIRMATION FOR THE SECOND ENTRY. IT CAN BE ANYTHING
   ConfirmIsDouble(prhs[2], 2); // Data Length
+  if(nrhs > 3)
+    ConfirmIsString(prhs[3], 3); // Name of the contact
 
   
 }
@@ -0,0 +1,67 @@
+#include "mex.h"
+#include "Display.h"
+#include "Supersocket.h"
+#include "BackgroundReceiver.h"
+#include "string.h"
+#include "SupersocketMatlabHeader.h"
+
+#define DEFAULT_RING_SIZE (64 * 1024 * 1024)
+
+static void ValidateInputs( int nlhs,       mxArray *plhs[],
+                            int nrhs, const mxArray *prhs[]);
+
+/*
+ receiver = StartBackgroundReceiver(supersocket, ringBytes)
+
+ Starts a thread that keeps reading the bound sockets of the supersocket into
+ a ring buffer of ringBytes (64 MB if left out), so nothing is lost while
+ Matlab is busy. Use ReadBackgroundReceiver() to collect what arrived, and
+ StopBackgroundReceiver() when done. Don't call ReceiveData() on the same
+ supersocket in the meantime.
+*/
+void mexFunction( int nlhs,       mxArray *plhs[],
+                  int nrhs, const mxArray *prhs[])
+{
+    INITIALIZE_DISPLAY
+
+    ValidateInputs(nlhs, plhs, nrhs, prhs);
+
+    Supersocket *s  = mexGetSupersocketPointer(prhs[0]);
+    double ringSize = (nrhs > 1) ? mxGetScalar(prhs[1]) : DEFAULT_RING_SIZE;
+
+    if(ringSize < BACKGROUND_RECEIVER_MAX_DATAGRAM + sizeof(uint32_t))
+      mexErrMsgIdAndTxt( "MATLAB:StartBackgroundReceiver:ringTooSmall",
+              "The ring must hold at least %d bytes.", BACKGROUND_RECEIVER_MAX_DATAGRAM + (int) sizeof(uint32_t));
+
+    IVP myValue = {0};
+    myValue.thePointer = mxCalloc(1, sizeof(BackgroundReceiver)); 
+    mexMakeMemoryPersistent(myValue.thePointer);
+
+    if(StartBackgroundReceiver(myValue.thePointer, s, (uint64_t) ringSize) < 0)
+    {
+      mxFree(myValue.thePointer);
+      mexErrMsgIdAndTxt( "MATLAB:StartBackgroundReceiver:startFailed",
+              "Unable to start the background receiver.");
+    }
+
+    plhs[0] = mxCreateNumericMatrix(1,1,mxINT64_CLASS,mxREAL);
+    long long *ip;
+    ip = (long long *) mxGetData(plhs[0]);
+    *ip = myValue.theInteger;
+
+    return;
+}
+
+
+static void ValidateInputs( int nlhs,       mxArray *plhs[],
+                            int nrhs, const mxArray *prhs[])
+{
+  ConfirmAtLeastNumInputs(nrhs, 1);
+  if(nrhs > 2)
+    mexErrMsgIdAndTxt( "MATLAB:StartBackgroundReceiver:invalidNumInputs",
+            "Function takes at most 2 inputs.");
+
+  ConfirmIsInt64(prhs[0], 0); // Pointer to supersocket
+  if(nrhs > 1)
+    ConfirmIsDouble(prhs[1], 1); // Size of the ring, in bytes
+}
@@ -0,0 +1,37 @@
+#include "mex.h"
+#include "Display.h"
+#include "Supersocket.h"
+#include "BackgroundReceiver.h"
+#include "string.h"
+#include "SupersocketMatlabHeader.h"
+
+static void ValidateInputs( int nlhs,       mxArray *plhs[],
+                            int nrhs, const mxArray *prhs[]);
+
+/*
+ StopBackgroundReceiver(receiver)
+
+ Stops the thread started by StartBackgroundReceiver() and frees its ring.
+ The receiver can't be used afterwards.
+*/
+void mexFunction( int nlhs,       mxArray *plhs[],
+                  int nrhs, const mxArray *prhs[])
+{
+    INITIALIZE_DISPLAY
+
+    ValidateInputs(nlhs, plhs, nrhs, prhs);
+
+    BackgroundReceiver *r = mexGetBackgroundReceiverPointer(prhs[0]);
+
+    StopBackgroundReceiver(r);
+    mxFree(r);
+    return;
+}
+
+
+static void ValidateInputs( int nlhs,       mxArray *plhs[],
+                            int nrhs, const mxArray *prhs[])
+{
+  ConfirmNumInputs(nrhs, 1);
+  ConfirmIsInt64(prhs[0], 0); // Pointer to the background receiver
+}
@@ -1,5 +1,6 @@
 
 #include "SupersocketMatlabHeader.h"
+#include "TypedArray.h"
 
 Supersocket *mexGetSupersocketPointer(const mxArray *m)
 {
@@ -14,6 +15,14 @@ Supersocket *mexGetSupersocketPointer(const mxArray *m)
     return s;
 }
 
+BackgroundReceiver *mexGetBackgroundReceiverPointer(const mxArray *m)
+{
+    IVP myValue = {0};
+    myValue.theInteger = *(long long *) mxGetData(m);
+
+    return myValue.thePointer;
+}
+
 
 
 void ConfirmNumInputs(int nrhs, int n)
@@ -25,7 +34,7 @@ void ConfirmNumInputs(int nrhs, int n)
 
 void ConfirmAtLeastNumInputs(int nrhs, int n)
 {
-    if(nrhs != n) 
+    if(nrhs < n) 
       mexErrMsgIdAndTxt( "MATLAB:revord:invalidNumInputs",
               "Function requires at least %d inputs.", n);	
 }
@@ -72,4 +81,42 @@ void ConfirmIsCell(const mxArray *d, int n)
       mexErrMsgIdAndTxt( "MATLAB:revord:inputNotString",
               "Input (%d) must be a cell array.", n);
 
-}
\ No newline at end of file
+}
+
+int mexClassIDToArrayDtype(mxClassID classID)
+{
+    switch (classID)
+    {
+        case mxINT8_CLASS    : return ARRAY_DTYPE_INT8;
+        case mxUINT8_CLASS   : return ARRAY_DTYPE_UINT8;
+        case mxINT16_CLASS   : return ARRAY_DTYPE_INT16;
+        case mxUINT16_CLASS  : return ARRAY_DTYPE_UINT16;
+        case mxINT32_CLASS   : return ARRAY_DTYPE_INT32;
+        case mxUINT32_CLASS  : return ARRAY_DTYPE_UINT32;
+        case mxINT64_CLASS   : return ARRAY_DTYPE_INT64;
+        case mxUINT64_CLASS  : return ARRAY_DTYPE_UINT64;
+        case mxSINGLE_CLASS  : return ARRAY_DTYPE_FLOAT32;
+        case mxDOUBLE_CLASS  : return ARRAY_DTYPE_FLOAT64;
+        case mxLOGICAL_CLASS : return ARRAY_DTYPE_BOOL;
+        default              : return ARRAY_DTYPE_UNDEFINED;
+    }
+}
+
+mxClassID mexArrayDtypeToClassID(int dtype)
+{
+    switch (dtype)
+    {
+        case ARRAY_DTYPE_INT8    : return mxINT8_CLASS;
+        case ARRAY_DTYPE_UINT8   : return mxUINT8_CLASS;
+        case ARRAY_DTYPE_INT16   : return mxINT16_CLASS;
+        case ARRAY_DTYPE_UINT16  : return mxUINT16_CLASS;
+        case ARRAY_DTYPE_INT32   : return mxINT32_CLASS;
+        case ARRAY_DTYPE_UINT32  : return mxUINT32_CLASS;
+        case ARRAY_DTYPE_INT64   : return mxINT64_CLASS;
+        case ARRAY_DTYPE_UINT64  : return mxUINT64_CLASS;
+        case ARRAY_DTYPE_FLOAT32 : return mxSINGLE_CLASS;
+        case ARRAY_DTYPE_FLOAT64 : return mxDOUBLE_CLASS;
+        case ARRAY_DTYPE_BOOL    : return mxLOGICAL_CLASS;
+        default                  : return mxUINT8_CLASS;
+    }
+}
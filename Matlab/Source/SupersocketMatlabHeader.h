@@ -1,5 +1,6 @@
 #include "mex.h"
 #include "Supersocket.h"
+#include "BackgroundReceiver.h"
 
 
 #define INITIALIZE_DISPLAY \
@@ -20,6 +21,7 @@ typedef union
 } IVP;
 
 Supersocket *mexGetSupersocketPointer(const mxArray *m);
+BackgroundReceiver *mexGetBackgroundReceiverPointer(const mxArray *m);
 
 
 void ConfirmNumInputs(int nrhs, int n);
@@ -28,3 +30,6 @@ void ConfirmIsDouble(const mxArray *d, int n);
 void ConfirmIsString(const mxArray *d, int n);
 void ConfirmIsCell(const mxArray *d, int n);
 void ConfirmIsInt64(const mxArray *d, int n);
+
+int mexClassIDToArrayDtype(mxClassID classID);
+mxClassID mexArrayDtypeToClassID(int dtype);
@@ -10,6 +10,7 @@ InitializeSupersocketListener(bob)
 %%
 
 DiscoverSocket(alice, 'Bob');
+assert(DiscoverSocket(alice, 'Nobody', 500) == -1);
 
 %%
 
@@ -18,3 +19,23 @@ SendData(alice, stringToSend, length(stringToSend));
 fprintf('[Alice]: %s\n',ReceiveData(bob));
 
 
+
+%%
+
+for ii = 1:10
+    SendData(alice, stringToSend, length(stringToSend));
+end
+[data, lengths] = ReceiveDataBatch(bob, 100, 50);
+messages = mat2cell(data, 1, lengths);
+fprintf('[Alice]: %d messages in one batch\n', numel(messages));
+
+%%
+
+receiver = StartBackgroundReceiver(bob);
+for ii = 1:10
+    SendData(alice, stringToSend, length(stringToSend));
+end
+pause(0.1);
+[data, lengths, nDropped] = ReadBackgroundReceiver(receiver);
+fprintf('[Alice]: %d messages in the background, %d dropped\n', numel(lengths), nDropped);
+StopBackgroundReceiver(receiver);
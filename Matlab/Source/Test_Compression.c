@@ -0,0 +1,109 @@
+#include "Compression.h"
+#include "Supersocket.h"
+#include <stdio.h>
+
+/*
+ mex -DMATLAB GCC=/usr/bin/gcc-4.9 Test_Compression.c CFLAGS="-std=c11 -fPIC" ../../Display.c ../../ManageHeapMemory.c ../../Compression.c -I../../ -L/usr/local/MATLAB/R2017b/sys/os/glnxa64/
+
+ Round trips a handful of payloads through CompressBuffer() and DecompressBuffer(),
+ then checks that blocks which were cut short or tampered with are turned away
+ rather than read or written past the end of.
+*/
+
+#define LARGE_LENGTH 200000
+
+static void Check(int condition, char *what)
+{
+	if(condition == 0)
+		mexErrMsgIdAndTxt("MATLAB:Test_Compression:failed", "%s", what);
+}
+
+static void CheckRoundTrip(const uint8_t *source, int length, char *what)
+{
+	uint8_t *compressed = malloc(CompressBound(length));
+	uint8_t *restored 	= malloc(length + 1);
+
+	int n = CompressBuffer(source, length, compressed, CompressBound(length));
+	Check(n > 0 && n <= CompressBound(length), what);
+	Check(DecompressBuffer(compressed, n, restored, length) == length, what);
+	Check(memcmp(source, restored, length) == 0, what);
+
+	// One byte short of room has to fail, not overrun
+	if(length > 0)
+		Check(DecompressBuffer(compressed, n, restored, length - 1) == -1, what);
+
+	// Cutting the block short must never produce the whole payload
+	for(int i = 1; i < n; i++)
+		Check(DecompressBuffer(compressed, i, restored, length) < length, what);
+
+	free(compressed);
+	free(restored);
+}
+
+void mexFunction( int nlhs,       mxArray *plhs[],
+                  int nrhs, const mxArray *prhs[])
+{
+    int argc = 1;
+    char *argv[1];
+    argv[0] = "FILENAME";
+
+    InitializeDisplay(argc, argv);
+    SetColorfulness(DISABLE);
+    SetVerbose(ENABLE);
+
+	uint8_t *source = malloc(LARGE_LENGTH);
+
+	char text[] = "The quick brown fox jumps over the lazy dog. The quick brown fox jumps over the lazy cat.";
+	CheckRoundTrip((uint8_t *) text, strlen(text), "Text didn't survive the round trip");
+
+	CheckRoundTrip((uint8_t *) "ab", 2, "Short input didn't survive the round trip");
+
+	memset(source, 0, 4096);
+	CheckRoundTrip(source, 4096, "Zeros didn't survive the round trip");
+
+	// Something that doesn't compress still fits in CompressBound()
+	uint32_t x = 2463534242;
+	for(int i = 0; i < 4096; i++)
+	{
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		source[i] = (uint8_t) x;
+	}
+	CheckRoundTrip(source, 4096, "Noise didn't survive the round trip");
+
+	uint8_t compressed[CompressBound(4096)];
+	Check(CompressBuffer(source, 4096, compressed, 4095) == -1, "Compressed noise into less room than it needs");
+
+	// Long enough that repeats are further back than a back-reference can reach
+	for(int i = 0; i < LARGE_LENGTH; i++)
+		source[i] = (uint8_t) ((i % 70001) * 7 + (i / 1000));
+	CheckRoundTrip(source, LARGE_LENGTH, "Large input didn't survive the round trip");
+
+	// Blocks that were never made by CompressBuffer()
+	uint8_t restored[64];
+	uint8_t beforeStart[] 	= {0x10, 'a', 5, 0, 0x00};   // Refers back past the first byte
+	uint8_t zeroOffset[] 	= {0x10, 'a', 0, 0, 0x00};   // Refers to itself
+	uint8_t tooLong[] 		= {0xF0, 255, 255, 'a'};     // More literals than there are
+	uint8_t tooBig[] 		= {0x1F, 'a', 1, 0, 200};    // Expands past the destination
+
+	Check(DecompressBuffer(beforeStart, sizeof(beforeStart), restored, sizeof(restored)) == -1, "Accepted a reference before the start");
+	Check(DecompressBuffer(zeroOffset, sizeof(zeroOffset), restored, sizeof(restored)) == -1, "Accepted a zero offset");
+	Check(DecompressBuffer(tooLong, sizeof(tooLong), restored, sizeof(restored)) == -1, "Read literals past the end");
+	Check(DecompressBuffer(tooBig, sizeof(tooBig), restored, sizeof(restored)) == -1, "Wrote past the end");
+	Check(DecompressBuffer(tooBig, 0, restored, sizeof(restored)) == -1, "Accepted an empty block");
+
+	// Flipping any one byte of a real block mustn't take us out of bounds
+	int n = CompressBuffer(text, strlen(text), compressed, sizeof(compressed));
+	for(int i = 0; i < n; i++)
+	{
+		compressed[i] ^= 0xFF;
+		int m = DecompressBuffer(compressed, n, restored, sizeof(restored));
+		Check(m >= -1 && m <= (int) sizeof(restored), "Corrupt block decoded out of bounds");
+		compressed[i] ^= 0xFF;
+	}
+
+	free(source);
+
+	Display("Compression OK!");
+}
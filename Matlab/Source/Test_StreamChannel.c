@@ -0,0 +1,159 @@
+#include "StreamChannel.h"
+#include <stdio.h>
+
+/*
+ mex -DMATLAB GCC=/usr/bin/gcc-4.9 Test_StreamChannel.c CFLAGS="-std=c11 -fPIC" ../../Display.c ../../ManageHeapMemory.c ../../SocketWrapper.c ../../Message.c ../../Compression.c ../../PeerCache.c ../../TypedArray.c ../../Supersocket.c ../../SupersocketListener.c ../../StreamChannel.c -I../../ -L/usr/local/MATLAB/R2017b/sys/os/glnxa64/
+
+ Sends a stream of frames from Alice to Bob over a StreamChannel that puts out a
+ keyframe every KEYFRAME_INTERVAL frames, and checks that Bob gets back exactly
+ what was sent. Along the way one delta goes missing, and Bob has to turn away
+ the deltas after it until the next keyframe comes through.
+*/
+
+#define KEYFRAME_INTERVAL 	4
+#define FRAME_LENGTH 		256
+#define BUFFER_LENGTH 		(FRAME_LENGTH + STREAM_CHANNEL_HEADER_LENGTH)
+
+static uint8_t frame[FRAME_LENGTH];
+
+static void Check(int condition, char *what)
+{
+	if(condition == 0)
+		mexErrMsgIdAndTxt("MATLAB:Test_StreamChannel:failed", "%s", what);
+}
+
+// Long unchanged stretches with a few bytes moving about, like telemetry does
+static void NextFrame(int n)
+{
+	frame[(n * 37) % FRAME_LENGTH] ^= (uint8_t) (n + 1);
+	memcpy(&frame[100], &n, sizeof(n));
+}
+
+static int SendFrame(Supersocket *alice, int target, StreamChannel *c, int length)
+{
+	Message m = CreateMessage("Alice", 7, frame, length);
+	return SendStreamMessage(alice, target, c, &m);
+}
+
+static void ReceiveFrame(Supersocket *bob, Message *r)
+{
+	r->dlen = BUFFER_LENGTH;
+	Check(ReceiveMessageTimeout(bob, r, 1000) > 0, "Frame never arrived");
+}
+
+static void CheckFrame(StreamChannel *c, Message *r, int length, char *what)
+{
+	Check(DecodeStreamMessage(c, r, BUFFER_LENGTH) == length, what);
+	Check(r->dlen == (uint32_t) length && memcmp(r->data, frame, length) == 0, what);
+}
+
+void mexFunction( int nlhs,       mxArray *plhs[],
+                  int nrhs, const mxArray *prhs[])
+{
+    int argc = 1;
+    char *argv[1];
+    argv[0] = "FILENAME";
+
+    InitializeDisplay(argc, argv);
+    SetColorfulness(DISABLE);
+    SetVerbose(ENABLE);
+
+	Supersocket alice 	= {0};
+	Supersocket bob 	= {0};
+
+	int target = AddSocket(&alice, "Bob", "127.0.0.1", 5010, AF_INET, SOCK_DGRAM, CONNECT);
+	AddSocket(&bob, "Bob", "127.0.0.1", 5010, AF_INET, SOCK_DGRAM, BIND);
+
+	StreamChannel sending 	= {0};
+	StreamChannel receiving = {0};
+	InitializeStreamChannel(&sending, KEYFRAME_INTERVAL);
+	InitializeStreamChannel(&receiving, 0);
+
+	uint8_t buffer[BUFFER_LENGTH];
+	Message r = {0};
+	r.data = buffer;
+
+	// A keyframe and the deltas that follow it
+	for(int n = 0; n < KEYFRAME_INTERVAL; n++)
+	{
+		NextFrame(n);
+		SendFrame(&alice, target, &sending, FRAME_LENGTH);
+		ReceiveFrame(&bob, &r);
+
+		int expected = n == 0 ? MESSAGE_FLAG_STREAM_KEYFRAME : MESSAGE_FLAG_STREAM_DELTA;
+		Check((r.flags & expected) != 0, "Wrong kind of frame sent");
+		Check(r.dlen < FRAME_LENGTH || n == 0, "Delta is no smaller than the frame");
+		CheckFrame(&receiving, &r, FRAME_LENGTH, "Frame didn't survive the round trip");
+	}
+
+	// The next keyframe arrives, and then the delta after it goes missing
+	NextFrame(4);
+	SendFrame(&alice, target, &sending, FRAME_LENGTH);
+	ReceiveFrame(&bob, &r);
+	Check((r.flags & MESSAGE_FLAG_STREAM_KEYFRAME) != 0, "Keyframe interval not kept");
+	CheckFrame(&receiving, &r, FRAME_LENGTH, "Keyframe didn't survive the round trip");
+
+	NextFrame(5);
+	SendFrame(&alice, target, &sending, FRAME_LENGTH);
+	ReceiveFrame(&bob, &r);
+
+	for(int n = 6; n < 2 * KEYFRAME_INTERVAL; n++)
+	{
+		NextFrame(n);
+		SendFrame(&alice, target, &sending, FRAME_LENGTH);
+		ReceiveFrame(&bob, &r);
+		Check(DecodeStreamMessage(&receiving, &r, BUFFER_LENGTH) == -1, "Decoded a delta after a lost frame");
+	}
+
+	// Back in step at the keyframe, and the delta after it decodes again
+	for(int n = 2 * KEYFRAME_INTERVAL; n < 2 * KEYFRAME_INTERVAL + 2; n++)
+	{
+		NextFrame(n);
+		SendFrame(&alice, target, &sending, FRAME_LENGTH);
+		ReceiveFrame(&bob, &r);
+		CheckFrame(&receiving, &r, FRAME_LENGTH, "Didn't recover at the next keyframe");
+	}
+
+	// A frame that changes size has to go out as a keyframe
+	NextFrame(10);
+	SendFrame(&alice, target, &sending, FRAME_LENGTH / 2);
+	ReceiveFrame(&bob, &r);
+	Check((r.flags & MESSAGE_FLAG_STREAM_KEYFRAME) != 0, "Frame size changed without a keyframe");
+	CheckFrame(&receiving, &r, FRAME_LENGTH / 2, "Smaller frame didn't survive the round trip");
+
+	// So does one where every byte changed, since its delta is no smaller
+	for(int i = 0; i < FRAME_LENGTH / 2; i++)
+		frame[i] = (uint8_t) (i * 131 + 17) | 1;
+	SendFrame(&alice, target, &sending, FRAME_LENGTH / 2);
+	ReceiveFrame(&bob, &r);
+	Check((r.flags & MESSAGE_FLAG_STREAM_KEYFRAME) != 0, "Sent a delta bigger than the frame");
+	CheckFrame(&receiving, &r, FRAME_LENGTH / 2, "Changed frame didn't survive the round trip");
+
+	// ReceiveStreamMessage() skips over what it can't decode on its own
+	NextFrame(12);
+	SendFrame(&alice, target, &sending, FRAME_LENGTH / 2);
+	ReceiveFrame(&bob, &r);
+	for(int n = 13; n <= 4 * KEYFRAME_INTERVAL; n++)
+	{
+		NextFrame(n);
+		SendFrame(&alice, target, &sending, FRAME_LENGTH / 2);
+	}
+	r.dlen = BUFFER_LENGTH;
+	Check(ReceiveStreamMessage(&bob, &receiving, &r) == (int) MESSAGE_HEADER_LENGTH + FRAME_LENGTH / 2, "ReceiveStreamMessage() failed");
+	Check(memcmp(r.data, frame, FRAME_LENGTH / 2) == 0, "ReceiveStreamMessage() returned the wrong frame");
+
+	// Messages that didn't come from a StreamChannel are left alone
+	char text[] = "Not a stream";
+	Message m = CreateMessage("Alice", 7, text, strlen(text));
+	SendMessage(&alice, target, &m);
+	ReceiveFrame(&bob, &r);
+	Check(DecodeStreamMessage(&receiving, &r, BUFFER_LENGTH) == (int) strlen(text), "Plain Message was changed");
+	Check(memcmp(r.data, text, strlen(text)) == 0, "Plain Message was changed");
+
+	CloseStreamChannel(&sending);
+	CloseStreamChannel(&receiving);
+	CloseSupersocket(&alice);
+	CloseSupersocket(&bob);
+
+	Display("StreamChannel OK!");
+}
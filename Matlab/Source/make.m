@@ -4,8 +4,14 @@ fileList = {'CreateSupersocket.c', ...
     'SendData.c',...
     'PrintSupersocket.c', ...
     'ReceiveData.c',...
+    'ReceiveDataBatch.c',...
+    'StartBackgroundReceiver.c',...
+    'ReadBackgroundReceiver.c',...
+    'StopBackgroundReceiver.c',...
     'DiscoverSocket.c',...
-    'InitializeSupersocketListener.c'};
+    'InitializeSupersocketListener.c',...
+    'SendArray.c',...
+    'ReceiveArray.c'};
 
 if exist('target', 'var') && strcmp(target, 'windows')
     compilerVersion = '';
@@ -18,6 +18,7 @@ The way to declare a message is as follows:
     Message m = {0};
     strcpy(m.from, "Alice");
     m.id 	= 0;
+    m.flags = 0;
     m.dlen 	= strlen(buffer);
     m.data 	= buffer;
 @endcode
@@ -33,15 +34,51 @@ The way to declare a message is as follows:
 #define PROCESS_MAX_CHARS 32 
 #define DEFAULT_MESSAGE_BUFFER_SIZE 1500
 
+/** Number of struct iovec entries used to put a Message on the wire */
+#define MESSAGE_NUM_IOVECS 5
+
+/**
+Number of bytes on the wire in front of the data field. The flags byte made this 38
+rather than 37, so a process built before it was added misreads every Message from
+one built after, and the other way around. Both ends have to be rebuilt together.
+*/
+#define MESSAGE_HEADER_LENGTH (PROCESS_MAX_CHARS + sizeof(uint8_t) + sizeof(uint8_t) + sizeof(uint32_t))
+
+/**
+The flags field is set by the Supersocket library, not by the user, and describes
+how the data field was encoded on the wire. The receiving side undoes the encoding
+before handing the Message back, so by the time you see it the flags will be 0.
+The one exception is MESSAGE_FLAG_BUFFER_HANDLE, which says where the data is.
+*/
 typedef struct
 {
 	char 		from[PROCESS_MAX_CHARS];
 	uint8_t     id;
+	uint8_t     flags;
 	uint32_t 	dlen;
 	void* 		data; 
 
 } Message;
 
+/**
+@brief Bits of the Message.flags field
+
+- **MESSAGE_FLAG_COMPRESSED:** the data field was compressed using CompressBuffer()
+- **MESSAGE_FLAG_STREAM_KEYFRAME:** a whole frame sent through a StreamChannel
+- **MESSAGE_FLAG_STREAM_DELTA:** a frame delta-encoded against the previous one in its StreamChannel
+- **MESSAGE_FLAG_ARRAY:** the data field is an ArrayHeader followed by the array elements (TypedArray.h)
+- **MESSAGE_FLAG_BUFFER_HANDLE:** no data follows the header; it is in a file descriptor passed along with it (BufferHandle.h)
+*/
+typedef enum
+{
+	MESSAGE_FLAG_COMPRESSED 		= 1,
+	MESSAGE_FLAG_STREAM_KEYFRAME 	= 2,
+	MESSAGE_FLAG_STREAM_DELTA 		= 4,
+	MESSAGE_FLAG_ARRAY 				= 8,
+	MESSAGE_FLAG_BUFFER_HANDLE 		= 16
+
+} MessageFlag;
+
 
 /**
 @brief Print the message header and assume the data is a string
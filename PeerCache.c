@@ -0,0 +1,184 @@
+#define _GNU_SOURCE // For flock() and kill() under -std=c11
+#include "PeerCache.h"
+#include <errno.h>
+#include <fcntl.h> // For open()
+#include <signal.h> // For kill()
+#include <string.h>
+#include <sys/file.h> // For flock()
+#include <sys/mman.h> // For mmap()
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PEER_CACHE_MAGIC 0x53535043 // "SSPC"
+
+/** The layout of the whole file */
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entrySize;
+	uint32_t nEntries;
+	PeerCacheEntry entries[PEER_CACHE_MAX_ENTRIES];
+
+} PeerCacheFile;
+
+static PeerCacheFile *OpenPeerCache(int *fd);
+static void ClosePeerCache(PeerCacheFile *cache, int fd);
+static int IsProcessAlive(pid_t pid);
+
+
+int PublishToPeerCache(SocketWrapper *sw, struct sockaddr_in *listener)
+{
+	int fd;
+	PeerCacheFile *cache = OpenPeerCache(&fd);
+	if(cache == NULL)
+		return -1;
+
+	// Take over our own old entry for this name if there is one, otherwise the
+	// first free slot, and sweep out the dead while we're at it
+	pid_t pid 				= getpid();
+	PeerCacheEntry *slot 	= NULL;
+	for(int i = 0; i < PEER_CACHE_MAX_ENTRIES; i++)
+	{
+		PeerCacheEntry *e = &cache->entries[i];
+		if(e->pid != 0 && IsProcessAlive(e->pid) == 0)
+			memset(e, 0, sizeof(PeerCacheEntry));
+
+		if(e->pid == 0 && slot == NULL)
+			slot = e;
+		else if(e->pid != 0 && strcmp(e->socketWrapper.name, sw->name) == 0 && e->pid == pid)
+			slot = e;
+	}
+
+	if(slot == NULL)
+	{
+		DisplayWarning("[%s] Peer cache %s is full", sw->name, PEER_CACHE_FILENAME);
+		ClosePeerCache(cache, fd);
+		return -1;
+	}
+
+	slot->pid 					= pid;
+	slot->socketWrapper 		= *sw;
+	slot->socketWrapper.socket 	= -1;
+	slot->listener 				= *listener;
+
+	ClosePeerCache(cache, fd);
+	return 0;
+}
+
+int LookUpPeerCache(char *name, PeerCacheEntry *entry)
+{
+	int fd;
+	PeerCacheFile *cache = OpenPeerCache(&fd);
+	if(cache == NULL)
+		return -1;
+
+	int found = -1;
+	for(int i = 0; i < PEER_CACHE_MAX_ENTRIES && found < 0; i++)
+	{
+		PeerCacheEntry *e = &cache->entries[i];
+		if(e->pid == 0 || strcmp(e->socketWrapper.name, name) != 0)
+			continue;
+
+		if(IsProcessAlive(e->pid) == 0)
+		{
+			memset(e, 0, sizeof(PeerCacheEntry));
+			continue;
+		}
+
+		*entry = *e;
+		found = 0;
+	}
+
+	ClosePeerCache(cache, fd);
+	return found;
+}
+
+int RemoveFromPeerCache(char *name, pid_t pid)
+{
+	int fd;
+	PeerCacheFile *cache = OpenPeerCache(&fd);
+	if(cache == NULL)
+		return -1;
+
+	for(int i = 0; i < PEER_CACHE_MAX_ENTRIES; i++)
+	{
+		PeerCacheEntry *e = &cache->entries[i];
+		if(e->pid == pid && strcmp(e->socketWrapper.name, name) == 0)
+			memset(e, 0, sizeof(PeerCacheEntry));
+	}
+
+	ClosePeerCache(cache, fd);
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+
+/**
+Open, lock and map the cache, creating it if need be. A file that was written by a
+different version of the library is wiped rather than trusted.
+*/
+static PeerCacheFile *OpenPeerCache(int *fd)
+{
+	*fd = open(PEER_CACHE_FILENAME, O_RDWR | O_CREAT, 0666);
+	if(*fd < 0)
+	{
+		DisplayWarning("Unable to open peer cache %s: %s", PEER_CACHE_FILENAME, strerror(errno));
+		return NULL;
+	}
+
+	if(flock(*fd, LOCK_EX) < 0)
+	{
+		DisplayWarning("Unable to lock peer cache %s: %s", PEER_CACHE_FILENAME, strerror(errno));
+		close(*fd);
+		return NULL;
+	}
+
+	struct stat st;
+	if(fstat(*fd, &st) < 0 || (st.st_size != sizeof(PeerCacheFile) && ftruncate(*fd, sizeof(PeerCacheFile)) < 0))
+	{
+		DisplayWarning("Unable to size peer cache %s: %s", PEER_CACHE_FILENAME, strerror(errno));
+		close(*fd);
+		return NULL;
+	}
+
+	// Whoever creates it makes sure everyone else can use it, whatever our umask says
+	if(st.st_size == 0)
+		fchmod(*fd, 0666);
+
+	PeerCacheFile *cache = mmap(NULL, sizeof(PeerCacheFile), PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+	if(cache == MAP_FAILED)
+	{
+		DisplayWarning("Unable to map peer cache %s: %s", PEER_CACHE_FILENAME, strerror(errno));
+		close(*fd);
+		return NULL;
+	}
+
+	if(cache->magic != PEER_CACHE_MAGIC || cache->version != PEER_CACHE_VERSION || cache->entrySize != sizeof(PeerCacheEntry))
+	{
+		memset(cache, 0, sizeof(PeerCacheFile));
+		cache->magic 		= PEER_CACHE_MAGIC;
+		cache->version 		= PEER_CACHE_VERSION;
+		cache->entrySize 	= sizeof(PeerCacheEntry);
+		cache->nEntries 	= PEER_CACHE_MAX_ENTRIES;
+	}
+
+	return cache;
+}
+
+static void ClosePeerCache(PeerCacheFile *cache, int fd)
+{
+	munmap(cache, sizeof(PeerCacheFile));
+	flock(fd, LOCK_UN);
+	close(fd);
+}
+
+static int IsProcessAlive(pid_t pid)
+{
+	// EPERM means it exists but belongs to someone else
+	return kill(pid, 0) == 0 || errno == EPERM;
+}
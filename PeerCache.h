@@ -0,0 +1,67 @@
+/**
+@file
+@brief A file of who is bound where on this computer, so discovery can skip the multicast
+
+DiscoverSupersocket() normally asks the whole network who has a given name, and
+waits for an answer, resending every so often until it gets one. When a
+rig of many processes starts up, those round trips add up.
+
+Every process whose SupersocketListener is running writes its bound AF_INET
+SocketWrappers to a small memory-mapped file in /tmp, next to the AF_UNIX
+sockets, along with its pid and the port its listener answers unicast
+requests on. DiscoverSupersocket() looks there first. If the process that
+published the name is still alive, a single unicast request to its listener
+confirms it, and multicast is only used if that doesn't work.
+
+The file is shared by every process on the computer, so it is only ever touched
+while holding flock() on it. Entries of processes that have gone away are
+cleaned up whenever they are found.
+
+@authors David Brandman and Benjamin Shanahan
+*/
+
+#pragma once
+
+#include "SocketWrapper.h"
+#include <sys/types.h> // For pid_t
+
+/** Where the cache lives. It is created the first time anyone publishes to it. */
+#define PEER_CACHE_FILENAME "/tmp/p_supersocket.peers"
+
+/** How many names the cache can hold */
+#define PEER_CACHE_MAX_ENTRIES 256
+
+/** Bump this whenever PeerCacheEntry changes, so old files get thrown away */
+#define PEER_CACHE_VERSION 1
+
+/** How long to wait for a cached peer to answer before falling back to multicast */
+#define PEER_CACHE_PROBE_TIME 50 //Milliseconds
+
+/**
+@brief One published name
+
+The listener field is where the publishing process's SupersocketListener takes
+unicast requests. An entry whose pid is 0 is empty.
+*/
+typedef struct
+{
+	pid_t pid;
+	SocketWrapper socketWrapper;
+	struct sockaddr_in listener;
+
+} PeerCacheEntry;
+
+/**
+@brief Record that this process has sw bound, and that its listener is at listener
+*/
+int PublishToPeerCache(SocketWrapper *sw, struct sockaddr_in *listener);
+
+/**
+@brief Find a live entry for name. Returns 0 and fills in entry if there is one, otherwise -1.
+*/
+int LookUpPeerCache(char *name, PeerCacheEntry *entry);
+
+/**
+@brief Forget every entry for name that was published by pid
+*/
+int RemoveFromPeerCache(char *name, pid_t pid);
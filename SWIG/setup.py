@@ -17,9 +17,12 @@ ext_sources = [
     "supersocket.i",
 
     "../Message.c",
+    "../Compression.c",
     "../SocketWrapper.c",
     "../Supersocket.c",
+    "../TypedArray.c",
     "../SupersocketListener.c",
+    "../PeerCache.c",
     "../Display.c",
     "../ManageHeapMemory.c"
 
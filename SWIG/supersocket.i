@@ -90,6 +90,7 @@ from struct import pack, unpack
 #include "../SocketWrapper.h"
 #include "../Supersocket.h"
 #include "../SupersocketListener.h"
+#include "../TypedArray.h"
 #include "../Display.h"
 
 
@@ -97,6 +98,100 @@ from struct import pack, unpack
 
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Buffer protocol typemaps. Any function below that takes (void *data, int
+// dlen) accepts any Python object that exposes a contiguous buffer (bytes,
+// bytearray, memoryview, numpy arrays...) and uses its memory directly. A
+// (void *buffer, int bufferLength) pair must be writable, and is received into
+// in place, like socket.recv_into().
+///////////////////////////////////////////////////////////////////////////////
+
+%typemap(in) (void *data, int dlen) (Py_buffer view) {
+    view.obj = NULL;
+    if (PyObject_GetBuffer($input, &view, PyBUF_ANY_CONTIGUOUS) < 0)
+        SWIG_fail;
+    $1 = view.buf;
+    $2 = (int) view.len;
+}
+%typemap(freearg) (void *data, int dlen) {
+    if (view$argnum.obj != NULL)
+        PyBuffer_Release(&view$argnum);
+}
+
+%typemap(in) (void *buffer, int bufferLength) (Py_buffer view) {
+    view.obj = NULL;
+    if (PyObject_GetBuffer($input, &view, PyBUF_ANY_CONTIGUOUS | PyBUF_WRITABLE) < 0)
+        SWIG_fail;
+    $1 = view.buf;
+    $2 = (int) view.len;
+}
+%typemap(freearg) (void *buffer, int bufferLength) {
+    if (view$argnum.obj != NULL)
+        PyBuffer_Release(&view$argnum);
+}
+
+// MessagingOptions only carries file descriptors, which Python has no use for, so let it leave it out.
+%typemap(default) MessagingOptions *options {
+    $1 = NULL;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Release the GIL around every call that can block on a socket, so that other
+// Python threads keep running while one of them waits for data. None of these
+// touch Python objects between Py_BEGIN_ALLOW_THREADS and Py_END_ALLOW_THREADS;
+// buffers coming from the typemaps above stay pinned until the call returns.
+///////////////////////////////////////////////////////////////////////////////
+
+%define RELEASE_GIL(function)
+%exception function {
+    Py_BEGIN_ALLOW_THREADS
+    $action
+    Py_END_ALLOW_THREADS
+}
+%enddef
+
+RELEASE_GIL(PollSockets);
+RELEASE_GIL(SendData);
+RELEASE_GIL(SendDataToAll);
+RELEASE_GIL(SendMessage);
+RELEASE_GIL(SendMessageToAll);
+RELEASE_GIL(SendDataByName);
+RELEASE_GIL(SendMessageByName);
+RELEASE_GIL(SendMessageBatch);
+RELEASE_GIL(ReceiveSupersocket);
+RELEASE_GIL(ReceiveData);
+RELEASE_GIL(ReceiveMessage);
+RELEASE_GIL(ReceiveDataTimeout);
+RELEASE_GIL(ReceiveMessageTimeout);
+RELEASE_GIL(DiscoverSupersocket);
+RELEASE_GIL(DiscoverSupersocketTimeout);
+RELEASE_GIL(SendMessageFrom);
+RELEASE_GIL(SendMessageToAllFrom);
+RELEASE_GIL(ReceiveMessageInto);
+RELEASE_GIL(ReceiveMessageIntoTimeout);
+
+// Functions that raise a Python exception, rather than only returning -1 or
+// NULL, have to have the wrapper look for it. Otherwise Python sees a result
+// with an exception set and raises SystemError in its place.
+%define RAISE_PYTHON_ERRORS(function)
+%exception function {
+    $action
+    if (PyErr_Occurred())
+        SWIG_fail;
+}
+%enddef
+
+// Python 2 and older Python 3 only set up the GIL once a thread is started
+%init %{
+#if PY_VERSION_HEX < 0x03070000
+    PyEval_InitThreads();
+#endif
+%}
+
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // Data structures and functions to expose from Supersocket
 ///////////////////////////////////////////////////////////////////////////////
@@ -120,6 +215,7 @@ enum {
 typedef struct {
     char      from[PROCESS_MAX_CHARS];
     uint8_t   id;
+    uint8_t   flags;
     uint32_t  dlen;
     void     *data;
 } Message;
@@ -139,7 +235,9 @@ typedef enum
     SOCKETWRAPPER_STATUS_SOCKETERROR,
     SOCKETWRAPPER_STATUS_BINDERROR,
     SOCKETWRAPPER_STATUS_CONNECTERROR,
-    SOCKETWRAPPER_STATUS_LISTENERROR
+    SOCKETWRAPPER_STATUS_LISTENERROR,
+    SOCKETWRAPPER_STATUS_DISABLED,
+    SOCKETWRAPPER_STATUS_CLOSED
 
 } SOCKETWRAPPER_STATUS_LIST; 
 
@@ -149,13 +247,32 @@ typedef enum
     BIND            = 2,
     CONNECT         = 4,
     MULTICAST       = 8,
-    LISTEN          = 16
+    LISTEN          = 16,
+    ABSTRACT        = 32,
+    REUSEPORT       = 64
 
 } Flag;
 
 
 /* From Supersocket.h*/
 
+typedef struct SupersocketTable
+{
+    int nSockets;
+    SocketWrapper *socketWrapper;
+
+    int nBoundSockets;
+    int *boundSocketsList;
+    struct pollfd *boundSocketsStruct;
+
+    int nConnectedSockets;
+    int *connectedSocketsList;
+
+    int *nameIndex;
+    int nameIndexSize;
+
+} SupersocketTable;
+
 typedef struct
 {
     char name[PROCESS_MAX_CHARS];
@@ -169,11 +286,30 @@ typedef struct
     int nConnectedSockets;
     int *connectedSocketsList;
 
+    int compressionThreshold;
+
     pthread_mutex_t lock;
 
+    struct SupersocketListenerState *listener;
+
+    int *nameIndex;
+    int nameIndexSize;
+
+    double *lastHeard;
+    int *heartbeatPeriod;
+
+    SupersocketTable *table;
+    unsigned int epoch;
+    int readers[2];
+    struct RetiredSupersocketTable *retired;
+
+    int nextReady;
+
 } Supersocket;
 
 int InitializeSupersocket(Supersocket *s, char *name, char *ip, int port);
+int SetSupersocketLocalTransport(int type, int flags);
+int SetSupersocketReceiveShards(int nShards, int steerBySender);
 int CloseSupersocket(Supersocket *s);
 
 int AddSocket(Supersocket *s, char *name, char *ip, int port, int domain, int type, int flags);
@@ -185,17 +321,65 @@ int SendData(Supersocket *s, int target, void *data, int dlen, MessagingOptions
 int SendDataToAll(Supersocket *s, void *data, int dlen, MessagingOptions *options);
 int SendMessage(Supersocket *s, int target, Message *m);
 int SendMessageToAll(Supersocket *s, Message *m);
-
-int ReceiveSupersocket(Supersocket *s, int receiveMessageFlag, Message *m, void *data, int dlen, MessagingOptions *options);
-int ReceiveData(Supersocket *s, void *data, int dlen, MessagingOptions *options);
+int SendDataByName(Supersocket *s, char *name, void *data, int dlen, MessagingOptions *options);
+int SendMessageByName(Supersocket *s, char *name, Message *m);
+SupersocketTable *ReadSupersocketTable(Supersocket *s, int *epoch);
+void ReleaseSupersocketTable(Supersocket *s, int epoch);
+int FindSocketWrapperByName(Supersocket *s, char *name, int flags, int domain);
+int DisableSocketWrapper(Supersocket *s, int target);
+int EnableSocketWrapper(Supersocket *s, int target);
+int RemoveSocketWrapper(Supersocket *s, int target);
+int ReplaceSocketWrapper(Supersocket *s, int target, SocketWrapper *sw);
+int SendMessageBatch(Supersocket *s, int target, Message *m, int nMessages);
+int SetSupersocketCompression(Supersocket *s, int threshold);
+
+int ReceiveSupersocket(Supersocket *s, int receiveMessageFlag, Message *m, void *buffer, int bufferLength, MessagingOptions *options);
+int ReceiveData(Supersocket *s, void *buffer, int bufferLength, MessagingOptions *options);
 int ReceiveMessage(Supersocket *s, Message *m);
+int ReceiveDataTimeout(Supersocket *s, void *buffer, int bufferLength, int milliseconds, MessagingOptions *options);
+int ReceiveMessageTimeout(Supersocket *s, Message *m, int milliseconds);
 
 
 /* From SupersocketListener.h */
 
 int InitializeSupersocketListener(Supersocket *s);
+int StopSupersocketListener(Supersocket *s);
 void *SupersocketListener(void *);
 int DiscoverSupersocket(Supersocket *s, char *name);
+int DiscoverSupersocketTimeout(Supersocket *s, char *name, int milliseconds);
+int EnableSupersocketAnnouncements(Supersocket *s, int milliseconds);
+int LookUpSupersocketDirectory(Supersocket *s, char *name, SocketWrapper *sw);
+int SetSupersocketDirectoryServer(char *ip, int port);
+int EnableSupersocketHeartbeats(Supersocket *s, int milliseconds);
+int AnnounceSupersocketClose(Supersocket *s);
+
+
+
+/* From TypedArray.h */
+
+typedef enum
+{
+    ARRAY_DTYPE_UNDEFINED,
+    ARRAY_DTYPE_INT8,
+    ARRAY_DTYPE_UINT8,
+    ARRAY_DTYPE_INT16,
+    ARRAY_DTYPE_UINT16,
+    ARRAY_DTYPE_INT32,
+    ARRAY_DTYPE_UINT32,
+    ARRAY_DTYPE_INT64,
+    ARRAY_DTYPE_UINT64,
+    ARRAY_DTYPE_FLOAT32,
+    ARRAY_DTYPE_FLOAT64,
+    ARRAY_DTYPE_BOOL
+
+} ArrayDtype;
+
+typedef enum
+{
+    ARRAY_ORDER_ROW_MAJOR,
+    ARRAY_ORDER_COLUMN_MAJOR
+
+} ArrayOrder;
 
 
 
@@ -252,8 +436,10 @@ int GetFilename();
         return cdata(self._get_data_c(), self.dlen)
     %}
 
-    // Set data field to char pointer and update dlen.
-    void _set_data_c(char *data, int dlen) {
+    // Copy any bytes-like object into a newly allocated data field and update 
+    // dlen. The buffer typemap gives us its memory without an intermediate
+    // Python string.
+    void _set_data_c(void *data, int dlen) {
         $self->dlen = dlen;
         $self->data = malloc(dlen);
         memcpy($self->data, data, dlen);
@@ -262,12 +448,25 @@ int GetFilename();
     // Wrap `set_data_c()` with a nice Python function.
     %pythoncode %{
     def _set_data(self, datastring):
-        if type(datastring) != str:
-            raise Exception("Data must be a string!")
+        if isinstance(datastring, type(u"")) and not isinstance(datastring, bytes):
+            datastring = datastring.encode("utf-8")
         self._free_data_c()  # Free previously allocated data
-        self._set_data_c(datastring, len(datastring))
+        self._set_data_c(datastring)
     %}
 
+    // Return a writable memoryview over the first dlen bytes of the data 
+    // field. Nothing is copied, so this is the cheap way to look at what was
+    // received. The memoryview does not keep the Message alive: don't use it 
+    // after the Message has been deleted or re-initialized.
+    PyObject *view() {
+        static char empty[1];
+        Py_buffer view;
+        void *data = ($self->data == NULL) ? empty : $self->data;
+        Py_ssize_t dlen = ($self->data == NULL) ? 0 : $self->dlen;
+        PyBuffer_FillInfo(&view, NULL, data, dlen, 0, PyBUF_CONTIG);
+        return PyMemoryView_FromBuffer(&view);
+    }
+
     // Free allocated memory in data field.
     void _free_data_c() {
         if ($self->data != NULL) {
@@ -307,7 +506,7 @@ int GetFilename();
         self._free_data_c()
         if (data_length > 0):
             # Pack the data field with `data_length` zeros.
-            self.data = pack("%ds" % data_length,"")
+            self.data = pack("%ds" % data_length, b"")
     %}
 
     char *__repr__() {
@@ -354,6 +553,15 @@ int GetFilename();
         return tmp;
     }
 
+    // File descriptors of the bound sockets, for select(), selectors or an
+    // event loop. When any of them is readable, a receive won't block.
+    PyObject *filenos() {
+        PyObject *output = PyList_New($self->nBoundSockets);
+        for (int i = 0; i < $self->nBoundSockets; i++)
+            PyList_SetItem(output, i, PyLong_FromLong($self->boundSocketsStruct[i].fd));
+        return output;
+    }
+
     // Wrap PrintSupersocket() so that user can access it.
     void Print() {
         int v = GetVerbose();
@@ -368,4 +576,294 @@ int GetFilename();
         SetShowTrace(s);
     }
 
-}
\ No newline at end of file
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Typed arrays. SendArray() takes anything numpy can turn into an array and
+// ReceiveArray() hands back a numpy array that shares memory with the Message
+// it was received into, so neither direction copies the elements.
+///////////////////////////////////////////////////////////////////////////////
+
+RAISE_PYTHON_ERRORS(_SendArrayBuffer);
+
+%inline %{
+
+// Send the contiguous buffer held by `buffer` as a typed array. `shape` is a
+// sequence of ints. Raises ValueError if they don't go together.
+int _SendArrayBuffer(Supersocket *s, int target, int id, int dtype, int order, PyObject *shape, PyObject *buffer) {
+    uint32_t dims[ARRAY_MAX_DIMS] = {0};
+    int ndim = (int) PySequence_Size(shape);
+    if (ndim < 0 || ndim > ARRAY_MAX_DIMS) {
+        PyErr_SetString(PyExc_ValueError, "Too many dimensions for a typed array");
+        return -1;
+    }
+    for (int i = 0; i < ndim; i++) {
+        PyObject *item = PySequence_GetItem(shape, i);
+        dims[i] = (uint32_t) PyLong_AsUnsignedLongMask(item);
+        Py_XDECREF(item);
+    }
+
+    Py_buffer view;
+    if (PyObject_GetBuffer(buffer, &view, PyBUF_ANY_CONTIGUOUS) < 0)
+        return -1;
+
+    ArrayHeader h;
+    int output = PopulateArrayHeader(&h, dtype, order, ndim, dims);
+    if (output == 0 && (uint64_t) view.len != ArrayNumberOfBytes(&h)) {
+        PyErr_SetString(PyExc_ValueError, "Buffer size does not match shape and dtype");
+        output = -1;
+    }
+    else if (output == 0) {
+        Py_BEGIN_ALLOW_THREADS
+        output = SendArray(s, target, (uint8_t) id, &h, view.buf);
+        Py_END_ALLOW_THREADS
+    }
+
+    PyBuffer_Release(&view);
+    return output;
+}
+
+// Receive a typed array into m. Returns (dtype, order, shape, memoryview), where
+// the memoryview points at the elements inside m's buffer, or None on failure.
+PyObject *_ReceiveArrayView(Supersocket *s, Message *m) {
+    ArrayHeader h;
+    int nBytes;
+    Py_BEGIN_ALLOW_THREADS
+    nBytes = ReceiveArray(s, m, &h);
+    Py_END_ALLOW_THREADS
+    if (nBytes < 0)
+        Py_RETURN_NONE;
+
+    PyObject *shape = PyTuple_New(h.ndim);
+    for (int i = 0; i < h.ndim; i++)
+        PyTuple_SetItem(shape, i, PyLong_FromUnsignedLong(h.shape[i]));
+
+    Py_buffer view;
+    PyBuffer_FillInfo(&view, NULL, m->data, nBytes, 0, PyBUF_CONTIG);
+    PyObject *memory = PyMemoryView_FromBuffer(&view);
+
+    return Py_BuildValue("(iiNN)", h.dtype, h.order, shape, memory);
+}
+
+%}
+
+%pythoncode %{
+
+# Map numpy (kind, itemsize) pairs onto ArrayDtype values and back again
+_ARRAY_DTYPES = {
+    ('i', 1): ARRAY_DTYPE_INT8,    ('u', 1): ARRAY_DTYPE_UINT8,
+    ('i', 2): ARRAY_DTYPE_INT16,   ('u', 2): ARRAY_DTYPE_UINT16,
+    ('i', 4): ARRAY_DTYPE_INT32,   ('u', 4): ARRAY_DTYPE_UINT32,
+    ('i', 8): ARRAY_DTYPE_INT64,   ('u', 8): ARRAY_DTYPE_UINT64,
+    ('f', 4): ARRAY_DTYPE_FLOAT32, ('f', 8): ARRAY_DTYPE_FLOAT64,
+    ('b', 1): ARRAY_DTYPE_BOOL
+}
+_NUMPY_DTYPES = {
+    ARRAY_DTYPE_INT8: 'i1',    ARRAY_DTYPE_UINT8: 'u1',
+    ARRAY_DTYPE_INT16: 'i2',   ARRAY_DTYPE_UINT16: 'u2',
+    ARRAY_DTYPE_INT32: 'i4',   ARRAY_DTYPE_UINT32: 'u4',
+    ARRAY_DTYPE_INT64: 'i8',   ARRAY_DTYPE_UINT64: 'u8',
+    ARRAY_DTYPE_FLOAT32: 'f4', ARRAY_DTYPE_FLOAT64: 'f8',
+    ARRAY_DTYPE_BOOL: '?'
+}
+
+def SendArray(s, target, array, id=0):
+    """
+    Send a numpy array (or anything numpy.asarray() accepts) to target as a
+    typed array. Contiguous arrays, in either C or Fortran order, are sent
+    without being copied.
+    """
+    import numpy
+    a = numpy.asarray(array)
+    if not (a.flags.c_contiguous or a.flags.f_contiguous):
+        a = numpy.ascontiguousarray(a)
+    if a.dtype.byteorder not in ('=', '|'):
+        a = a.astype(a.dtype.newbyteorder('='))
+    key = (a.dtype.kind, a.dtype.itemsize)
+    if key not in _ARRAY_DTYPES:
+        raise TypeError("Cannot send arrays of dtype %s" % a.dtype)
+    order = ARRAY_ORDER_ROW_MAJOR
+    if a.flags.f_contiguous and not a.flags.c_contiguous:
+        order = ARRAY_ORDER_COLUMN_MAJOR
+    return _SendArrayBuffer(s, target, id, _ARRAY_DTYPES[key], order, a.shape, a)
+
+def ReceiveArray(s, m):
+    """
+    Receive a typed array into Message m, which must have been initialized
+    with enough room, and return it as a numpy array. The array shares memory
+    with m, so it is only valid until m is reused or deleted. Returns None if
+    what arrived wasn't a typed array.
+    """
+    import numpy
+    result = _ReceiveArrayView(s, m)
+    if result is None:
+        return None
+    dtype, order, shape, memory = result
+    a = numpy.frombuffer(memory, dtype=_NUMPY_DTYPES[dtype])
+    return a.reshape(shape, order='F' if order == ARRAY_ORDER_COLUMN_MAJOR else 'C')
+
+%}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Zero-copy sends and receives. The header fields (from, id) come from a 
+// Message, and the data goes straight to or from a Python buffer.
+///////////////////////////////////////////////////////////////////////////////
+
+%{
+int ReceiveMessageIntoTimeout(Supersocket *s, Message *m, void *buffer, int bufferLength, int milliseconds);
+%}
+
+%inline %{
+
+// Send m's header with the contents of any bytes-like object as its data.
+int SendMessageFrom(Supersocket *s, int target, Message *m, void *data, int dlen) {
+    Message toSend = *m;
+    toSend.data = data;
+    toSend.dlen = dlen;
+    return SendMessage(s, target, &toSend);
+}
+
+// Same as SendMessageFrom(), but to every connected socket.
+int SendMessageToAllFrom(Supersocket *s, Message *m, void *data, int dlen) {
+    Message toSend = *m;
+    toSend.data = data;
+    toSend.dlen = dlen;
+    return SendMessageToAll(s, &toSend);
+}
+
+// Receive the header into m and the data into a preallocated writable buffer
+// (bytearray, numpy array, memoryview...), like socket.recv_into(). m's own
+// data field is left alone. Returns the number of data bytes received, which
+// is also left in m.dlen, or -1.
+int ReceiveMessageInto(Supersocket *s, Message *m, void *buffer, int bufferLength) {
+    int output = ReceiveMessageIntoTimeout(s, m, buffer, bufferLength, -1);
+    return output < 0 ? -1 : (int) m->dlen;
+}
+
+// Same as ReceiveMessageInto(), but gives up after milliseconds. Like
+// ReceiveMessageTimeout(), this returns the total number of bytes received 
+// (header included), or 0 if nothing arrived, so that a Message with no data 
+// can't be mistaken for a timeout. The data length is in m.dlen.
+int ReceiveMessageIntoTimeout(Supersocket *s, Message *m, void *buffer, int bufferLength, int milliseconds) {
+    void *data = m->data;
+    m->data = buffer;
+    m->dlen = bufferLength;
+    int output = ReceiveMessageTimeout(s, m, milliseconds);
+    m->data = data;
+    if (output <= 0)
+        m->dlen = 0;
+    return output;
+}
+
+%}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Non-blocking receives and batched sends, for event loops. See 
+// supersocket_asyncio.py.
+///////////////////////////////////////////////////////////////////////////////
+
+RAISE_PYTHON_ERRORS(SendMessageList);
+
+%inline %{
+
+// Receive a Message if one is waiting, without blocking. Returns 0 if there
+// was nothing to read.
+int TryReceiveMessage(Supersocket *s, Message *m) {
+    return ReceiveMessageTimeout(s, m, 0);
+}
+
+// Same as ReceiveMessageIntoTimeout() with a timeout of 0.
+int TryReceiveMessageInto(Supersocket *s, Message *m, void *buffer, int bufferLength) {
+    return ReceiveMessageIntoTimeout(s, m, buffer, bufferLength, 0);
+}
+
+// Send a sequence of Messages to target with SendMessageBatch(). Raises
+// TypeError if it isn't a sequence of Messages.
+int SendMessageList(Supersocket *s, int target, PyObject *messages) {
+    PyObject *sequence = PySequence_Fast(messages, "SendMessageList expects a sequence of Messages");
+    if (sequence == NULL)
+        return -1;
+
+    int n = (int) PySequence_Fast_GET_SIZE(sequence);
+    Message *batch = malloc((n > 0 ? n : 1) * sizeof(Message));
+    int output = (batch == NULL) ? -1 : 0;
+
+    for (int i = 0; i < n && output == 0; i++) {
+        Message *m = NULL;
+        if (SWIG_IsOK(SWIG_ConvertPtr(PySequence_Fast_GET_ITEM(sequence, i), (void **) &m, SWIGTYPE_p_Message, 0)) && m != NULL)
+            batch[i] = *m;
+        else {
+            PyErr_SetString(PyExc_TypeError, "SendMessageList expects a sequence of Messages");
+            output = -1;
+        }
+    }
+
+    if (output == 0) {
+        Py_BEGIN_ALLOW_THREADS
+        output = SendMessageBatch(s, target, batch, n);
+        Py_END_ALLOW_THREADS
+    }
+
+    free(batch);
+    Py_DECREF(sequence);
+    return output;
+}
+
+%}
+
+///////////////////////////////////////////////////////////////////////////////
+// Discovering several names at once
+///////////////////////////////////////////////////////////////////////////////
+
+%inline %{
+
+// Discover a sequence of names with DiscoverSupersockets(). Returns a list
+// of where each was added to the Supersocket, -1 for those not found before
+// the timeout. A negative timeout waits until all of them are found.
+PyObject *DiscoverSupersocketList(Supersocket *s, PyObject *names, int milliseconds) {
+    PyObject *sequence = PySequence_Fast(names, "DiscoverSupersocketList expects a sequence of names");
+    if (sequence == NULL)
+        return NULL;
+
+    int n = (int) PySequence_Fast_GET_SIZE(sequence);
+    char **cNames = malloc((n > 0 ? n : 1) * sizeof(char *));
+    int *indices  = malloc((n > 0 ? n : 1) * sizeof(int));
+    PyObject *output = NULL;
+
+    int ok = (cNames != NULL && indices != NULL);
+    for (int i = 0; i < n && ok; i++) {
+        PyObject *item = PySequence_Fast_GET_ITEM(sequence, i);
+%#if PY_VERSION_HEX >= 0x03000000
+        cNames[i] = PyUnicode_Check(item) ? (char *) PyUnicode_AsUTF8(item) : NULL;
+%#else
+        cNames[i] = PyString_Check(item) ? PyString_AsString(item) : NULL;
+%#endif
+        if (cNames[i] == NULL) {
+            PyErr_SetString(PyExc_TypeError, "DiscoverSupersocketList expects a sequence of names");
+            ok = 0;
+        }
+    }
+
+    if (ok) {
+        Py_BEGIN_ALLOW_THREADS
+        DiscoverSupersockets(s, cNames, n, indices, milliseconds);
+        Py_END_ALLOW_THREADS
+
+        output = PyList_New(n);
+        for (int i = 0; i < n && output != NULL; i++)
+            PyList_SetItem(output, i, PyLong_FromLong(indices[i] < 0 ? -1 : indices[i]));
+    }
+
+    free(cNames);
+    free(indices);
+    Py_DECREF(sequence);
+    return output;
+}
+
+%}
@@ -0,0 +1,78 @@
+##
+# @file
+#
+# asyncio adapter for the Supersocket Python extension (Python 3 only).
+#
+# The bound sockets of a Supersocket are registered as readers with the event
+# loop, so nothing blocks and no extra threads are needed:
+#
+#       s = Supersocket()
+#       AddSocket(s, "Bob", "127.0.0.1", 5000, AF_INET, SOCK_DGRAM, BIND)
+#
+#       bob = AsyncSupersocket(s)
+#       m = await bob.receive_message()
+#       bob.send_many(target, [m1, m2, m3])
+#
+# Messages are read as soon as the loop sees a socket become readable and are
+# queued until someone awaits them.
+#
+# @author David Brandman
+
+import asyncio
+
+from supersocket import Message, SendMessage, SendMessageList, \
+                        TryReceiveMessageInto
+
+
+class AsyncSupersocket(object):
+
+    def __init__(self, s, buffer_length=65507, loop=None):
+        """
+        Start watching the bound sockets of Supersocket s. buffer_length is
+        the largest Message data that can be received.
+        """
+        self.s       = s
+        self.loop    = loop or asyncio.get_event_loop()
+        self._buffer = bytearray(buffer_length)
+        self._queue  = asyncio.Queue()
+        self._fds    = s.filenos()
+        for fd in self._fds:
+            self.loop.add_reader(fd, self._on_readable)
+
+    def close(self):
+        """ Stop watching the sockets. The Supersocket itself is left open. """
+        for fd in self._fds:
+            self.loop.remove_reader(fd)
+        self._fds = []
+
+    def _on_readable(self):
+        # Drain everything that's waiting, so one wakeup can cover many Messages
+        while True:
+            header = Message()
+            n = TryReceiveMessageInto(self.s, header, self._buffer)
+            if n <= 0:
+                break
+            header.data = memoryview(self._buffer)[:header.dlen]
+            self._queue.put_nowait(header)
+
+    async def receive_message(self):
+        """ Wait for the next Message. """
+        return await self._queue.get()
+
+    def try_receive_message(self):
+        """ Return the next Message if there is one already, otherwise None. """
+        try:
+            return self._queue.get_nowait()
+        except asyncio.QueueEmpty:
+            return None
+
+    def send_message(self, target, m):
+        """ Send a Message to target. Datagram sends don't wait. """
+        return SendMessage(self.s, target, m)
+
+    def send_many(self, target, messages):
+        """
+        Send a sequence of Messages to target, in order. Datagram targets get
+        them in batches, with one system call per batch.
+        """
+        return SendMessageList(self.s, target, messages)
@@ -0,0 +1,50 @@
+##
+# @file
+#
+# Test the asyncio adapter: a batch of Messages sent with send_many() should
+# all come back, in order, through receive_message(). Python 3 only.
+#
+# @author David Brandman
+
+import asyncio
+from supersocket import *
+from supersocket_asyncio import AsyncSupersocket
+
+async def main():
+
+    alice = Supersocket()
+    bob   = Supersocket()
+
+    aliceToBob = AddSocket(alice, "Bob", "127.0.0.1", 5003, AF_INET, SOCK_DGRAM, CONNECT)
+    AddSocket(bob, "Bob", "127.0.0.1", 5003, AF_INET, SOCK_DGRAM, BIND)
+
+    asyncBob = AsyncSupersocket(bob)
+
+    messages = []
+    for i in range(100):
+        m = Message()
+        m._from = "Alice"
+        m.id = i
+        m.data = b"frame %d" % i
+        messages.append(m)
+
+    AsyncSupersocket(alice).send_many(aliceToBob, messages)
+
+    for i in range(100):
+        r = await asyncio.wait_for(asyncBob.receive_message(), 1.0)
+        assert r.id == i and r.data == b"frame %d" % i
+
+    # Nothing is sent unless everything in the batch is a Message
+    try:
+        AsyncSupersocket(alice).send_many(aliceToBob, [messages[0], "not a Message"])
+        assert False, "Sent something that isn't a Message"
+    except TypeError:
+        pass
+
+    asyncBob.close()
+    print("asyncio OK!")
+
+if __name__ == "__main__":
+
+    SetVerbose(DISABLE)
+    asyncio.get_event_loop().run_until_complete(main())
@@ -0,0 +1,46 @@
+##
+# @file
+#
+# Test sending from and receiving into objects that support the buffer 
+# protocol, without going through Python strings.
+#
+# @author David Brandman
+
+from supersocket import *
+
+if __name__ == "__main__":
+
+    SetVerbose(DISABLE)
+
+    alice = Supersocket()
+    bob   = Supersocket()
+
+    aliceToBob = AddSocket(alice, "Bob", "127.0.0.1", 5002, AF_INET, SOCK_DGRAM, CONNECT)
+    AddSocket(bob, "Bob", "127.0.0.1", 5002, AF_INET, SOCK_DGRAM, BIND)
+
+    # Send straight from a bytearray, and receive into a preallocated one
+    sent   = bytearray(range(200))
+    buffer = bytearray(1024)
+    header = Message()
+    header._from = "Alice"
+    header.id = 3
+
+    SendMessageFrom(alice, aliceToBob, header, sent)
+    header = Message()
+    n = ReceiveMessageInto(bob, header, buffer)
+
+    assert n == len(sent)
+    assert header._from == "Alice" and header.id == 3
+    assert memoryview(buffer)[:n] == memoryview(sent)
+
+    # Or receive into the Message's own buffer and look at it without copying.
+    # ReceiveMessage() needs a Message header in front of the data, which
+    # SendData() doesn't send.
+    r = Message()
+    r.initialize(1024)
+    SendMessageFrom(alice, aliceToBob, header, memoryview(sent)[10:20])
+    ReceiveMessage(bob, r)
+
+    assert r.view().tobytes() == bytes(sent[10:20])
+
+    print("Buffer protocol OK!")
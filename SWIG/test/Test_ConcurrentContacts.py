@@ -0,0 +1,62 @@
+##
+# @file
+#
+# Test that receiving goes on undisturbed while another thread adds and
+# removes contacts on the same Supersocket. Every Message sent should come
+# back whole, in order, however many contact tables are swapped in under it.
+#
+# @author David Brandman
+
+import threading
+from supersocket import *
+
+N_MESSAGES = 500
+
+if __name__ == "__main__":
+
+    SetVerbose(DISABLE)
+
+    alice = Supersocket()
+    bob   = Supersocket()
+
+    aliceToBob = AddSocket(alice, "Bob", "127.0.0.1", 5005, AF_INET, SOCK_DGRAM, CONNECT)
+    AddSocket(bob, "Bob", "127.0.0.1", 5005, AF_INET, SOCK_DGRAM, BIND)
+
+    done     = threading.Event()
+    failures = []
+
+    # Bound contacts change what Bob polls, connected ones only the table
+    def churn():
+        i = 0
+        while not done.is_set():
+            flags  = BIND if i % 2 else CONNECT
+            target = AddSocket(bob, "Contact%d" % i, "127.0.0.1", 0, AF_INET, SOCK_DGRAM, flags)
+            if target < 0 or RemoveSocketWrapper(bob, target) < 0:
+                failures.append(i)
+            i += 1
+
+    thread = threading.Thread(target=churn)
+    thread.start()
+
+    m = Message()
+    m._from = "Alice"
+    r = Message()
+    try:
+        for i in range(N_MESSAGES):
+            m.id = i % 256
+            m.data = b"message %d" % i
+            SendMessage(alice, aliceToBob, m)
+
+            r.initialize(64)
+            assert ReceiveMessageTimeout(bob, r, 1000) > 0
+            assert r.id == i % 256 and r.data == b"message %d" % i
+    finally:
+        done.set()
+        thread.join()
+
+    assert failures == []
+
+    CloseSupersocket(alice)
+    CloseSupersocket(bob)
+
+    print("Concurrent contacts OK!")
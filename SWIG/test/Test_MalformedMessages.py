@@ -0,0 +1,85 @@
+##
+# @file
+#
+# Test that truncated and forged datagrams are turned away rather than read
+# past the end of what arrived. ReceiveMessage() needs a whole Message header,
+# and exactly as much data as the header says, and the listener has to go on
+# answering discovery requests after being sent nonsense.
+#
+# @author David Brandman
+
+import socket
+from struct import pack
+from supersocket import *
+
+# Message.from, id, flags and dlen, the way SendMessage() puts them on the wire
+HEADER = "=32sBBI"
+
+MESSAGE_FLAG_BUFFER_HANDLE = 16                             # From Message.h
+ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND_MANY = 6  # From SupersocketListener.h
+ID_SUPERSOCKET_SOCKETWRAPPER_HEARTBEAT = 8
+LISTENER = ("239.0.0.1", 5000)
+
+def header(id, flags, dlen):
+    return pack(HEADER, b"Forger", id, flags, dlen)
+
+if __name__ == "__main__":
+
+    SetVerbose(DISABLE)
+
+    alice = Supersocket()
+    bob   = Supersocket()
+
+    aliceToBob = AddSocket(alice, "Bob", "127.0.0.1", 5004, AF_INET, SOCK_DGRAM, CONNECT)
+    AddSocket(bob, "Bob", "127.0.0.1", 5004, AF_INET, SOCK_DGRAM, BIND)
+
+    forger = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+
+    forgeries = [
+        b"too short",                                   # Not even a whole header
+        header(1, 0, 1000) + b"short",                  # Says more data came than did
+        header(1, 0, 0) + b"extra",                     # Says less
+        header(1, MESSAGE_FLAG_BUFFER_HANDLE, 0),       # A buffer handle, with no file descriptor
+    ]
+
+    r = Message()
+    for forgery in forgeries:
+        forger.sendto(forgery, ("127.0.0.1", 5004))
+        r.initialize(1024)
+        assert ReceiveMessageTimeout(bob, r, 1000) == -1
+
+    # Bob still gets what's sent properly
+    m = Message()
+    m._from = "Alice"
+    m.id = 2
+    m.data = b"still here"
+    SendMessage(alice, aliceToBob, m)
+    r.initialize(1024)
+
+    assert ReceiveMessageTimeout(bob, r, 1000) > 0
+    assert r.id == 2 and r.data == b"still here"
+
+    # A name list is a period and a count of names, followed by the names.
+    # These say there are far more names than came with them.
+    carol = Supersocket()
+    dave  = Supersocket()
+    InitializeSupersocket(carol, "Carol", "127.0.0.1", 0)
+    InitializeSupersocket(dave, "Dave", "127.0.0.1", 0)
+    InitializeSupersocketListener(carol)
+    InitializeSupersocketListener(dave)
+
+    nameLists = [
+        header(ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND_MANY, 0, 1000000) + pack("=II", 0, 5000),
+        header(ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND_MANY, 0, 8) + pack("=II", 0, 5000),
+        header(ID_SUPERSOCKET_SOCKETWRAPPER_HEARTBEAT, 0, 8) + pack("=II", 1000, 5000),
+        header(ID_SUPERSOCKET_SOCKETWRAPPER_HEARTBEAT, 0, 4) + pack("=I", 1000),
+    ]
+    for nameList in nameLists:
+        forger.sendto(nameList, LISTENER)
+
+    assert DiscoverSupersocketTimeout(carol, "Dave", 2000) >= 0
+
+    CloseSupersocket(carol)
+    CloseSupersocket(dave)
+
+    print("Malformed Messages OK!")
@@ -0,0 +1,74 @@
+##
+# @file
+#
+# Test that a second replica starting up doesn't take over the contact Alice
+# has for the first one. Every listener tells everyone where its sockets are
+# when it starts, which is meant for a process that has come back, not for
+# another process with the same name. Each replica is this script run again.
+#
+#     $ python Test_Replicas.py
+#
+# @author David Brandman
+
+import subprocess
+import sys
+import time
+from supersocket import *
+
+# Longer than the UPDATE_REPEATS notices a starting listener sends out
+UPDATE_TIME = 1.0
+
+def RunReplica(n):
+    decoder = Supersocket()
+    InitializeSupersocket(decoder, "Replica%s" % n, "127.0.0.1", 0)
+    AddSocket(decoder, "Decoder", "127.0.0.1", 0, AF_INET, SOCK_DGRAM, BIND)
+    InitializeSupersocketListener(decoder)
+    sys.stdout.write("ready\n")
+    sys.stdout.flush()
+
+    r = Message()
+    while True:
+        r.initialize(64)
+        if ReceiveMessageTimeout(decoder, r, 10000) <= 0:
+            break
+        sys.stdout.write(r.data.decode() + "\n")
+        sys.stdout.flush()
+
+def StartReplica(n):
+    replica = subprocess.Popen([sys.executable, __file__, str(n)], stdout=subprocess.PIPE, universal_newlines=True)
+    assert replica.stdout.readline() == "ready\n"
+    return replica
+
+if __name__ == "__main__":
+
+    SetVerbose(DISABLE)
+
+    if len(sys.argv) > 1:
+        RunReplica(sys.argv[1])
+        sys.exit(0)
+
+    first = StartReplica(1)
+
+    alice = Supersocket()
+    InitializeSupersocket(alice, "Alice", "127.0.0.1", 0)
+    InitializeSupersocketListener(alice)
+    target = DiscoverSupersocketTimeout(alice, "Decoder", 2000)
+    assert target >= 0
+
+    second = StartReplica(2)
+    time.sleep(UPDATE_TIME)
+
+    try:
+        m = Message()
+        m._from = "Alice"
+        m.data = b"still the first"
+        SendMessage(alice, target, m)
+
+        assert first.stdout.readline() == "still the first\n"
+    finally:
+        first.kill()
+        second.kill()
+
+    CloseSupersocket(alice)
+
+    print("Replicas OK!")
@@ -0,0 +1,45 @@
+##
+# @file
+#
+# Test sending numpy arrays as typed arrays. The receiving side should get back
+# an array with the same dtype and shape, without any reshaping or typecasting.
+#
+# @author David Brandman
+
+import numpy
+from supersocket import *
+
+if __name__ == "__main__":
+
+    SetVerbose(DISABLE)
+
+    alice = Supersocket()
+    bob   = Supersocket()
+
+    aliceToBob = AddSocket(alice, "Bob", "127.0.0.1", 5001, AF_INET, SOCK_DGRAM, CONNECT)
+    AddSocket(bob, "Bob", "127.0.0.1", 5001, AF_INET, SOCK_DGRAM, BIND)
+
+    r = Message()
+    r.initialize(60000)
+
+    for sent in [numpy.arange(12, dtype=numpy.float64).reshape(3, 4),
+                 numpy.asfortranarray(numpy.arange(24, dtype=numpy.int16).reshape(2, 3, 4)),
+                 numpy.array([True, False, True])]:
+
+        SendArray(alice, aliceToBob, sent)
+        received = ReceiveArray(bob, r)
+
+        print("Sent %s %s, received %s %s" % (sent.dtype, sent.shape, received.dtype, received.shape))
+        assert received.dtype == sent.dtype
+        assert received.shape == sent.shape
+        assert (received == sent).all()
+
+    # A shape that the buffer doesn't fill, or with too many dimensions, is refused
+    for shape, buffer in [((3,), bytearray(8)), ((1,) * 9, bytearray(8))]:
+        try:
+            _SendArrayBuffer(alice, aliceToBob, 0, ARRAY_DTYPE_FLOAT64, ARRAY_ORDER_ROW_MAJOR, shape, buffer)
+            assert False, "Sent a shape of %s with %d bytes" % (shape, len(buffer))
+        except ValueError:
+            pass
+
+    print("Typed arrays OK!")
@@ -0,0 +1,228 @@
+#define _GNU_SOURCE // For pthread_setaffinity_np()
+#include "ShardedReceiver.h"
+#include <errno.h>
+#include <linux/filter.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void *ShardedReceiverThread(void *input);
+static int OpenShard(ShardedReceiverWorker *w, SocketWrapper *primary);
+static int SteerBySender(int soc, int nShards);
+static void PinToCore(ShardedReceiverWorker *w);
+static void CloseShards(ShardedReceiver *r);
+
+
+int StartShardedReceiver(ShardedReceiver *r, Supersocket *s, ShardedReceiverCallback callback, void *arg)
+{
+	int steer;
+	int nShards = GetSupersocketReceiveShards(&steer);
+
+	// A single shard is just a worker on the socket s already has
+	int target = FindSocketWrapperByName(s, s->name, nShards > 1 ? BIND | REUSEPORT : BIND, AF_INET);
+	if(target < 0)
+	{
+		DisplayError("[%s] Has no AF_INET socket to share between %d shards. Call SetSupersocketReceiveShards() before InitializeSupersocket()", s->name, nShards);
+		return -1;
+	}
+
+	memset(r, 0, sizeof(ShardedReceiver));
+	r->s 		= s;
+	r->callback = callback;
+	r->arg 		= arg;
+	r->nShards 	= nShards;
+	r->workers 	= calloc(nShards, sizeof(ShardedReceiverWorker));
+	if(r->workers == NULL)
+	{
+		DisplayError("[%s] Unable to allocate %d ShardedReceiver workers", s->name, nShards);
+		return -1;
+	}
+
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+	SocketWrapper primary 	= table->socketWrapper[target];
+	ReleaseSupersocketTable(s, epoch);
+
+	// Every shard has to be bound before the program that picks between them is attached
+	int val = 0;
+	for(int i = 0; i < nShards; i++)
+	{
+		r->workers[i].r 		= r;
+		r->workers[i].shard 	= i;
+		r->workers[i].sw.socket = -1;
+		if(i > 0 && val == 0)
+			val = OpenShard(&r->workers[i], &primary);
+	}
+	if(val == 0 && steer && nShards > 1)
+		val = SteerBySender(primary.socket, nShards);
+	if(val < 0)
+	{
+		CloseShards(r);
+		return -1;
+	}
+
+	r->running = 1;
+	int nStarted = 0;
+	while(val == 0 && nStarted < nShards)
+	{
+		if(pthread_create(&r->workers[nStarted].thread, NULL, &ShardedReceiverThread, &r->workers[nStarted]) != 0)
+		{
+			DisplayError("[%s] Unable to start ShardedReceiver worker %d", s->name, nStarted);
+			val = -1;
+		}
+		else
+			nStarted++;
+	}
+
+	if(val < 0)
+	{
+		r->running = 0;
+		for(int i = 0; i < nStarted; i++)
+			pthread_join(r->workers[i].thread, NULL);
+		CloseShards(r);
+		return -1;
+	}
+
+	Display("[%s] ShardedReceiver started with %d shards%s", s->name, nShards, steer ? ", steered by sender" : "");
+	return 0;
+}
+
+int StopShardedReceiver(ShardedReceiver *r)
+{
+	if(r->workers == NULL)
+		return -1;
+
+	// The workers notice within SHARDED_RECEIVER_POLL_TIME
+	r->running = 0;
+	uint64_t nReceived = 0;
+	for(int i = 0; i < r->nShards; i++)
+	{
+		pthread_join(r->workers[i].thread, NULL);
+		nReceived += r->workers[i].nReceived;
+	}
+	CloseShards(r);
+
+	Display("[%s] ShardedReceiver stopped: %llu received", r->s->name, (unsigned long long) nReceived);
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+
+/**
+Shard 0 receives on the Supersocket, like anyone calling ReceiveMessage() would.
+The others have a socket to themselves, so they read it directly.
+*/
+static void *ShardedReceiverThread(void *input)
+{
+	ShardedReceiverWorker *w 	= (ShardedReceiverWorker *) input;
+	ShardedReceiver *r 			= w->r;
+	PinToCore(w);
+
+	Message m = CreateMessageBuffer(SHARDED_RECEIVER_MAX_DATAGRAM);
+	if(m.data == NULL)
+	{
+		DisplayError("[%s] ShardedReceiver worker %d could not allocate its receive buffer", r->s->name, w->shard);
+		return NULL;
+	}
+
+	while(r->running)
+	{
+		m.dlen = SHARDED_RECEIVER_MAX_DATAGRAM;
+
+		int bytesRead;
+		if(w->shard == 0)
+			bytesRead = ReceiveMessageTimeout(r->s, &m, SHARDED_RECEIVER_POLL_TIME);
+		else if(PollSocketWrapper(&w->sw, SHARDED_RECEIVER_POLL_TIME) > 0)
+			bytesRead = ReceiveMessageFromSocketWrapper(&w->sw, &m);
+		else
+			bytesRead = 0;
+
+		if(bytesRead <= 0)
+			continue;
+
+		w->nReceived++;
+		r->callback(&m, w->shard, r->arg);
+	}
+
+	DestroyMessageBuffer(&m);
+	return NULL;
+}
+
+/** Another socket on the primary's address and port, which is where the kernel has put it */
+static int OpenShard(ShardedReceiverWorker *w, SocketWrapper *primary)
+{
+	PopulateSocketWrapper(&w->sw, primary->name, "0.0.0.0", 0, AF_INET, SOCK_DGRAM, BIND | REUSEPORT);
+	w->sw.inetStruct = primary->inetStruct;
+
+	if(InitializeSocketWrapper(&w->sw) < 0)
+	{
+		DisplayError("[%s] Unable to bind receive shard %d", primary->name, w->shard);
+		CloseSocketWrapper(&w->sw);
+		w->sw.socket = -1;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+Pick the shard from the sender's name, which is the first PROCESS_MAX_CHARS bytes of
+every Message. The program sees the datagram from the start of the UDP payload, and
+XORs the name together four bytes at a time, then mixes and reduces it. The kernel
+numbers the shards in the order they were bound, which is the order of the workers.
+CreateMessage() zeroes the name past its end, so the same name always gives the
+same shard. Anything shorter than a name goes to shard 0.
+*/
+static int SteerBySender(int soc, int nShards)
+{
+	struct sock_filter code[3 * (PROCESS_MAX_CHARS / 4) + 4];
+	int n = 0;
+
+	code[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 0);
+	for(int offset = 4; offset < PROCESS_MAX_CHARS; offset += 4)
+	{
+		code[n++] = (struct sock_filter) BPF_STMT(BPF_MISC | BPF_TAX, 0);
+		code[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offset);
+		code[n++] = (struct sock_filter) BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0);
+	}
+	code[n++] = (struct sock_filter) BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 0x9E3779B1);
+	code[n++] = (struct sock_filter) BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16);
+	code[n++] = (struct sock_filter) BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, nShards);
+	code[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_A, 0);
+
+	struct sock_fprog program = {.len = n, .filter = code};
+	if(setsockopt(soc, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0)
+	{
+		DisplayError("Unable to steer receive shards by sender: %s", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/** Shard 0 is the Supersocket's own socket, which stays open */
+static void CloseShards(ShardedReceiver *r)
+{
+	for(int i = 1; i < r->nShards; i++)
+		CloseSocketWrapper(&r->workers[i].sw);
+
+	free(r->workers);
+	r->workers = NULL;
+}
+
+/** One core per shard, going round again if there are more shards than cores */
+static void PinToCore(ShardedReceiverWorker *w)
+{
+	long nCores = sysconf(_SC_NPROCESSORS_ONLN);
+	if(nCores < 1)
+		return;
+
+	cpu_set_t cores;
+	CPU_ZERO(&cores);
+	CPU_SET(w->shard % nCores, &cores);
+	if(pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores) != 0)
+		DisplayWarning("[%s] Unable to pin receive shard %d to a core", w->r->s->name, w->shard);
+}
@@ -0,0 +1,98 @@
+/**
+@file
+@brief Receive on one thread per core, sharing the AF_INET port between them
+
+However many threads call ReceiveMessage(), there is one bound AF_INET socket behind
+a Supersocket name, and draining it takes one core at most. After
+SetSupersocketReceiveShards(), that socket is bound with SO_REUSEPORT, and a
+ShardedReceiver binds nShards - 1 more to the same port. The kernel spreads what
+arrives across them, and each has a worker thread of its own, pinned to its own core,
+that hands every Message to a callback.
+
+@code
+	SetSupersocketReceiveShards(4, 1);
+	InitializeSupersocket(&s, "Decoder", "0.0.0.0", 6000);
+
+	ShardedReceiver r = {0};
+	StartShardedReceiver(&r, &s, HandleMessage, &state);
+
+	// ... the workers call HandleMessage(&m, shard, &state) for everything that arrives
+
+	StopShardedReceiver(&r);
+@endcode
+
+Shard 0 receives on the Supersocket itself, so it gets the AF_UNIX socket, local
+connections and anything else bound as well, and Messages it receives count as heard
+from their sender. The other shards only ever see the AF_INET port, and don't. Turn
+heartbeats on (EnableSupersocketHeartbeats()) if liveness matters.
+
+Messages from any one sender arrive on one shard, and so in order, but the callback is
+called from several threads at once; it has to look after any state it shares. The
+Message it is given is only good until it returns. While the ShardedReceiver is
+running it is the only thing that should receive on the Supersocket.
+
+Tools/ShardedReceiveBenchmark.c measures how the receive rate goes with the number of shards.
+
+@authors David Brandman and Benjamin Shanahan
+*/
+
+#pragma once
+
+#include "Supersocket.h"
+
+/** Largest datagram the workers can receive */
+#define SHARDED_RECEIVER_MAX_DATAGRAM 65507
+
+/** How often the workers look up from poll() to see if they've been asked to stop */
+#define SHARDED_RECEIVER_POLL_TIME 100 //Milliseconds
+
+/** What the workers hand every Message to, along with the shard it arrived on */
+typedef void (*ShardedReceiverCallback)(Message *m, int shard, void *arg);
+
+/**
+@brief One worker thread and the socket it drains
+
+Shard 0 drains the Supersocket, and has no SocketWrapper of its own.
+*/
+typedef struct
+{
+	struct ShardedReceiver *r;
+	int shard;
+	SocketWrapper sw;
+	pthread_t thread;
+	uint64_t nReceived;
+
+} ShardedReceiverWorker;
+
+/**
+@brief Definition of the ShardedReceiver structure
+*/
+typedef struct ShardedReceiver
+{
+	Supersocket *s;
+	ShardedReceiverCallback callback;
+	void *arg;
+	volatile int running;
+
+	int nShards;
+	ShardedReceiverWorker *workers;
+
+} ShardedReceiver;
+
+/**
+@brief Bind the rest of the shards and start a worker for each
+
+s has to have been initialized after SetSupersocketReceiveShards(), and with its
+AF_INET socket still open. The number of shards and whether they are steered by
+sender are what SetSupersocketReceiveShards() said. With a single shard, the one
+worker receives on s like anyone else would.
+*/
+int StartShardedReceiver(ShardedReceiver *r, Supersocket *s, ShardedReceiverCallback callback, void *arg);
+
+/**
+@brief Stop the workers and close the extra shards
+
+Anything still waiting on those shards is lost, and from then on everything arrives
+on the Supersocket's own socket again.
+*/
+int StopShardedReceiver(ShardedReceiver *r);
@@ -1,8 +1,27 @@
+#define _GNU_SOURCE // For sendmmsg() and MSG_CMSG_CLOEXEC
 #include "SocketWrapper.h"
 #include "ManageHeapMemory.h"
+#include "Compression.h"
 #include <poll.h> // for sturct pollfd
 #include <errno.h>
 #include <unistd.h> // For unlink(), write
+#include <sys/uio.h> // For readv(), writev()
+#include <stddef.h> // For offsetof()
+
+static int SendOnConnection(SocketWrapper *sw, struct iovec *data, int nVec, MessagingOptions *options);
+static int ReconnectSocketWrapper(SocketWrapper *sw);
+static int IsBrokenConnection(int error);
+static int HasDescriptors(MessagingOptions *options);
+static int ReceiveDescriptors(int soc, struct iovec *data, int nVec, MessagingOptions *options);
+static int DecompressReceivedMessage(Message *m, int bytesRead, int capacity);
+
+/** Room for the SCM_RIGHTS of SOCKETWRAPPER_MAX_FDS, lined up the way cmsghdr needs */
+typedef union
+{
+	char buffer[CMSG_SPACE(SOCKETWRAPPER_MAX_FDS * sizeof(int))];
+	struct cmsghdr align;
+
+} DescriptorControl;
 
 
 /////////////////////////////////////////////////////////////////////////////////
@@ -33,11 +52,20 @@ int PopulateSocketWrapper(SocketWrapper *sw,
 	strcpy(sw->name, name);
 	PopulateSockaddr_in(&sw->inetStruct, ip, port);
 	PopulateSockaddr_un(&sw->unixStruct, name);
+	if(ParseFlags(flags, ABSTRACT))
+	{
+		// Same name, but starting with a '\0' puts it in the abstract namespace
+		memmove(&sw->unixStruct.sun_path[1], sw->unixStruct.sun_path, sizeof(sw->unixStruct.sun_path) - 2);
+		sw->unixStruct.sun_path[0] = '\0';
+	}
 	sw->domain   = domain;
 	sw->type     = type;
 	sw->status   = SOCKETWRAPPER_STATUS_UNINITIALIZED;
 	sw->flags    = flags;
 	sw->socket   = -1;
+	// A contact understands only what it tells us during discovery
+	sw->capabilities = ParseFlags(flags, BIND) ? SOCKETWRAPPER_CAPABILITIES_DEFAULT : 0;
+	sw->instance 	 = 0;
 
 	return 0;
 
@@ -82,6 +110,13 @@ int InitializeSocketWrapper(SocketWrapper *sw)
 		return -1;
 	}
 
+	// Every socket that is to share a port has to ask for it before it binds
+	if (ParseFlags(sw->flags, REUSEPORT) && setsockopt(sw->socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(int)) < 0)
+	{
+	    DisplayError("Setsockopt(SO_REUSEPORT) '%s' : %s", sw->name, strerror(errno));
+		return -1;
+	}
+
 	// Step 3: Bind the socket, if the user desires it. 
 	if(ParseFlags(sw->flags, BIND))
 	{
@@ -91,17 +126,19 @@ int InitializeSocketWrapper(SocketWrapper *sw)
 		// If the process terminates and the file exists, then no one else can bind to it, 
 		// and no one can send messages to it either.
 
+		// An ABSTRACT name has no file, and the kernel lets go of it when its socket closes.
+
 		// At the end of a successful bind, the status becomes INITIALIZED.
 		if(sw->domain == AF_UNIX)
 		{
-			if(DoesFileExist(sw->unixStruct.sun_path))
+			if(ParseFlags(sw->flags, ABSTRACT) == 0 && DoesFileExist(sw->unixStruct.sun_path))
 		   		if(unlink(sw->unixStruct.sun_path))
 		   		{
 		   			DisplayError("Unlink AF_UNIX socket for '%s': %s", sw->name, strerror);
 					return -1;
 		   		}
 
-			if(bind(sw->socket, (const struct sockaddr *) &sw->unixStruct, sizeof(struct sockaddr_un)) < 0)
+			if(bind(sw->socket, (const struct sockaddr *) &sw->unixStruct, Sockaddr_unLength(&sw->unixStruct)) < 0)
 			{
 				PrintSockaddr_un(&sw->unixStruct);
 				DisplayError("Bind AF_UNIX socket for '%s' (%d): %s", sw->name, sw->socket, strerror(errno));
@@ -168,13 +205,13 @@ int InitializeSocketWrapper(SocketWrapper *sw)
 		}
 	}
 	
-	// Step 6: Connect. This is used for both SOCK_DGRAM and SOCK_STREAM connections. 
+	// Step 6: Connect. This is used for SOCK_DGRAM, SOCK_STREAM and SOCK_SEQPACKET connections. 
 	// At the end we have a connected socket! Huzzah.
 	if(ParseFlags(sw->flags, CONNECT) && ParseFlags(sw->flags, MULTICAST) == 0)
 	{
 		if(sw->domain == AF_UNIX)
 		{
-			if(connect(sw->socket, (const struct sockaddr *) &sw->unixStruct, sizeof(struct sockaddr_un)) < 0)
+			if(connect(sw->socket, (const struct sockaddr *) &sw->unixStruct, Sockaddr_unLength(&sw->unixStruct)) < 0)
 			{
 				PrintSockaddr_un(&sw->unixStruct);
 				DisplayError("Connect AF_UNIX for '%s' socket %d: %s", sw->name, sw->socket, strerror(errno));
@@ -269,7 +306,7 @@ int SendIOvecToSocketWrapper(SocketWrapper *sw, struct iovec *data, int nVec, Me
 		
 		if (sendmsg(sw->socket, &message, 0) < 0)
 		{
-			DisplayWarning("[%s][Socket: %d]Socket: %d. ~~Multicast~~ Failed Sending message: %s. ", sw->name, strerror(errno));
+			DisplayWarning("[%s][Socket: %d] ~~Multicast~~ Failed Sending message: %s. ", sw->name, sw->socket, strerror(errno));
 			return -1;			
 		}
 		return 0;
@@ -285,7 +322,7 @@ int SendIOvecToSocketWrapper(SocketWrapper *sw, struct iovec *data, int nVec, Me
 		if (sw->domain == AF_UNIX)
 		{
 			addr = (const struct sockaddr*) &sw->unixStruct;
-			len = sizeof(struct sockaddr_un);
+			len = Sockaddr_unLength(&sw->unixStruct);
 		}
 		else
 		{
@@ -300,10 +337,15 @@ int SendIOvecToSocketWrapper(SocketWrapper *sw, struct iovec *data, int nVec, Me
 		}		
 	}
 
+	// SOCK_SEQPACKET stays connected from one Message to the next, and file
+	// descriptors can only go along with sendmsg()
+	if(sw->type == SOCK_SEQPACKET || HasDescriptors(options))
+		return SendOnConnection(sw, data, nVec, options);
+
 	// Write the message to the socket! N.B. we're using connected sockets for SOCK_DGRAM.
 	if(writev(sw->socket, data, nVec) < 0)
 	{
-		DisplayWarning("[%s][Socket: %d]Socket: %d. Failed Sending message: %s. ", sw->name, strerror(errno));
+		DisplayWarning("[%s][Socket: %d] Failed Sending message: %s. ", sw->name, sw->socket, strerror(errno));
 		return -1;
 	}
 	
@@ -317,6 +359,85 @@ int SendIOvecToSocketWrapper(SocketWrapper *sw, struct iovec *data, int nVec, Me
 	return 0;
 }
 
+/**
+A SOCK_SEQPACKET contact is connected once and stays that way. If the other end has
+gone away, say because it was restarted, we connect again and have one more go.
+MSG_NOSIGNAL is so that a broken connection is an error rather than a SIGPIPE.
+Any file descriptors in options go along as SCM_RIGHTS.
+*/
+static int SendOnConnection(SocketWrapper *sw, struct iovec *data, int nVec, MessagingOptions *options)
+{
+	struct msghdr message 	= {0};
+	message.msg_iov 		= data;
+	message.msg_iovlen 		= nVec;
+
+	DescriptorControl control;
+	if(HasDescriptors(options))
+	{
+		if(sw->domain != AF_UNIX || options->nFds > SOCKETWRAPPER_MAX_FDS)
+		{
+			DisplayWarning("[%s] Can only pass up to %d file descriptors, and only over AF_UNIX", sw->name, SOCKETWRAPPER_MAX_FDS);
+			return -1;
+		}
+
+		memset(&control, 0, sizeof(control));
+		message.msg_control 	= control.buffer;
+		message.msg_controllen 	= CMSG_SPACE(options->nFds * sizeof(int));
+
+		struct cmsghdr *header 	= CMSG_FIRSTHDR(&message);
+		header->cmsg_level 		= SOL_SOCKET;
+		header->cmsg_type 		= SCM_RIGHTS;
+		header->cmsg_len 		= CMSG_LEN(options->nFds * sizeof(int));
+		memcpy(CMSG_DATA(header), options->fds, options->nFds * sizeof(int));
+	}
+
+	if(sendmsg(sw->socket, &message, MSG_NOSIGNAL) >= 0)
+		return 0;
+
+	if(sw->type == SOCK_SEQPACKET && IsBrokenConnection(errno) && ReconnectSocketWrapper(sw) == 0
+		&& sendmsg(sw->socket, &message, MSG_NOSIGNAL) >= 0)
+		return 0;
+
+	DisplayWarning("[%s][Socket: %d] Failed Sending message: %s. ", sw->name, sw->socket, strerror(errno));
+	return -1;
+}
+
+/**
+Connect sw all over again, but keep its file descriptor, so that any copy of sw (there's
+one in every Supersocket table that has it) carries on working.
+*/
+static int ReconnectSocketWrapper(SocketWrapper *sw)
+{
+	if(sw->domain != AF_UNIX)
+		return -1;
+
+	int soc = socket(sw->domain, sw->type, 0);
+	if(soc < 0)
+		return -1;
+
+	int val = connect(soc, (const struct sockaddr *) &sw->unixStruct, Sockaddr_unLength(&sw->unixStruct));
+	if(val == 0 && dup2(soc, sw->socket) < 0)
+		val = -1;
+
+	int error = errno;
+	close(soc);
+	errno = error;
+
+	if(val == 0)
+		Display("[%s] Reconnected socket %d", sw->name, sw->socket);
+	return val;
+}
+
+static int IsBrokenConnection(int error)
+{
+	return error == EPIPE || error == ECONNRESET || error == ENOTCONN || error == ECONNREFUSED;
+}
+
+static int HasDescriptors(MessagingOptions *options)
+{
+	return options != NULL && options->fds != NULL && options->nFds > 0;
+}
+
 
 int SendDataToSocketWrapper(SocketWrapper *sw, void *data, int dlen, MessagingOptions *options)
 {
@@ -327,9 +448,67 @@ int SendDataToSocketWrapper(SocketWrapper *sw, void *data, int dlen, MessagingOp
 
 int SendMessageToSocketWrapper(SocketWrapper *sw, Message *m)
 {
-	struct iovec messageContents[4] = {0};
+	struct iovec messageContents[MESSAGE_NUM_IOVECS] = {0};
 	PopulateIOvec(messageContents, m);
-	return SendIOvecToSocketWrapper(sw, (struct iovec*) &messageContents, 4, NULL);
+	return SendIOvecToSocketWrapper(sw, (struct iovec*) &messageContents, MESSAGE_NUM_IOVECS, NULL);
+}
+
+/**
+@brief Send several Messages with as few system calls as we can
+
+Connected and multicast SOCK_DGRAM sockets, and connected SOCK_SEQPACKET ones,
+hand up to SOCKETWRAPPER_MAX_BATCH Messages to the kernel per sendmmsg() call.
+Anything else goes out one Message at a time.
+*/
+int SendMessagesToSocketWrapper(SocketWrapper *sw, Message *m, int nMessages)
+{
+	int isMulticast = ParseFlags(sw->flags, MULTICAST);
+	int isBatched 	= (sw->type == SOCK_DGRAM || (sw->type == SOCK_SEQPACKET && isMulticast == 0));
+	if(sw->socket == -1 || isBatched == 0 || (isMulticast == 0 && ParseFlags(sw->flags, CONNECT) == 0))
+	{
+		for(int i = 0; i < nMessages; i++)
+			if(SendMessageToSocketWrapper(sw, &m[i]) < 0)
+				return -1;
+		return 0;
+	}
+
+	struct mmsghdr messages[SOCKETWRAPPER_MAX_BATCH];
+	struct iovec messageContents[SOCKETWRAPPER_MAX_BATCH][MESSAGE_NUM_IOVECS];
+
+	int sent 		= 0;
+	int reconnected = 0;
+	while(sent < nMessages)
+	{
+		int n = nMessages - sent < SOCKETWRAPPER_MAX_BATCH ? nMessages - sent : SOCKETWRAPPER_MAX_BATCH;
+		memset(messages, 0, n * sizeof(struct mmsghdr));
+		for(int i = 0; i < n; i++)
+		{
+			PopulateIOvec(messageContents[i], &m[sent + i]);
+			messages[i].msg_hdr.msg_iov 	= messageContents[i];
+			messages[i].msg_hdr.msg_iovlen 	= MESSAGE_NUM_IOVECS;
+			if(isMulticast)
+			{
+				messages[i].msg_hdr.msg_name 	= &sw->inetStruct;
+				messages[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+			}
+		}
+
+		int val = sendmmsg(sw->socket, messages, n, MSG_NOSIGNAL);
+		if(val <= 0 && sw->type == SOCK_SEQPACKET && reconnected == 0 && IsBrokenConnection(errno))
+		{
+			reconnected = 1;
+			if(ReconnectSocketWrapper(sw) == 0)
+				continue;
+		}
+		if(val <= 0)
+		{
+			DisplayWarning("[%s][Socket: %d] Failed sending batch of %d messages: %s", sw->name, sw->socket, n, strerror(errno));
+			return -1;
+		}
+		sent += val;
+	}
+
+	return 0;
 }
 
 /**
@@ -360,19 +539,64 @@ int ReceiveIOvecFromSocketWrapper(SocketWrapper *sw, struct iovec *data, int nVe
 
 	}
 
-	bytesRead = readv(readingSocket, data, nVec);
+	if(HasDescriptors(options))
+		bytesRead = ReceiveDescriptors(readingSocket, data, nVec, options);
+	else
+		bytesRead = readv(readingSocket, data, nVec);
+
 	if(bytesRead < 0)
 	{
 		DisplayWarning("[%s] Failed Reading message: %s", sw->name, strerror(errno));
 		return -1;
 	}
 
-	if(sw->type == SOCK_STREAM)
+	// One Message per accepted connection, for SOCK_STREAM and SOCK_SEQPACKET alike
+	if(readingSocket != sw->socket)
 		close(readingSocket);
 
 	return bytesRead;
 }
 
+/**
+readv(), but with room for any file descriptors that came along. They arrive already
+marked close-on-exec.
+*/
+static int ReceiveDescriptors(int soc, struct iovec *data, int nVec, MessagingOptions *options)
+{
+	DescriptorControl control;
+	struct msghdr message 	= {0};
+	message.msg_iov 		= data;
+	message.msg_iovlen 		= nVec;
+	message.msg_control 	= control.buffer;
+	message.msg_controllen 	= sizeof(control.buffer);
+
+	int room 		= options->nFds;
+	options->nFds 	= 0;
+
+	int bytesRead = recvmsg(soc, &message, MSG_CMSG_CLOEXEC);
+	if(bytesRead < 0)
+		return -1;
+
+	for(struct cmsghdr *header = CMSG_FIRSTHDR(&message); header != NULL; header = CMSG_NXTHDR(&message, header))
+	{
+		if(header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		int nFds = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for(int i = 0; i < nFds; i++)
+		{
+			int fd;
+			memcpy(&fd, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+			if(options->nFds < room)
+				options->fds[options->nFds++] = fd;
+			else
+				close(fd);
+		}
+	}
+
+	return bytesRead;
+}
+
 int ReceiveDataFromSocketWrapper(SocketWrapper *sw, void *data, int dlen, MessagingOptions *options)
 {
 	struct iovec messageContents = {.iov_base = data, .iov_len = dlen};
@@ -382,11 +606,77 @@ int ReceiveDataFromSocketWrapper(SocketWrapper *sw, void *data, int dlen, Messag
 
 int ReceiveMessageFromSocketWrapper(SocketWrapper *sw, Message *m)
 {
-	struct iovec messageContents[4] = {0};
+	int capacity = m->dlen;
+
+	struct iovec messageContents[MESSAGE_NUM_IOVECS] = {0};
 	PopulateIOvec(messageContents, m);
-	return ReceiveIOvecFromSocketWrapper(sw, (struct iovec*) &messageContents, 4, NULL);
+	int bytesRead = ReceiveIOvecFromSocketWrapper(sw, (struct iovec*) &messageContents, MESSAGE_NUM_IOVECS, NULL);
 
+	return CheckReceivedMessage(m, bytesRead, capacity);
+}
 
+/**
+m->dlen is whatever the sender wrote in the header, so until it's been held up against
+what actually arrived nothing can go by it. A datagram too big for the buffer is cut
+short by the kernel, and one that was made up can say anything at all.
+*/
+int CheckReceivedMessage(Message *m, int bytesRead, int capacity)
+{
+	if(bytesRead <= 0)
+		return bytesRead;
+
+	if(bytesRead < (int) MESSAGE_HEADER_LENGTH)
+	{
+		DisplayWarning("Discarding a %d byte Message, which is too short to have a header", bytesRead);
+		return -1;
+	}
+
+	// Its data is in a file descriptor, which the kernel throws away unless we ask for it
+	if(m->flags & MESSAGE_FLAG_BUFFER_HANDLE)
+	{
+		DisplayWarning("Discarding a buffer handle from %.*s, which only ReceiveBufferHandle() can receive", PROCESS_MAX_CHARS, m->from);
+		return -1;
+	}
+
+	if(m->dlen != (uint32_t) (bytesRead - (int) MESSAGE_HEADER_LENGTH))
+	{
+		DisplayWarning("Discarding Message from %.*s, which says it has %u bytes of data but has %d (room for %d)",
+			PROCESS_MAX_CHARS, m->from, m->dlen, bytesRead - (int) MESSAGE_HEADER_LENGTH, capacity);
+		return -1;
+	}
+
+	return DecompressReceivedMessage(m, bytesRead, capacity);
+}
+
+/**
+If the sender compressed the payload then what we just read into m->data is the
+compressed block. We move it into the thread's scratch buffer and decompress it
+straight back into m->data, so the caller's buffer ends up holding the original bytes.
+*/
+static int DecompressReceivedMessage(Message *m, int bytesRead, int capacity)
+{
+	if((m->flags & MESSAGE_FLAG_COMPRESSED) == 0)
+		return bytesRead;
+
+	int compressedLength = bytesRead - (int) MESSAGE_HEADER_LENGTH;
+	void *scratch 		 = GetCompressionScratch(compressedLength);
+	if(compressedLength <= 0 || compressedLength > capacity || scratch == NULL)
+	{
+		DisplayWarning("Compressed Message from %s does not fit the receive buffer", m->from);
+		return -1;
+	}
+	memcpy(scratch, m->data, compressedLength);
+
+	int dlen = DecompressBuffer(scratch, compressedLength, m->data, capacity);
+	if(dlen < 0)
+	{
+		DisplayWarning("Unable to decompress Message from %s", m->from);
+		return -1;
+	}
+
+	m->dlen 	= dlen;
+	m->flags 	&= ~MESSAGE_FLAG_COMPRESSED;
+	return (int) MESSAGE_HEADER_LENGTH + dlen;
 }
 
 int PopulateIOvec(struct iovec *messageContents, Message *m)
@@ -397,11 +687,14 @@ int PopulateIOvec(struct iovec *messageContents, Message *m)
 	messageContents[1].iov_base 	= &m->id;
 	messageContents[1].iov_len  	= sizeof(m->id);
 
-	messageContents[2].iov_base 	= &m->dlen;
-	messageContents[2].iov_len  	= sizeof(m->dlen);
+	messageContents[2].iov_base 	= &m->flags;
+	messageContents[2].iov_len  	= sizeof(m->flags);
+
+	messageContents[3].iov_base 	= &m->dlen;
+	messageContents[3].iov_len  	= sizeof(m->dlen);
 
-	messageContents[3].iov_base 	= m->data;
-	messageContents[3].iov_len  	= m->dlen;
+	messageContents[4].iov_base 	= m->data;
+	messageContents[4].iov_len  	= m->dlen;
 
 	return 0;
 }
@@ -421,13 +714,13 @@ int PollSocketWrapper(SocketWrapper *sw, int milliseconds)
 
 int ReplyToSocketWrapper(int soc, SocketWrapper *sw, Message *m)
 {
-	struct iovec messageContents[4];
+	struct iovec messageContents[MESSAGE_NUM_IOVECS];
 	PopulateIOvec(messageContents, m);
 	struct msghdr messageHeader = {0};
 	messageHeader.msg_name 			= &sw->inetStruct;
 	messageHeader.msg_namelen 		= sizeof(struct sockaddr_in);
 	messageHeader.msg_iov  		    = messageContents;
-	messageHeader.msg_iovlen 		= 4;
+	messageHeader.msg_iovlen 		= MESSAGE_NUM_IOVECS;
 
 	if(sendmsg(soc, &messageHeader, 0) < 0)
 	{
@@ -458,6 +751,7 @@ void PrintSocketWrapper(SocketWrapper *s)
 	{
 		case SOCK_DGRAM  : strcpy(type, "SOCK_DGRAM");  break;
 		case SOCK_STREAM : strcpy(type, "SOCK_STREAM"); break;
+		case SOCK_SEQPACKET : strcpy(type, "SOCK_SEQPACKET"); break;
 	}
 
 	char status[20] = {0};
@@ -469,9 +763,11 @@ void PrintSocketWrapper(SocketWrapper *s)
 		case SOCKETWRAPPER_STATUS_SOCKETERROR   : strcpy(status, "ERROR: SOCKET"); 	break;
 		case SOCKETWRAPPER_STATUS_BINDERROR     : strcpy(status, "ERROR: BIND"); 	break;
 		case SOCKETWRAPPER_STATUS_CONNECTERROR  : strcpy(status, "ERROR: CONNECT"); break;
+		case SOCKETWRAPPER_STATUS_DISABLED      : strcpy(status, "Disabled"); 	    break;
+		case SOCKETWRAPPER_STATUS_CLOSED        : strcpy(status, "Closed"); 	    break;
 	}
 
-    char flags[50] = {0};
+    char flags[80] = {0};
 	if(ParseFlags(s->flags, UNINITIALIZED))
 		strcat(flags, "Uninitialized ");
 	if(ParseFlags(s->flags, BIND))
@@ -482,6 +778,10 @@ void PrintSocketWrapper(SocketWrapper *s)
 		strcat(flags, "Multicast ");	
 	if(ParseFlags(s->flags, LISTEN))
 		strcat(flags, "Listen ");		
+	if(ParseFlags(s->flags, ABSTRACT))
+		strcat(flags, "Abstract ");
+	if(ParseFlags(s->flags, REUSEPORT))
+		strcat(flags, "Reuseport ");
 
 	Display("Name      : %s", s->name);
 	PrintSockaddr_in(&s->inetStruct);
@@ -502,7 +802,9 @@ void PrintSockaddr_in(struct sockaddr_in *addr)
 
 void PrintSockaddr_un(struct sockaddr_un *addr)
 {
-    Display("AF_UNIX Path: %s",addr->sun_path);
+	// An abstract name is shown the way ss -x shows it
+	char *path = addr->sun_path[0] == '\0' ? &addr->sun_path[1] : addr->sun_path;
+    Display("AF_UNIX Path: %s%s", addr->sun_path[0] == '\0' ? "@" : "", path);
 }
 
 
@@ -567,6 +869,14 @@ int PopulateSockaddr_un(struct sockaddr_un *addr, char *name)
 	return 0;
 }
 
+socklen_t Sockaddr_unLength(struct sockaddr_un *addr)
+{
+	if(addr->sun_path[0] != '\0')
+		return sizeof(struct sockaddr_un);
+
+	return offsetof(struct sockaddr_un, sun_path) + 1 + strnlen(&addr->sun_path[1], sizeof(addr->sun_path) - 1);
+}
+
 
 int ParseFlags(int flags, Flag toParse)
 {
@@ -577,6 +887,8 @@ int ParseFlags(int flags, Flag toParse)
 		case CONNECT       : return (flags >> 2) & 1; break;
 		case MULTICAST     : return (flags >> 3) & 1; break;
 		case LISTEN 	   : return (flags >> 4) & 1; break;
+		case ABSTRACT 	   : return (flags >> 5) & 1; break;
+		case REUSEPORT 	   : return (flags >> 6) & 1; break;
 	}
 	return -1;
 }
@@ -33,6 +33,15 @@ And if you wanted to receive a message from a SOCK_STREAM:
 
 	PopulateSocketWrapper(&s, "Alice", "127.0.0.1", 5000, AF_INET, SOCK_STREAM, BIND | LISTEN );
 
+On the same computer, a reliable and ordered AF_UNIX connection that is kept open
+between Messages, with no file in /tmp:
+
+	PopulateSocketWrapper(&s, "Alice", NULL, 0, AF_UNIX, SOCK_SEQPACKET, BIND | LISTEN | ABSTRACT);
+	PopulateSocketWrapper(&s, "Alice", NULL, 0, AF_UNIX, SOCK_SEQPACKET, CONNECT | ABSTRACT);
+
+A SocketWrapper on its own takes one Message per accepted connection, like SOCK_STREAM.
+A Supersocket keeps each connection it accepts, see SetSupersocketLocalTransport().
+
 Once this is done you're probably interested in sending or receiving
 messages using a SocketWrapper object. There are two wrappers to 
 do this. There is a ReceiveMessage() and SendMessage() wrapper, which 
@@ -50,6 +59,7 @@ really convenient to communicate the contents of a message being sent.
 #include <arpa/inet.h> // for the inet() call for populating structs and such
 #include <sys/socket.h> // socket() creation
 #include <sys/un.h> // for sturct_sockaddr_un
+#include <sys/uio.h> // for struct iovec
 #include "Message.h"
 #include "Display.h"
 
@@ -67,6 +77,11 @@ would connect to /tmp/p_Apple().
 It turns out that AF_UNIX supports both SOCK_DGRAM and SOCK_STREAM.
 However, from my research the SOCK_DGRAM is lossless, so it made
 sense to just create the UDP communication method for this.
+
+With the ABSTRACT flag the same name is used in Linux's abstract
+namespace instead (it shows up as @/tmp/p_Apple in `ss -x`). Nothing
+is created on disk, so there is no stale file to unlink when binding,
+and the name goes away by itself when the process that bound it does.
 */
 #define AF_UNIX_FILENAME "/tmp/p_%s"  
 
@@ -75,6 +90,16 @@ sense to just create the UDP communication method for this.
 */
 #define NUM_SOCKSTREAM_LISTENERS 3
 
+/** 
+@brief Most Messages handed to the kernel in one sendmmsg() call
+*/
+#define SOCKETWRAPPER_MAX_BATCH 64
+
+/** 
+@brief Most file descriptors that can go along with one send over AF_UNIX
+*/
+#define SOCKETWRAPPER_MAX_FDS 16
+
 
 /**
 @brief Definition of the SocketWrapper structure
@@ -87,10 +112,16 @@ both are usually not initialized with meaningful data.
 The following fields refer to:
 
 - **domain:** whether this is AF_INET or AF_UNIX
-- **type:**   whether the socket is SOCK_DGRAM or SOCK_STREAM
+- **type:**   whether the socket is SOCK_DGRAM or SOCK_STREAM (or SOCK_SEQPACKET, for AF_UNIX)
 - **status:** See the enum struct SOCKETWRAPPER_STATUS_LIST for more info
 - **flags:**  See enum Flag for more info
 - **socket:** contains the int corresponding to the file descriptor for the socket
+- **capabilities:** See enum Capability. For a bound socket this is what we advertise
+                    to other processes during discovery; for a connected socket it is
+                    what the other end told us it understands, which is nothing for one
+                    added by hand with AddSocket().
+- **instance:** for a contact that was discovered, the instance in its DiscoveryRecord,
+                which tells replicas with the same name apart. 0 if we don't know.
 
 Note: `PROCESS_MAX_CHARS` defined in Message.h
 */
@@ -100,10 +131,12 @@ typedef struct
 	struct sockaddr_in inetStruct;
 	struct sockaddr_un unixStruct;
 	int domain; // AF_UNIX vs AF_INET
-	int type; // SOCKET_DGRAM or SOCKET_STREAM
+	int type; // SOCKET_DGRAM, SOCKET_STREAM or SOCK_SEQPACKET
 	int status; // Defines whether it is initialized, defined, offline, etc.
 	int flags; // Defines whether it is connected or bound
 	int socket; // Contains the binded / connected socket
+	int capabilities; // What the other end of this socket understands
+	uint32_t instance; // Which process is at the other end, if discovery told us
 
 } SocketWrapper;
 
@@ -134,6 +167,12 @@ The definitions are as follows:
 
 7. **ListenError:** If you tried to listen to a socket and failed
 
+8. **Disabled:** A contact that has gone quiet. It's still there, but sends to
+				 everyone skip it until it's heard from again. See SupersocketListener.h.
+
+9. **Closed:** A contact that has gone away. Its socket has been closed and it
+			   has been taken out of the Supersocket's lists.
+
 */
 typedef enum 
 {
@@ -143,7 +182,9 @@ typedef enum
 	SOCKETWRAPPER_STATUS_SOCKETERROR,
 	SOCKETWRAPPER_STATUS_BINDERROR,
 	SOCKETWRAPPER_STATUS_CONNECTERROR,
-	SOCKETWRAPPER_STATUS_LISTENERROR
+	SOCKETWRAPPER_STATUS_LISTENERROR,
+	SOCKETWRAPPER_STATUS_DISABLED,
+	SOCKETWRAPPER_STATUS_CLOSED
 
 
 } SOCKETWRAPPER_STATUS_LIST; 
@@ -156,6 +197,13 @@ together during declaration. So, for example, in the flags value of
 PopulateSocketWrapper() you would call `BIND | MULTICAST` if you wanted to
 listen in on a multicast address. The values here are parse in the ParseFlags()
 function.
+
+ABSTRACT only means anything for AF_UNIX: the address is in the abstract namespace
+rather than at the file AF_UNIX_FILENAME.
+
+REUSEPORT sets SO_REUSEPORT before binding, so that several sockets can be bound to
+the same port and the kernel shares what arrives between them (see
+SetSupersocketReceiveShards()).
 */
 typedef enum 
 {
@@ -163,17 +211,59 @@ typedef enum
 	BIND 			= 2,
 	CONNECT 		= 4,
 	MULTICAST 		= 8,
-	LISTEN 		    = 16
+	LISTEN 		    = 16,
+	ABSTRACT 		= 32,
+	REUSEPORT 		= 64
 
 } Flag;
 
 /**
-Right now this structure is empty, but it allows us to future proof a little bit
-by saying that we may want options in the future!
+@brief List of the transport capabilities a SocketWrapper can advertise
+
+These are OR'd together in the .capabilities field. The bound SocketWrapper
+that gets handed out by SupersocketListener carries the capabilities of the
+process that owns it, and DiscoverSupersocket() keeps them with the contact,
+so the sender always knows what the receiver is able to decode.
+
+- **SOCKETWRAPPER_CAPABILITY_COMPRESSION:** can decompress MESSAGE_FLAG_COMPRESSED payloads
+- **SOCKETWRAPPER_CAPABILITY_ABSTRACT_UNIX:** the AF_UNIX socket of the same name is in the
+                                          abstract namespace
+- **SOCKETWRAPPER_CAPABILITY_SEQPACKET:** the AF_UNIX socket of the same name takes
+                                      SOCK_SEQPACKET connections
+- **SOCKETWRAPPER_CAPABILITY_TOPIC:** the address and port are the multicast group a topic
+                                  is published on (see Topic.h), to be joined rather than sent to
+
+The abstract and SOCK_SEQPACKET bits describe how the process is reached from the same
+computer, so they are set by InitializeSupersocket() rather than being part of
+SOCKETWRAPPER_CAPABILITIES_DEFAULT, and the topic bit is set by PublishTopic().
+*/
+typedef enum
+{
+	SOCKETWRAPPER_CAPABILITY_COMPRESSION 	= 1,
+	SOCKETWRAPPER_CAPABILITY_ABSTRACT_UNIX 	= 2,
+	SOCKETWRAPPER_CAPABILITY_SEQPACKET 		= 4,
+	SOCKETWRAPPER_CAPABILITY_TOPIC 			= 8
+
+} Capability;
+
+/** Everything this build of the library is able to decode */
+#define SOCKETWRAPPER_CAPABILITIES_DEFAULT (SOCKETWRAPPER_CAPABILITY_COMPRESSION)
+
+/**
+Options for a single send or receive. Passing NULL is the same as passing one
+that is all zeros.
+
+- **fds, nFds:** file descriptors passed alongside the data with SCM_RIGHTS, which
+                 only works over AF_UNIX. On a send, the nFds (at most SOCKETWRAPPER_MAX_FDS)
+                 in fds go along with it; the sender can close its copies straight
+                 afterwards. On a receive, fds has room for nFds, and nFds is set to
+                 however many arrived. Anything that doesn't fit is closed.
 */
 typedef struct 
 {
-	
+	int *fds;
+	int nFds;
+
 } MessagingOptions;
 
 /**
@@ -206,6 +296,16 @@ int InitializeSocketWrapper(SocketWrapper *sw);
 int CloseSocketWrapper(SocketWrapper *sw);
 
 
+/**
+@brief Send and receive a gather/scatter list of buffers
+
+Everything else in this file that sends or receives ends up here. These are handy
+if you need to put something on the wire that isn't exactly a Message, but want
+it to go out as one datagram without copying it all into one place first.
+*/
+int SendIOvecToSocketWrapper(SocketWrapper *sw, struct iovec *data, int nVec, MessagingOptions *options);
+int ReceiveIOvecFromSocketWrapper(SocketWrapper *sw, struct iovec *data, int nVec, MessagingOptions *options);
+
 /**
 
 */
@@ -221,15 +321,35 @@ This function works as follows:
 */
 int SendMessageToSocketWrapper(SocketWrapper *sw, Message *m);
 
+/**
+@brief Send an array of nMessages Messages to a SocketWrapper, in order
+
+Datagram and connected SOCK_SEQPACKET sockets send them in batches with a single
+system call each.
+*/
+int SendMessagesToSocketWrapper(SocketWrapper *sw, Message *m, int nMessages);
+
 /**
 @brief Receive Messages from a SocketWrapper
 
 This function works as follows:
 	1. Decide if this is a valid SocketWrapper that can be used to receive messages.
 	2. If (1), then read the contents of the socket into the message
+	3. Discard it with -1 if it isn't whole (see CheckReceivedMessage())
 */
 int ReceiveMessageFromSocketWrapper(SocketWrapper *sw, Message *m);
 
+/**
+@brief Make sure a Message that was just read into m is whole, and undo MESSAGE_FLAG_COMPRESSED
+
+bytesRead is what the read returned, and capacity is how big m->data was before it. A
+Message whose header doesn't give the number of bytes of data that actually arrived, be
+it cut short or made up, is discarded with a warning. Returns bytesRead as it would have
+been had the Message not been compressed, or -1. Only needed by anyone reading Messages
+with ReceiveIOvecFromSocketWrapper() themselves.
+*/
+int CheckReceivedMessage(Message *m, int bytesRead, int capacity);
+
 /**
 @brief Call poll() on a SocketWrapper with specified milliseconds value
 */
@@ -275,6 +395,11 @@ int PopulateSockaddr_inFromSocket(struct sockaddr_in *addr, int sock);
 */
 int PopulateSockaddr_un(struct sockaddr_un *addr, char *name);
 
+/**
+@brief How long addr is, for bind() and connect(). An abstract name is only as long as it is.
+*/
+socklen_t Sockaddr_unLength(struct sockaddr_un *addr);
+
 /**
 @brief Helper function to print the contents of a SocketWrapper
 */
@@ -0,0 +1,370 @@
+#include "StreamChannel.h"
+#include "Compression.h" // For GetCompressionScratch()
+#include <stdlib.h>
+#include <string.h>
+
+
+static StreamChannelEntry *FindStreamChannelEntry(StreamChannel *c, char *name, uint8_t id);
+static int RememberFrame(StreamChannelEntry *e, void *data, uint32_t dlen);
+static int EncodeZeroRuns(const uint8_t *current, const uint8_t *previous, int length, uint8_t *output, int capacity);
+static int DecodeZeroRuns(const uint8_t *input, int inputLength, const uint8_t *previous, uint8_t *output, int length);
+static uint8_t *WriteVarint(uint8_t *op, uint8_t *oend, uint32_t value);
+static const uint8_t *ReadVarint(const uint8_t *ip, const uint8_t *iend, uint32_t *value);
+static uint64_t Load64(const uint8_t *p);
+
+
+int InitializeStreamChannel(StreamChannel *c, int keyframeInterval)
+{
+	c->keyframeInterval = keyframeInterval > 0 ? keyframeInterval : STREAM_CHANNEL_DEFAULT_KEYFRAME_INTERVAL;
+	c->nEntries 		= 0;
+	c->entries 			= NULL;
+	c->buffer 			= NULL;
+	c->bufferLength 	= 0;
+
+	return 0;
+}
+
+int CloseStreamChannel(StreamChannel *c)
+{
+	for(int i = 0; i < c->nEntries; i++)
+		free(c->entries[i].previous);
+
+	free(c->entries);
+	free(c->buffer);
+	c->entries 		= NULL;
+	c->buffer 		= NULL;
+	c->nEntries 	= 0;
+	c->bufferLength = 0;
+
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+
+/**
+@brief Encode a frame and send it
+
+The outgoing data field is laid out as a uint32_t sequence number followed by either
+the frame itself (keyframe) or the zero-run encoding of the frame XOR'd with the
+previous one (delta). We only send a delta if it comes out smaller than the frame.
+*/
+int SendStreamMessage(Supersocket *s, int target, StreamChannel *c, Message *m)
+{
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+
+	StreamChannelEntry *e = NULL;
+	if (target < 0 || target >= table->nSockets)
+		DisplayError("SendStreamMessage: Target number exceeds number of sockets!");
+	else
+		e = FindStreamChannelEntry(c, table->socketWrapper[target].name, m->id);
+
+	ReleaseSupersocketTable(s, epoch);
+	if(e == NULL)
+		return -1;
+
+	int needed = STREAM_CHANNEL_HEADER_LENGTH + m->dlen;
+	if(needed > c->bufferLength)
+	{
+		void *buffer = realloc(c->buffer, needed);
+		if(buffer == NULL)
+		{
+			DisplayError("SendStreamMessage: Unable to allocate %d bytes", needed);
+			return -1;
+		}
+		c->buffer 		= buffer;
+		c->bufferLength = needed;
+	}
+
+	int keyframe = (e->valid == 0) || (e->dlen != m->dlen) || (e->sequence % c->keyframeInterval == 0);
+	e->sequence++;
+
+	uint8_t *payload = (uint8_t *) c->buffer + STREAM_CHANNEL_HEADER_LENGTH;
+	memcpy(c->buffer, &e->sequence, sizeof(e->sequence));
+
+	int dlen = -1;
+	if(keyframe == 0)
+		dlen = EncodeZeroRuns(m->data, e->previous, m->dlen, payload, (int) m->dlen - 1);
+
+	if(dlen < 0)
+	{
+		keyframe = 1;
+		dlen = m->dlen;
+		memcpy(payload, m->data, dlen);
+	}
+
+	if(RememberFrame(e, m->data, m->dlen) < 0)
+		return -1;
+
+	Message encoded = *m;
+	encoded.flags 	|= keyframe ? MESSAGE_FLAG_STREAM_KEYFRAME : MESSAGE_FLAG_STREAM_DELTA;
+	encoded.dlen 	= STREAM_CHANNEL_HEADER_LENGTH + dlen;
+	encoded.data 	= c->buffer;
+
+	return SendMessage(s, target, &encoded);
+}
+
+int ReceiveStreamMessage(Supersocket *s, StreamChannel *c, Message *m)
+{
+	int capacity = m->dlen;
+
+	while (1)
+	{
+		m->dlen = capacity;
+		int bytesRead = ReceiveMessage(s, m);
+		if(bytesRead < 0)
+			return bytesRead;
+
+		// Decoding overwrites the sequence number, so hold on to it for the warning
+		uint32_t sequence = 0;
+		if(m->dlen >= STREAM_CHANNEL_HEADER_LENGTH)
+			memcpy(&sequence, m->data, sizeof(sequence));
+
+		int dlen = DecodeStreamMessage(c, m, capacity);
+		if(dlen >= 0)
+			return (int) MESSAGE_HEADER_LENGTH + dlen;
+
+		Display("[%s] Dropping stream frame %u from %s, waiting for a keyframe", s->name, sequence, m->from);
+	}
+}
+
+int DecodeStreamMessage(StreamChannel *c, Message *m, int capacity)
+{
+	int isKeyframe 	= (m->flags & MESSAGE_FLAG_STREAM_KEYFRAME) != 0;
+	int isDelta 	= (m->flags & MESSAGE_FLAG_STREAM_DELTA) != 0;
+
+	if(isKeyframe == 0 && isDelta == 0)
+		return m->dlen;
+
+	if(m->dlen < STREAM_CHANNEL_HEADER_LENGTH || m->dlen > capacity)
+		return -1;
+
+	StreamChannelEntry *e = FindStreamChannelEntry(c, m->from, m->id);
+	if(e == NULL)
+		return -1;
+
+	uint32_t sequence;
+	memcpy(&sequence, m->data, sizeof(sequence));
+
+	uint8_t *payload 	= (uint8_t *) m->data + STREAM_CHANNEL_HEADER_LENGTH;
+	int payloadLength 	= m->dlen - STREAM_CHANNEL_HEADER_LENGTH;
+
+	if(isKeyframe)
+	{
+		memmove(m->data, payload, payloadLength);
+		if(RememberFrame(e, m->data, payloadLength) < 0)
+			return -1;
+	}
+	else
+	{
+		// A delta is only good if we decoded the frame right before it
+		if(e->valid == 0 || sequence != e->sequence + 1 || e->dlen > capacity)
+		{
+			e->valid = 0;
+			return -1;
+		}
+
+		void *scratch = GetCompressionScratch(payloadLength);
+		if(scratch == NULL)
+			return -1;
+		memcpy(scratch, payload, payloadLength);
+
+		if(DecodeZeroRuns(scratch, payloadLength, e->previous, m->data, e->dlen) < 0)
+		{
+			e->valid = 0;
+			return -1;
+		}
+		memcpy(e->previous, m->data, e->dlen);
+	}
+
+	e->sequence = sequence;
+	m->dlen 	= e->dlen;
+	m->flags 	&= ~(MESSAGE_FLAG_STREAM_KEYFRAME | MESSAGE_FLAG_STREAM_DELTA);
+
+	return m->dlen;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+
+/**
+Find the entry for (name, id), adding a new one if we haven't seen this stream before.
+There are usually only a handful of streams per channel, so a linear scan is fine.
+*/
+static StreamChannelEntry *FindStreamChannelEntry(StreamChannel *c, char *name, uint8_t id)
+{
+	for(int i = 0; i < c->nEntries; i++)
+		if(c->entries[i].id == id && strcmp(c->entries[i].name, name) == 0)
+			return &c->entries[i];
+
+	// We don't use ManageHeapMemory() here, since under MATLAB it hands out mxCalloc()
+	// memory and CloseStreamChannel() needs to be able to free() it.
+	int n = c->nEntries;
+	StreamChannelEntry *entries = realloc(c->entries, (n + 1) * sizeof(StreamChannelEntry));
+	if(entries == NULL)
+	{
+		DisplayError("Unable to allocate StreamChannel entry for %s", name);
+		return NULL;
+	}
+	c->entries = entries;
+
+	StreamChannelEntry *e = &c->entries[n];
+	memset(e, 0, sizeof(StreamChannelEntry));
+	strncpy(e->name, name, PROCESS_MAX_CHARS - 1);
+	e->id = id;
+
+	c->nEntries++;
+	return e;
+}
+
+static int RememberFrame(StreamChannelEntry *e, void *data, uint32_t dlen)
+{
+	if(dlen != e->dlen || e->previous == NULL)
+	{
+		void *previous = realloc(e->previous, dlen > 0 ? dlen : 1);
+		if(previous == NULL)
+		{
+			e->valid = 0;
+			return -1;
+		}
+		e->previous = previous;
+		e->dlen 	= dlen;
+	}
+	memcpy(e->previous, data, dlen);
+	e->valid = 1;
+
+	return 0;
+}
+
+/**
+@brief Write out current XOR previous as (zero run, literal run) pairs
+
+Each pair is a varint count of bytes that didn't change, a varint count of bytes
+that did, and then those changed bytes XOR'd with the previous frame. Unchanged
+stretches are skipped eight bytes at a time, which is where nearly all of the
+time goes for telemetry that barely moves.
+
+Returns the encoded length, or -1 if it doesn't fit in capacity.
+*/
+static int EncodeZeroRuns(const uint8_t *current, const uint8_t *previous, int length, uint8_t *output, int capacity)
+{
+	uint8_t *op 	= output;
+	uint8_t *oend 	= output + capacity;
+	int i 			= 0;
+
+	if(capacity < 0)
+		return -1;
+
+	while(i < length)
+	{
+		int zeroStart = i;
+		while(i + 8 <= length && Load64(current + i) == Load64(previous + i))
+			i += 8;
+		while(i < length && current[i] == previous[i])
+			i++;
+		int zeroRun = i - zeroStart;
+
+		// The literal run ends where the next worthwhile run of unchanged bytes begins
+		int literalStart = i;
+		int equal 		 = 0;
+		while(i < length)
+		{
+			if(current[i] == previous[i])
+			{
+				if(++equal >= STREAM_CHANNEL_MIN_ZERO_RUN)
+					break;
+			}
+			else
+				equal = 0;
+			i++;
+		}
+		int literalEnd 	= (i < length) ? i - (equal - 1) : i - equal;
+		int literalRun 	= literalEnd - literalStart;
+		i 				= literalEnd;
+
+		op = WriteVarint(op, oend, zeroRun);
+		op = WriteVarint(op, oend, literalRun);
+		if(op == NULL || literalRun > oend - op)
+			return -1;
+
+		for(int k = 0; k < literalRun; k++)
+			*op++ = current[literalStart + k] ^ previous[literalStart + k];
+	}
+
+	return (int) (op - output);
+}
+
+static int DecodeZeroRuns(const uint8_t *input, int inputLength, const uint8_t *previous, uint8_t *output, int length)
+{
+	const uint8_t *ip 	= input;
+	const uint8_t *iend = input + inputLength;
+	int i 				= 0;
+
+	while(ip < iend)
+	{
+		uint32_t zeroRun, literalRun;
+		ip = ReadVarint(ip, iend, &zeroRun);
+		if(ip == NULL)
+			return -1;
+		ip = ReadVarint(ip, iend, &literalRun);
+		if(ip == NULL)
+			return -1;
+
+		if(zeroRun > length - i || literalRun > length - i - zeroRun || literalRun > iend - ip)
+			return -1;
+
+		memcpy(output + i, previous + i, zeroRun);
+		i += zeroRun;
+
+		for(uint32_t k = 0; k < literalRun; k++, i++)
+			output[i] = previous[i] ^ *ip++;
+	}
+
+	return i == length ? length : -1;
+}
+
+static uint8_t *WriteVarint(uint8_t *op, uint8_t *oend, uint32_t value)
+{
+	if(op == NULL)
+		return NULL;
+
+	do
+	{
+		if(op >= oend)
+			return NULL;
+		uint8_t byte = value & 0x7F;
+		value >>= 7;
+		*op++ = byte | (value ? 0x80 : 0);
+	} while(value);
+
+	return op;
+}
+
+static const uint8_t *ReadVarint(const uint8_t *ip, const uint8_t *iend, uint32_t *value)
+{
+	*value = 0;
+	for(int shift = 0; shift < 35; shift += 7)
+	{
+		if(ip >= iend)
+			return NULL;
+		uint8_t byte = *ip++;
+		*value |= (uint32_t) (byte & 0x7F) << shift;
+		if((byte & 0x80) == 0)
+			return ip;
+	}
+	return NULL;
+}
+
+static uint64_t Load64(const uint8_t *p)
+{
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
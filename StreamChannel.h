@@ -0,0 +1,122 @@
+/**
+@file
+@brief Delta-encoded streams of fixed-layout Messages
+
+A lot of the traffic that goes through Supersocket is telemetry: the same struct
+sent thousands of times per second, where most of the fields barely change from
+one frame to the next. A StreamChannel takes advantage of that. Each Message sent
+through the channel is XOR'd against the previous frame that went to the same
+(target, id), and the result, which is mostly zeros, is run-length encoded.
+
+@code
+	StreamChannel c = {0};
+	InitializeStreamChannel(&c, STREAM_CHANNEL_DEFAULT_KEYFRAME_INTERVAL);
+
+	Message m = CreateMessage("Alice", 7, &telemetry, sizeof(telemetry));
+	SendStreamMessage(&alice, aliceToBob, &c, &m);
+@endcode
+
+And on the other side, Bob keeps his own StreamChannel to remember what he last got:
+
+@code
+	StreamChannel c = {0};
+	InitializeStreamChannel(&c, 0);
+
+	Message r = CreateMessageBuffer(sizeof(telemetry) + STREAM_CHANNEL_HEADER_LENGTH);
+	ReceiveStreamMessage(&bob, &c, &r);
+@endcode
+
+Every frame carries a sequence number. If a receiver misses a frame it can't
+decode the deltas that follow, so it drops them until the next keyframe, which
+is a frame sent whole. Keyframes go out every keyframeInterval frames, whenever
+the size of the frame changes, and whenever the delta wouldn't be any smaller.
+
+Messages that didn't come through a StreamChannel are handed back untouched by
+ReceiveStreamMessage(), so a single Supersocket can mix both kinds of traffic.
+
+@authors David Brandman and Benjamin Shanahan
+*/
+
+#pragma once
+
+#include "Supersocket.h"
+
+/** A keyframe goes out at least this often, in frames */
+#define STREAM_CHANNEL_DEFAULT_KEYFRAME_INTERVAL 100
+
+/** Runs of identical bytes shorter than this are cheaper to send as literals */
+#define STREAM_CHANNEL_MIN_ZERO_RUN 4
+
+/** Every encoded frame starts with a uint32_t sequence number */
+#define STREAM_CHANNEL_HEADER_LENGTH sizeof(uint32_t)
+
+/**
+@brief What a StreamChannel remembers about one stream
+
+On the sending side the name is the name of the target SocketWrapper; on the receiving
+side it is the .from field of the incoming Message. Together with the id, this is what
+tells one stream apart from another.
+*/
+typedef struct
+{
+	char 		name[PROCESS_MAX_CHARS];
+	uint8_t 	id;
+	uint32_t 	sequence;
+	int 		valid; // Whether previous holds a frame we can decode against
+	uint32_t 	dlen;
+	void 		*previous;
+
+} StreamChannelEntry;
+
+/**
+@brief Definition of the StreamChannel structure
+
+The keyframeInterval only matters when sending. The buffer is where outgoing
+frames are encoded, and grows as needed.
+*/
+typedef struct
+{
+	int keyframeInterval;
+
+	int nEntries;
+	StreamChannelEntry *entries;
+
+	void *buffer;
+	int bufferLength;
+
+} StreamChannel;
+
+/**
+@brief Get a StreamChannel ready. A keyframeInterval of 0 or less uses the default.
+*/
+int InitializeStreamChannel(StreamChannel *c, int keyframeInterval);
+
+/**
+@brief Free all of the frames a StreamChannel is holding on to
+*/
+int CloseStreamChannel(StreamChannel *c);
+
+/**
+@brief Delta-encode a Message against the last one sent to (target, m->id) and send it
+*/
+int SendStreamMessage(Supersocket *s, int target, StreamChannel *c, Message *m);
+
+/**
+@brief Receive the next Message, decoding it if it came from a StreamChannel
+
+Frames that can't be decoded because an earlier one went missing are dropped,
+and the function keeps waiting. Returns the same value as ReceiveMessage().
+
+Keyframes arrive with their sequence number in front of them, so the buffer in m
+needs to be STREAM_CHANNEL_HEADER_LENGTH bytes larger than the largest frame.
+*/
+int ReceiveStreamMessage(Supersocket *s, StreamChannel *c, Message *m);
+
+/**
+@brief Decode a Message that was already received with ReceiveMessage()
+
+m->data is rewritten in place and capacity is the size of that buffer. Returns
+the decoded length, or -1 if the frame can't be decoded and should be dropped.
+Messages that aren't stream frames are left alone and their length returned.
+*/
+int DecodeStreamMessage(StreamChannel *c, Message *m, int capacity);
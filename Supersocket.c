@@ -1,7 +1,10 @@
+#define _GNU_SOURCE // For clock_gettime() under -std=c11
 #include "Supersocket.h"
 #include "ManageHeapMemory.h"
 #include "SupersocketListener.h"
+#include "Compression.h"
 #include <unistd.h> // For close
+#include <time.h>
 
 #include <errno.h>
 
@@ -11,9 +14,53 @@ Add code to ensure name is not too long
 I like the bitmask idea, it makes it much easier to wrok with.
 */
 
+/** A table that has been swapped out, along with the socket it was the last to use, if any */
+struct RetiredSupersocketTable
+{
+	SupersocketTable *table;
+	int socket;
+	unsigned int epoch;
+	struct RetiredSupersocketTable *next;
+};
+
+/** What readers get before anything has been added */
+static SupersocketTable emptyTable = {0};
+
+/** How InitializeSupersocket() makes the AF_UNIX socket. See SetSupersocketLocalTransport(). */
+static int localType 	= SOCK_DGRAM;
+static int localFlags 	= 0;
+
+/** How many sockets a ShardedReceiver shares the AF_INET port between. See SetSupersocketReceiveShards(). */
+static int receiveShards 	= 1;
+static int steerBySender 	= 0;
 
+/** What receiving from a local SOCK_SEQPACKET connection that has just opened or closed gives */
+#define CONNECTION_CHANGED -2
 
-static void swap(int *a, int *b);
+static uint32_t HashName(char *name);
+static int IndexName(Supersocket *s, SupersocketTable *table, int n);
+static int GrowNameIndex(Supersocket *s, SupersocketTable *table);
+static void InsertName(SupersocketTable *table, int n);
+static void RemoveFromList(int *list, int *n, int target, struct pollfd *pollList);
+static int RemoveSocketWrapperLocked(Supersocket *s, int target);
+static SupersocketTable *CopySupersocketTable(Supersocket *s, int room);
+static void *CopyArray(void *from, int nItems, int room, int itemSize);
+static int InsertSocketWrapper(Supersocket *s, SupersocketTable *table, SocketWrapper *sw);
+static void FreeSupersocketTable(SupersocketTable *table);
+static void PublishSupersocketTable(Supersocket *s, SupersocketTable *table, int socket);
+static void ReclaimSupersocketTables(Supersocket *s);
+static SocketWrapper *FindReadySocketWrapper(Supersocket *s, SupersocketTable *table);
+static int ReceiveFromSocketWrapper(Supersocket *s, SocketWrapper *sw, int receiveMessageFlag, Message *m, struct iovec *data, int nVec, MessagingOptions *options);
+static int IsConnectionListener(SocketWrapper *sw);
+static int AcceptConnection(Supersocket *s, SocketWrapper *listener);
+static int IsAcceptedConnection(SocketWrapper *sw);
+static int ReuseClosedConnection(Supersocket *s, SupersocketTable *table, SocketWrapper *connection);
+static int DropConnection(Supersocket *s, int socket);
+static int PollAndReceiveSupersocket(Supersocket *s, int milliseconds, int receiveMessageFlag, Message *m, struct iovec *data, int nVec, MessagingOptions *options);
+static int SendMessageBatchToSocketWrapper(Supersocket *s, SocketWrapper *sw, Message *m, int nMessages);
+static double NowMilliseconds(void);
+static int CompressMessage(Message *m, Message *compressed);
+static int ShouldCompress(Supersocket *s, SocketWrapper *sw, Message *m);
 
 
 /**
@@ -25,6 +72,19 @@ int InitializeSupersocket(Supersocket *s, char *name, char *ip, int port)
 	s->nSockets 			= 0;
 	s->nBoundSockets 		= 0;
 	s->nConnectedSockets 	= 0;
+	s->compressionThreshold = 0;
+	s->listener 			= NULL;
+	s->nameIndex 			= NULL;
+	s->nameIndexSize 		= 0;
+	s->lastHeard 			= NULL;
+	s->heartbeatPeriod 		= NULL;
+	s->watchingHeartbeats 	= 0;
+	s->table 				= NULL;
+	s->epoch 				= 0;
+	s->readers[0] 			= 0;
+	s->readers[1] 			= 0;
+	s->retired 				= NULL;
+	s->nextReady 			= 0;
 
 	if(pthread_mutex_init(&s->lock, NULL) < 0)
 	{
@@ -32,30 +92,121 @@ int InitializeSupersocket(Supersocket *s, char *name, char *ip, int port)
 		return -1;
 	}
 
-	if(AddSocket(s, name, ip, port, AF_INET, SOCK_DGRAM, BIND) < 0)
+	// The AF_INET socket is what discovery hands out, so it says how the AF_UNIX one is made
+	SocketWrapper sw = {0};
+	PopulateSocketWrapper(&sw, name, ip, port, AF_INET, SOCK_DGRAM, receiveShards > 1 ? BIND | REUSEPORT : BIND);
+	if(ParseFlags(localFlags, ABSTRACT))
+		sw.capabilities |= SOCKETWRAPPER_CAPABILITY_ABSTRACT_UNIX;
+	if(localType == SOCK_SEQPACKET)
+		sw.capabilities |= SOCKETWRAPPER_CAPABILITY_SEQPACKET;
+
+	if(AddSocketWrapper(s, &sw) < 0)
 	{
 		DisplayError("Could not initialize AF_INET SOCK_DGRAM: %s", strerror(errno));
-		return -1;		
+		return -1;
+	}
+	if(AddSocket(s, name, ip, port, AF_UNIX, localType, BIND | localFlags | (localType == SOCK_SEQPACKET ? LISTEN : 0)) < 0)
+	{
+		DisplayError("Could not initialize the AF_UNIX socket: %s", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+int SetSupersocketLocalTransport(int type, int flags)
+{
+	if((type != SOCK_DGRAM && type != SOCK_SEQPACKET) || (flags & ~ABSTRACT) != 0)
+	{
+		DisplayError("The local transport has to be SOCK_DGRAM or SOCK_SEQPACKET, with flags 0 or ABSTRACT");
+		return -1;
 	}
-	if(AddSocket(s, name, ip, port, AF_UNIX, SOCK_DGRAM, BIND) < 0)
+
+	localType 	= type;
+	localFlags 	= flags;
+	return 0;
+}
+
+int SetSupersocketReceiveShards(int nShards, int steer)
+{
+	if(nShards < 1 || nShards > SUPERSOCKET_MAX_SHARDS)
 	{
-		DisplayError("Could not initialize AF_UNIX SOCK_DGRAM: %s", strerror(errno));
-		return -1;		
+		DisplayError("The number of receive shards has to be between 1 and %d, not %d", SUPERSOCKET_MAX_SHARDS, nShards);
+		return -1;
 	}
 
+	receiveShards 	= nShards;
+	steerBySender 	= steer != 0;
 	return 0;
 }
 
+int GetSupersocketReceiveShards(int *steer)
+{
+	if(steer != NULL)
+		*steer = steerBySender;
+	return receiveShards;
+}
+
 int CloseSupersocket(Supersocket *s)
 {
+	// Let anyone who has us as a contact know straight away, rather than
+	// leaving them to notice the heartbeats have stopped
+	if(s->listener != NULL)
+	{
+		AnnounceSupersocketClose(s);
+		StopSupersocketListener(s);
+	}
+
 	pthread_mutex_lock(&s->lock);
 	for (int i = 0; i < s->nSockets; i++)
-		close(s->socketWrapper[i].socket);
+		if(s->socketWrapper[i].socket >= 0)
+			close(s->socketWrapper[i].socket);
 
+	ReclaimSupersocketTables(s);
 	pthread_mutex_unlock(&s->lock);
 
+	// A listener callback closing s leaves it to the listener thread, which may
+	// still look at s before its round is over
+	if(ReleaseSupersocketListener(s) == 0)
+		FreeSupersocketTables(s);
+
 	return 0;
 }
+/**
+Nobody can be reading s any more, so the retired tables go whatever their epoch.
+*/
+void FreeSupersocketTables(Supersocket *s)
+{
+	pthread_mutex_lock(&s->lock);
+	while(s->retired != NULL)
+	{
+		struct RetiredSupersocketTable *retired = s->retired;
+		s->retired = retired->next;
+
+		if(retired->socket >= 0)
+			close(retired->socket);
+		FreeSupersocketTable(retired->table);
+		free(retired);
+	}
+
+	FreeSupersocketTable(s->table);
+	free(s->lastHeard);
+	free(s->heartbeatPeriod);
+
+	s->table 				= NULL;
+	s->socketWrapper 		= NULL;
+	s->boundSocketsList 	= NULL;
+	s->boundSocketsStruct 	= NULL;
+	s->connectedSocketsList = NULL;
+	s->nameIndex 			= NULL;
+	s->nameIndexSize 		= 0;
+	s->lastHeard 			= NULL;
+	s->heartbeatPeriod 		= NULL;
+	s->nSockets 			= 0;
+	s->nBoundSockets 		= 0;
+	s->nConnectedSockets 	= 0;
+	pthread_mutex_unlock(&s->lock);
+}
 
 /////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////
@@ -76,43 +227,294 @@ int AddSocket(Supersocket *s, char *name, char *ip, int port, int domain, int ty
 int AddSocketWrapper(Supersocket *s, SocketWrapper *sw)
 {
 	pthread_mutex_lock(&s->lock);
-	// We are going to be adding the entry at address n in the master socket list.
-	int n = s->nSockets;
 	if (InitializeSocketWrapper(sw) < 0)
 	{
 		DisplayError("[%s] Could not initialize %s", s->name, sw->name);
+		pthread_mutex_unlock(&s->lock);
 		return -1;
 	}
-	else
+
+	// Anyone sending right now carries on with the table they have. They'll
+	// see the new socket the next time around.
+	SupersocketTable *table = CopySupersocketTable(s, 1);
+	if(table == NULL)
 	{
-		if(ParseFlags(sw->flags, BIND))
+		close(sw->socket);
+		pthread_mutex_unlock(&s->lock);
+		return -1;
+	}
+
+	int n = InsertSocketWrapper(s, table, sw);
+
+	PublishSupersocketTable(s, table, -1);
+	pthread_mutex_unlock(&s->lock);
+	return n;	
+}
+
+/**
+All of them go in the one copy of the table, so however many there are, senders only
+ever see one change and there's only one copy to make.
+*/
+int AddSocketWrappers(Supersocket *s, SocketWrapper *sw, int n, int *indices)
+{
+	pthread_mutex_lock(&s->lock);
+	SupersocketTable *table = CopySupersocketTable(s, n);
+	if(table == NULL)
+	{
+		pthread_mutex_unlock(&s->lock);
+		return -1;
+	}
+
+	int nAdded = 0;
+	for(int i = 0; i < n; i++)
+	{
+		indices[i] = -1;
+		if (InitializeSocketWrapper(&sw[i]) < 0)
 		{
-			int m = s->nBoundSockets;
-			s->boundSocketsList         	= ManageHeapMemory(s->boundSocketsList, m, sizeof(int));
-			s->boundSocketsList[m] 			= n;		
-			
-			s->boundSocketsStruct         	= ManageHeapMemory(s->boundSocketsStruct, m, sizeof(struct pollfd));
-			s->boundSocketsStruct[m].fd 	= sw->socket;
-			s->boundSocketsStruct[m].events = POLLIN;
-
-			s->nBoundSockets++;
+			DisplayError("[%s] Could not initialize %s", s->name, sw[i].name);
+			continue;
 		}
-		if(ParseFlags(sw->flags, CONNECT))
+
+		indices[i] = InsertSocketWrapper(s, table, &sw[i]);
+		if(indices[i] >= 0)
+			nAdded++;
+	}
+
+	PublishSupersocketTable(s, table, -1);
+	pthread_mutex_unlock(&s->lock);
+	return nAdded;
+}
+
+/** Put sw, already initialized, at the end of table. Must be called with the lock held. */
+static int InsertSocketWrapper(Supersocket *s, SupersocketTable *table, SocketWrapper *sw)
+{
+	// We are going to be adding the entry at address n in the master socket list.
+	int n = table->nSockets;
+
+	// Not ManageHeapMemory(), which under MATLAB is mxRealloc(): these are free()d, and
+	// the BackgroundReceiver thread accepting a connection can't use the MATLAB allocator
+	double *lastHeard = realloc(s->lastHeard, (n + 1) * sizeof(double));
+	if(lastHeard != NULL)
+		s->lastHeard = lastHeard;
+	int *heartbeatPeriod = realloc(s->heartbeatPeriod, (n + 1) * sizeof(int));
+	if(heartbeatPeriod != NULL)
+		s->heartbeatPeriod = heartbeatPeriod;
+
+	if(lastHeard == NULL || heartbeatPeriod == NULL)
+	{
+		DisplayError("[%s] Unable to make room for %s: %s", s->name, sw->name, strerror(errno));
+		close(sw->socket);
+		return -1;
+	}
+	s->lastHeard[n] 		= NowMilliseconds();
+	s->heartbeatPeriod[n] 	= 0;
+
+	if(ParseFlags(sw->flags, BIND))
+	{
+		int m = table->nBoundSockets;
+		table->boundSocketsList[m] 				= n;
+		table->boundSocketsStruct[m].fd 		= sw->socket;
+		table->boundSocketsStruct[m].events 	= POLLIN;
+		table->boundSocketsStruct[m].revents 	= 0;
+		table->nBoundSockets++;
+	}
+	if(ParseFlags(sw->flags, CONNECT))
+	{
+		int m = table->nConnectedSockets;
+		table->connectedSocketsList[m] = n;
+		table->nConnectedSockets++;
+	}
+	memcpy(&table->socketWrapper[n], sw, sizeof(SocketWrapper));
+	table->nSockets++;
+	IndexName(s, table, n);
+
+	return n;
+}
+
+
+/**
+Probe from the name's home slot until an empty one. Several sockets can share a name
+(the AF_INET and AF_UNIX halves of InitializeSupersocket(), for a start), so we keep
+going and take the highest index that matches, which is the most recently added.
+*/
+int FindSocketWrapperByName(Supersocket *s, char *name, int flags, int domain)
+{
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+
+	int found = -1;
+	if(table->nameIndexSize > 0)
+	{
+		uint32_t mask = table->nameIndexSize - 1;
+		for(uint32_t slot = HashName(name) & mask; table->nameIndex[slot] >= 0; slot = (slot + 1) & mask)
 		{
-			int m = s->nConnectedSockets;
-			s->connectedSocketsList         = ManageHeapMemory(s->connectedSocketsList, m, sizeof(int));
-			s->connectedSocketsList[m] 		= n;
-			s->nConnectedSockets++;
-		}
+			int i = table->nameIndex[slot];
+			SocketWrapper *sw = &table->socketWrapper[i];
+			if(i > found 
+				&& sw->status != SOCKETWRAPPER_STATUS_CLOSED
+				&& (sw->flags & flags) == flags
+				&& (domain == 0 || sw->domain == domain) 
+				&& strcmp(sw->name, name) == 0)
+				found = i;
+		}	
 	}
-	s->socketWrapper = ManageHeapMemory(s->socketWrapper, n, sizeof(SocketWrapper));
-	memcpy(&s->socketWrapper[n], sw, sizeof(SocketWrapper)); 
+	ReleaseSupersocketTable(s, epoch);
+
+	return found;
+}
 
-	s->nSockets++;
+/**
+Readers say which half of the epoch they came in under, and only then look at the table.
+A writer that has just swapped a table out can't know whether someone got hold of the old
+one a moment before, so the old one is only freed once both halves have emptied out since.
+See ReclaimSupersocketTables().
+*/
+SupersocketTable *ReadSupersocketTable(Supersocket *s, int *epoch)
+{
+	*epoch = __atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST) & 1;
+	__atomic_add_fetch(&s->readers[*epoch], 1, __ATOMIC_SEQ_CST);
+
+	SupersocketTable *table = __atomic_load_n(&s->table, __ATOMIC_SEQ_CST);
+	return table != NULL ? table : &emptyTable;
+}
+
+void ReleaseSupersocketTable(Supersocket *s, int epoch)
+{
+	__atomic_sub_fetch(&s->readers[epoch], 1, __ATOMIC_SEQ_CST);
+}
+
+int DisableSocketWrapper(Supersocket *s, int target)
+{
+	pthread_mutex_lock(&s->lock);
+	int ok = (target >= 0 && target < s->nSockets && s->socketWrapper[target].status == SOCKETWRAPPER_STATUS_INITIALIZED);
+	if(ok)
+		s->socketWrapper[target].status = SOCKETWRAPPER_STATUS_DISABLED;
 	pthread_mutex_unlock(&s->lock);
-	return n;	
+
+	return ok ? 0 : -1;
 }
 
+int EnableSocketWrapper(Supersocket *s, int target)
+{
+	pthread_mutex_lock(&s->lock);
+	int ok = (target >= 0 && target < s->nSockets && s->socketWrapper[target].status == SOCKETWRAPPER_STATUS_DISABLED);
+	if(ok)
+		s->socketWrapper[target].status = SOCKETWRAPPER_STATUS_INITIALIZED;
+	pthread_mutex_unlock(&s->lock);
+
+	return ok ? 0 : -1;
+}
+
+int RemoveSocketWrapper(Supersocket *s, int target)
+{
+	pthread_mutex_lock(&s->lock);
+	int ok = (target >= 0 && target < s->nSockets && s->socketWrapper[target].status != SOCKETWRAPPER_STATUS_CLOSED);
+	if(ok)
+		ok = (RemoveSocketWrapperLocked(s, target) == 0);
+	pthread_mutex_unlock(&s->lock);
+
+	return ok ? 0 : -1;
+}
+
+int ReplaceSocketWrapper(Supersocket *s, int target, SocketWrapper *sw)
+{
+	if(InitializeSocketWrapper(sw) < 0)
+	{
+		DisplayError("[%s] Could not initialize the new address for %s", s->name, sw->name);
+		return -1;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	SupersocketTable *table = NULL;
+	if(target >= 0 && target < s->nSockets)
+		table = CopySupersocketTable(s, 1);
+
+	if(table == NULL)
+	{
+		pthread_mutex_unlock(&s->lock);
+		close(sw->socket);
+		return -1;
+	}
+
+	int oldSocket = table->socketWrapper[target].socket;
+	for(int i = 0; i < table->nBoundSockets; i++)
+		if(table->boundSocketsList[i] == target)
+			table->boundSocketsStruct[i].fd = sw->socket;
+
+	table->socketWrapper[target] 	= *sw;
+	s->lastHeard[target] 			= NowMilliseconds();
+
+	// The old socket stays open for whoever is still sending on it
+	PublishSupersocketTable(s, table, oldSocket);
+	pthread_mutex_unlock(&s->lock);
+
+	Display("[%s] %s has moved, updated target %d", s->name, sw->name, target);
+	return 0;
+}
+
+int RefreshSocketWrapper(Supersocket *s, char *name, int heartbeatPeriod)
+{
+	// This is done for every Message received, so don't bother unless someone is counting
+	if(heartbeatPeriod < 0 && __atomic_load_n(&s->watchingHeartbeats, __ATOMIC_ACQUIRE) == 0)
+		return -1;
+
+	int target = FindSocketWrapperByName(s, name, CONNECT, 0);
+	if(target < 0)
+		return -1;
+
+	pthread_mutex_lock(&s->lock);
+	s->lastHeard[target] = NowMilliseconds();
+	if(heartbeatPeriod >= 0)
+		s->heartbeatPeriod[target] = heartbeatPeriod;
+	if(heartbeatPeriod > 0)
+		__atomic_store_n(&s->watchingHeartbeats, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&s->lock);
+
+	return target;
+}
+
+int CheckSocketWrapperLiveness(Supersocket *s, int *targets, int *statuses, int maxChanges)
+{
+	double now 		= NowMilliseconds();
+	int nChanges 	= 0;
+
+	pthread_mutex_lock(&s->lock);
+	// Going backwards, since closing a contact takes it out of the list
+	for(int i = s->nConnectedSockets - 1; i >= 0 && nChanges < maxChanges; i--)
+	{
+		int target 			= s->connectedSocketsList[i];
+		int period 			= s->heartbeatPeriod[target];
+		SocketWrapper *sw 	= &s->socketWrapper[target];
+		if(period <= 0)
+			continue;
+
+		double silence = now - s->lastHeard[target];
+		int status = sw->status;
+		if(silence > LIVENESS_CLOSE_PERIODS * period)
+			RemoveSocketWrapperLocked(s, target);
+		else if(silence > LIVENESS_DISABLE_PERIODS * period && sw->status == SOCKETWRAPPER_STATUS_INITIALIZED)
+			sw->status = SOCKETWRAPPER_STATUS_DISABLED;
+		else if(silence <= LIVENESS_DISABLE_PERIODS * period && sw->status == SOCKETWRAPPER_STATUS_DISABLED)
+			sw->status = SOCKETWRAPPER_STATUS_INITIALIZED;
+
+		// Removing it put a new table in place
+		sw = &s->socketWrapper[target];
+		if(sw->status != status)
+		{
+			targets[nChanges] 	= target;
+			statuses[nChanges] 	= sw->status;
+			nChanges++;
+		}	
+	}
+
+	// This runs every so often, so it's a good time to close and free whatever
+	// was left over from the last change once its readers are done with it
+	if(s->retired != NULL)
+		ReclaimSupersocketTables(s);
+	pthread_mutex_unlock(&s->lock);
+
+	return nChanges;
+}
 
 /////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////
@@ -122,101 +524,207 @@ int AddSocketWrapper(Supersocket *s, SocketWrapper *sw)
 
 int SendData(Supersocket *s, int target, void *data, int dlen, MessagingOptions *options)
 {
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+
+	int val = -1;
 	// Perform some error checking to ensure that the target is valid
-	if (target > s->nSockets)
-	{
+	if (target < 0 || target >= table->nSockets)
 		DisplayError("SendData: Target number exceeds number of sockets!");
-		return -1;
-	}
+	else // Send data only to the socketWrapper array entry that is requested
+		val = SendDataToSocketWrapper(&table->socketWrapper[target], data, dlen, options);
 
-	// Send data only to the socketWrapper array entry that is requested
-	return SendDataToSocketWrapper(&s->socketWrapper[target], data, dlen, options);
+	ReleaseSupersocketTable(s, epoch);
+	return val;
 }
 
 int SendDataToAll(Supersocket *s, void *data, int dlen, MessagingOptions *options)
 {
-	for(int i = 0; i < s->nConnectedSockets; i++)
-		SendDataToSocketWrapper(&s->socketWrapper[s->connectedSocketsList[i]], data, dlen, options);
-	
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+
+	for(int i = 0; i < table->nConnectedSockets; i++)
+	{
+		SocketWrapper *sw = &table->socketWrapper[table->connectedSocketsList[i]];
+		if(sw->status != SOCKETWRAPPER_STATUS_DISABLED)
+			SendDataToSocketWrapper(sw, data, dlen, options);
+	}
+
+	ReleaseSupersocketTable(s, epoch);
 	return 0;
 }
 
 int SendMessage(Supersocket *s, int target, Message *m)
 {
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+
+	int val = -1;
 	// Perform some error checking to ensure that the target is valid
-	if (target > s->nSockets)
-	{
+	if (target < 0 || target >= table->nSockets)
 		DisplayError("SendMessage: Target number exceeds number of sockets!");
-		return -1;
+	else
+	{
+		// Send message only to the socketWrapper array that is requested
+		SocketWrapper *sw = &table->socketWrapper[target];
+		Message compressed;
+		if(ShouldCompress(s, sw, m) && CompressMessage(m, &compressed))
+			val = SendMessageToSocketWrapper(sw, &compressed);
+		else
+			val = SendMessageToSocketWrapper(sw, m);
 	}
-	
-	// Send message only to the socketWrapper array that is requested	
-	return SendMessageToSocketWrapper(&s->socketWrapper[target], m);	
-}
 
+	ReleaseSupersocketTable(s, epoch);
+	return val;
+}
 
-int SendMessageToAll(Supersocket *s, Message *m)
+int SendMessageBatch(Supersocket *s, int target, Message *m, int nMessages)
 {
-	for(int i = 0; i < s->nConnectedSockets; i++)
-		SendMessageToSocketWrapper(&s->socketWrapper[s->connectedSocketsList[i]], m);	
-	
-	return 0;
-}
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
 
+	int val = -1;
+	if (target < 0 || target >= table->nSockets)
+		DisplayError("SendMessageBatch: Target number exceeds number of sockets!");
+	else
+		val = SendMessageBatchToSocketWrapper(s, &table->socketWrapper[target], m, nMessages);
 
-int PollSockets(Supersocket *s, int milliseconds)
-{
-	int val = poll(s->boundSocketsStruct, s->nBoundSockets, milliseconds);
-	if (val < 0)
-	{
-		DisplayError("Could not poll bound sockets: %s", strerror(errno));
-		return -1;	
-	}
+	ReleaseSupersocketTable(s, epoch);
 	return val;
 }
 
-int ReceiveSupersocket(Supersocket *s, int receiveMessageFlag, Message *m, void *data, int dlen, MessagingOptions *options)
+int SendMessageToAll(Supersocket *s, Message *m)
 {
-	int output = 0;
-	for(int i = 0; i < s->nBoundSockets; i++)
-		if(s->boundSocketsStruct[i].revents == POLLIN)
+	// We compress at most once, the first time we meet a contact that can take it,
+	// and then reuse the compressed Message for everyone else who can.
+	Message compressed;
+	int compressionState = 0; // 0: not tried, 1: compressed, -1: not worth it
+
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+
+	for(int i = 0; i < table->nConnectedSockets; i++)
+	{
+		SocketWrapper *sw = &table->socketWrapper[table->connectedSocketsList[i]];
+		if(sw->status == SOCKETWRAPPER_STATUS_DISABLED)
+			continue;
+
+		if(ShouldCompress(s, sw, m))
 		{
-			if(receiveMessageFlag == 1)
-				output = ReceiveMessageFromSocketWrapper(&s->socketWrapper[s->boundSocketsList[i]], m);
-			else
-				output = ReceiveDataFromSocketWrapper(&s->socketWrapper[s->boundSocketsList[i]], data, dlen, options);
+			if(compressionState == 0)
+				compressionState = CompressMessage(m, &compressed) ? 1 : -1;
 
-			if(output >= 0)
+			if(compressionState == 1)
 			{
-				swap(&s->boundSocketsList[i], &s->boundSocketsList[s->nBoundSockets-1]);
-				swap(&s->boundSocketsStruct[i].fd, &s->boundSocketsStruct[s->nBoundSockets-1].fd);
+				SendMessageToSocketWrapper(sw, &compressed);
+				continue;
 			}
-			return output;
 		}	
+		SendMessageToSocketWrapper(sw, m);	
+	}
 
-	return -1;
+	ReleaseSupersocketTable(s, epoch);
+	return 0;
 }
 
-int ReceiveData(Supersocket *s, void *data, int dlen, MessagingOptions *options)
+int SendDataByName(Supersocket *s, char *name, void *data, int dlen, MessagingOptions *options)
 {
-	if(PollSockets(s, -1) < 0)
+	int target = FindSocketWrapperByName(s, name, CONNECT, 0);
+	if(target < 0)
 	{
-		DisplayError("Unable to poll socket: %s",  strerror(errno));		
+		DisplayError("[%s] SendDataByName: No contact called %s", s->name, name);
 		return -1;
 	}
 
-	return ReceiveSupersocket(s, 0, NULL, data, dlen, options);
+	return SendData(s, target, data, dlen, options);
 }
 
-int ReceiveMessage(Supersocket *s, Message *m)
+int SendMessageByName(Supersocket *s, char *name, Message *m)
 {
-	if(PollSockets(s, -1) < 0)
+	int target = FindSocketWrapperByName(s, name, CONNECT, 0);
+	if(target < 0)
 	{
-		DisplayError("Unable to poll socket: %s", strerror(errno));		
+		DisplayError("[%s] SendMessageByName: No contact called %s", s->name, name);
 		return -1;
 	}
 
-	return ReceiveSupersocket(s, 1, m, NULL, 0, NULL);
+	return SendMessage(s, target, m);
+}
+
+int SetSupersocketCompression(Supersocket *s, int threshold)
+{
+	s->compressionThreshold = threshold > 0 ? threshold : 0;
+	return 0;
+}
+
+
+int PollSockets(Supersocket *s, int milliseconds)
+{
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+
+	int val = poll(table->boundSocketsStruct, table->nBoundSockets, milliseconds);
+	if (val < 0)
+		DisplayError("Could not poll bound sockets: %s", strerror(errno));
+
+	ReleaseSupersocketTable(s, epoch);
+	return val < 0 ? -1 : val;
+}
+
+SocketWrapper *GetReadySocketWrapper(Supersocket *s)
+{
+	return FindReadySocketWrapper(s, s->table != NULL ? s->table : &emptyTable);
+}
+
+int ReceiveSupersocket(Supersocket *s, int receiveMessageFlag, Message *m, void *data, int dlen, MessagingOptions *options)
+{
+	struct iovec contents = {.iov_base = data, .iov_len = dlen};
+
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+
+	int val = ReceiveFromSocketWrapper(s, FindReadySocketWrapper(s, table), receiveMessageFlag, m, &contents, 1, options);
+
+	ReleaseSupersocketTable(s, epoch);
+	return val == CONNECTION_CHANGED ? 0 : val;
+}
+
+int ReceiveIOvecSupersocket(Supersocket *s, struct iovec *data, int nVec, MessagingOptions *options)
+{
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+
+	int val = ReceiveFromSocketWrapper(s, FindReadySocketWrapper(s, table), 0, NULL, data, nVec, options);
+
+	ReleaseSupersocketTable(s, epoch);
+	return val == CONNECTION_CHANGED ? 0 : val;
+}
+
+int ReceiveIOvecSupersocketTimeout(Supersocket *s, struct iovec *data, int nVec, int milliseconds, MessagingOptions *options)
+{
+	return PollAndReceiveSupersocket(s, milliseconds, 0, NULL, data, nVec, options);
+}
+
+int ReceiveData(Supersocket *s, void *data, int dlen, MessagingOptions *options)
+{
+	struct iovec contents = {.iov_base = data, .iov_len = dlen};
+	return PollAndReceiveSupersocket(s, -1, 0, NULL, &contents, 1, options);
+}
+
+int ReceiveMessage(Supersocket *s, Message *m)
+{
+	return PollAndReceiveSupersocket(s, -1, 1, m, NULL, 0, NULL);
+}
+
+int ReceiveDataTimeout(Supersocket *s, void *data, int dlen, int milliseconds, MessagingOptions *options)
+{
+	struct iovec contents = {.iov_base = data, .iov_len = dlen};
+	return PollAndReceiveSupersocket(s, milliseconds, 0, NULL, &contents, 1, options);
+}
+
+int ReceiveMessageTimeout(Supersocket *s, Message *m, int milliseconds)
+{
+	return PollAndReceiveSupersocket(s, milliseconds, 1, m, NULL, 0, NULL);
 }
 
 // int ReceiveMessage(Supersocket *s, Message *m)
@@ -253,7 +761,7 @@ void VerboseSupersocket(Supersocket *s)
 	SetShowTrace(DISABLE);
 	for(int i = 0; i < s->nSockets; i++)
 		Display("%d ", s->socketWrapper[i].socket);
-	Display("\n");
+	Display("\n");	
 	SetShowTrace(ENABLE);
 
 	Display("Bound Socket Indexes: ");
@@ -272,11 +780,480 @@ void VerboseSupersocket(Supersocket *s)
 	SetShowTrace(ENABLE);
 }
 
-static void swap(int *a, int *b)
+static int ShouldCompress(Supersocket *s, SocketWrapper *sw, Message *m)
+{
+	return s->compressionThreshold > 0 
+		&& m->dlen >= s->compressionThreshold 
+		&& (sw->capabilities & SOCKETWRAPPER_CAPABILITY_COMPRESSION);
+}
+
+/**
+Compress m into the thread's scratch buffer. Returns 1 if compressed now describes
+a smaller Message, and 0 if the data didn't compress (in which case send m as is).
+*/
+static int CompressMessage(Message *m, Message *compressed)
+{
+	void *scratch = GetCompressionScratch(m->dlen);
+	if(scratch == NULL)
+		return 0;
+
+	// Asking for one byte less than the original means we only get a result if it helps
+	int dlen = CompressBuffer(m->data, m->dlen, scratch, m->dlen - 1);
+	if(dlen < 0)
+		return 0;
+
+	*compressed 		= *m;
+	compressed->flags 	|= MESSAGE_FLAG_COMPRESSED;
+	compressed->dlen 	= dlen;
+	compressed->data 	= scratch;
+	return 1;
+}
+
+/** FNV-1a */
+static uint32_t HashName(char *name)
+{
+	uint32_t hash = 2166136261u;
+	for(int i = 0; i < PROCESS_MAX_CHARS && name[i] != '\0'; i++)
+		hash = (hash ^ (uint8_t) name[i]) * 16777619u;
+	return hash;
+}
+
+/**
+Put socketWrapper[n] in the table's name index, doubling it whenever it gets half full.
+The table mustn't have been published yet.
+*/
+static int IndexName(Supersocket *s, SupersocketTable *table, int n)
+{
+	// Growing puts every socket back in, n included
+	if(2 * table->nSockets > table->nameIndexSize && GrowNameIndex(s, table) == 0)
+		return 0;
+
+	// If it couldn't grow, carry on for as long as there's an empty slot left
+	if(table->nameIndexSize <= n)
+		return -1;
+
+	InsertName(table, n);
+	return 0;
+}
+
+static int GrowNameIndex(Supersocket *s, SupersocketTable *table)
+{
+	int size = table->nameIndexSize > 0 ? 2 * table->nameIndexSize : 16;
+	int *nameIndex = malloc(size * sizeof(int));
+	if(nameIndex == NULL)
+	{
+		DisplayError("[%s] Unable to grow the name index to %d entries", s->name, size);
+		return -1;
+	}
+
+	free(table->nameIndex);
+	table->nameIndex 		= nameIndex;
+	table->nameIndexSize 	= size;
+	memset(table->nameIndex, -1, size * sizeof(int));
+
+	for(int i = 0; i < table->nSockets; i++)
+		InsertName(table, i);
+
+	return 0;
+}
+
+static void InsertName(SupersocketTable *table, int n)
+{
+	uint32_t mask = table->nameIndexSize - 1;
+	uint32_t slot = HashName(table->socketWrapper[n].name) & mask;
+	while(table->nameIndex[slot] >= 0)
+		slot = (slot + 1) & mask;
+
+	table->nameIndex[slot] = n;
+}
+
+/** Take target out of list, and the matching entry out of pollList if there is one */
+static void RemoveFromList(int *list, int *n, int target, struct pollfd *pollList)
+{
+	for(int i = 0; i < *n; i++)
+	{
+		if(list[i] != target)
+			continue;
+
+		memmove(&list[i], &list[i + 1], (*n - i - 1) * sizeof(int));
+		if(pollList != NULL)
+			memmove(&pollList[i], &pollList[i + 1], (*n - i - 1) * sizeof(struct pollfd));
+		(*n)--;
+		return;
+	}
+}
+
+/** Must be called with the lock held */
+static int RemoveSocketWrapperLocked(Supersocket *s, int target)
+{
+	SupersocketTable *table = CopySupersocketTable(s, 1);
+	if(table == NULL)
+		return -1;
+
+	SocketWrapper *sw = &table->socketWrapper[target];
+	Display("[%s] Removing %s", s->name, sw->name);
+
+	RemoveFromList(table->connectedSocketsList, &table->nConnectedSockets, target, NULL);
+	RemoveFromList(table->boundSocketsList, &table->nBoundSockets, target, table->boundSocketsStruct);
+
+	int socket = sw->socket;
+	sw->socket = -1;
+	sw->status = SOCKETWRAPPER_STATUS_CLOSED;
+
+	PublishSupersocketTable(s, table, socket);
+	return 0;
+}
+
+/**
+Copy the current table, with room for that many more sockets in every array. Must be
+called with the lock held. Nothing is shared with the original, so the copy can be
+changed as much as we like until it is published.
+*/
+static SupersocketTable *CopySupersocketTable(Supersocket *s, int room)
+{
+	SupersocketTable *old 	= s->table != NULL ? s->table : &emptyTable;
+	SupersocketTable *table = malloc(sizeof(SupersocketTable));
+	if(table == NULL)
+	{
+		DisplayError("[%s] Unable to allocate a new contact table", s->name);
+		return NULL;
+	}
+
+	*table = *old;
+	table->socketWrapper 		= CopyArray(old->socketWrapper, old->nSockets, room, sizeof(SocketWrapper));
+	table->boundSocketsList 	= CopyArray(old->boundSocketsList, old->nBoundSockets, room, sizeof(int));
+	table->boundSocketsStruct 	= CopyArray(old->boundSocketsStruct, old->nBoundSockets, room, sizeof(struct pollfd));
+	table->connectedSocketsList = CopyArray(old->connectedSocketsList, old->nConnectedSockets, room, sizeof(int));
+	table->nameIndex 			= CopyArray(old->nameIndex, old->nameIndexSize, 1, sizeof(int));
+
+	if(table->socketWrapper == NULL || table->boundSocketsList == NULL || table->boundSocketsStruct == NULL
+		|| table->connectedSocketsList == NULL || table->nameIndex == NULL)
+	{
+		DisplayError("[%s] Unable to allocate a new contact table", s->name);
+		FreeSupersocketTable(table);
+		return NULL;
+	}
+
+	return table;
+}
+
+/** nItems of itemSize from the array at from, and room for that many more after them */
+static void *CopyArray(void *from, int nItems, int room, int itemSize)
+{
+	void *to = malloc((nItems + room) * itemSize);
+	if(to != NULL && nItems > 0)
+		memcpy(to, from, nItems * itemSize);
+
+	return to;
+}
+
+static void FreeSupersocketTable(SupersocketTable *table)
+{
+	if(table == NULL)
+		return;
+
+	free(table->socketWrapper);
+	free(table->boundSocketsList);
+	free(table->boundSocketsStruct);
+	free(table->connectedSocketsList);
+	free(table->nameIndex);
+	free(table);
+}
+
+/**
+Swap table in for the current one, point the Supersocket's own fields at it, and retire
+the old one along with socket, which is closed when the old table is freed (-1 for none).
+Must be called with the lock held.
+*/
+static void PublishSupersocketTable(Supersocket *s, SupersocketTable *table, int socket)
+{
+	SupersocketTable *old = s->table;
+	__atomic_store_n(&s->table, table, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&s->tableGeneration, 1, __ATOMIC_SEQ_CST);
+
+	s->nSockets 			= table->nSockets;
+	s->socketWrapper 		= table->socketWrapper;
+	s->nBoundSockets 		= table->nBoundSockets;
+	s->boundSocketsList 	= table->boundSocketsList;
+	s->boundSocketsStruct 	= table->boundSocketsStruct;
+	s->nConnectedSockets 	= table->nConnectedSockets;
+	s->connectedSocketsList = table->connectedSocketsList;
+	s->nameIndex 			= table->nameIndex;
+	s->nameIndexSize 		= table->nameIndexSize;
+
+	if(old != NULL || socket >= 0)
+	{
+		struct RetiredSupersocketTable *retired = malloc(sizeof(struct RetiredSupersocketTable));
+		if(retired == NULL)
+		{
+			// Better to leak it than to free it from under somebody
+			DisplayWarning("[%s] Unable to keep track of an old contact table", s->name);
+			return;
+		}	
+
+		retired->table 	= old;
+		retired->socket = socket;
+		retired->epoch 	= __atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST);
+		retired->next 	= s->retired;
+		s->retired 		= retired;
+	}
+
+	ReclaimSupersocketTables(s);
+}
+
+/**
+Someone who came in during epoch e might have picked up any table that was current
+up to the moment they looked. So a table retired in epoch e is safe to free once the
+epoch has moved on to e + 2. The epoch only moves on when nobody is left reading under
+the half it is about to reuse, and we never wait for that: if a reader is still in, say
+because it's blocked in poll(), whatever is retired just waits for the next time.
+Must be called with the lock held.
+*/
+static void ReclaimSupersocketTables(Supersocket *s)
+{
+	for(int i = 0; i < 2; i++)
+	{
+		unsigned int epoch = __atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST);
+		if(__atomic_load_n(&s->readers[(epoch + 1) & 1], __ATOMIC_SEQ_CST) != 0)
+			break;
+
+		__atomic_store_n(&s->epoch, epoch + 1, __ATOMIC_SEQ_CST);
+	}
+
+	unsigned int epoch = __atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST);
+	struct RetiredSupersocketTable **next = &s->retired;
+	while(*next != NULL)
+	{
+		struct RetiredSupersocketTable *retired = *next;
+		if(epoch - retired->epoch < 2)
+		{
+			next = &retired->next;
+			continue;
+		}	
+
+		*next = retired->next;
+		if(retired->socket >= 0)
+			close(retired->socket);
+		FreeSupersocketTable(retired->table);
+		free(retired);
+	}
+}
+
+/**
+After a poll() on the table's bound sockets, return the first SocketWrapper that has
+something to read. We start looking just after whichever one was read last time, so that
+a busy socket can't starve the rest.
+*/
+static SocketWrapper *FindReadySocketWrapper(Supersocket *s, SupersocketTable *table)
+{
+	int n = table->nBoundSockets;
+	for(int k = 0; k < n; k++)
+	{
+		int i = (s->nextReady + k) % n;
+		// A local connection that has closed only says POLLHUP once there's nothing left to read
+		if(table->boundSocketsStruct[i].revents & (POLLIN | POLLHUP))
+		{
+			table->boundSocketsStruct[i].revents = 0;
+			s->nextReady = i + 1;
+			return &table->socketWrapper[table->boundSocketsList[i]];
+		}	
+	}
+
+	return NULL;
+}
+
+static int ReceiveFromSocketWrapper(Supersocket *s, SocketWrapper *sw, int receiveMessageFlag, Message *m, struct iovec *data, int nVec, MessagingOptions *options)
+{
+	if(sw == NULL)
+		return -1;
+
+	if(IsConnectionListener(sw))
+		return AcceptConnection(s, sw);
+
+	int bytesRead;
+	if(receiveMessageFlag == 1)
+		bytesRead = ReceiveMessageFromSocketWrapper(sw, m);
+	else
+		bytesRead = ReceiveIOvecFromSocketWrapper(sw, data, nVec, options);
+
+	// Any Message from a contact is as good as a heartbeat from it
+	if(receiveMessageFlag == 1 && bytesRead > 0)
+		RefreshSocketWrapper(s, m->from, -1);
+
+	// Reading nothing at all from a connection means the other end has closed it
+	if(bytesRead == 0 && sw->type == SOCK_SEQPACKET)
+		return DropConnection(s, sw->socket);
+
+	return bytesRead;
+}
+
+/** A bound SOCK_SEQPACKET socket that contacts connect to, rather than a connection to read from */
+static int IsConnectionListener(SocketWrapper *sw)
+{
+	return sw->type == SOCK_SEQPACKET && ParseFlags(sw->flags, LISTEN);
+}
+
+/**
+A local contact has connected to us. Rather than read one Message and hang up, which is
+what a SocketWrapper on its own does, the connection is kept as a bound socket of its
+own, with the listener's name, so it's polled along with everything else. It goes in the
+slot of one that has been dropped, if there is one.
+*/
+static int AcceptConnection(Supersocket *s, SocketWrapper *listener)
+{
+	SocketWrapper connection = *listener;
+	connection.flags 	= listener->flags & ~LISTEN;
+	connection.socket 	= accept(listener->socket, NULL, NULL);
+	if(connection.socket < 0)
+	{
+		DisplayWarning("[%s] Unable to accept a connection to %s: %s", s->name, listener->name, strerror(errno));
+		return -1;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	SupersocketTable *table = CopySupersocketTable(s, 1);
+	if(table == NULL)
+	{
+		close(connection.socket);
+		pthread_mutex_unlock(&s->lock);
+		return -1;
+	}
+
+	int n = ReuseClosedConnection(s, table, &connection);
+	if(n < 0)
+		n = InsertSocketWrapper(s, table, &connection);
+	PublishSupersocketTable(s, table, -1);
+	pthread_mutex_unlock(&s->lock);
+
+	Display("[%s] Accepted a connection to %s on socket %d (%d)", s->name, listener->name, connection.socket, n);
+	return CONNECTION_CHANGED;
+}
+
+/**
+Forget the accepted connection on socket. It's found by its socket rather than its index
+since whoever read from it might have been looking at an older table.
+*/
+static int DropConnection(Supersocket *s, int socket)
+{
+	pthread_mutex_lock(&s->lock);
+	for(int i = 0; i < s->nSockets; i++)
+	{
+		SocketWrapper *sw = &s->socketWrapper[i];
+		if(sw->socket == socket && sw->status != SOCKETWRAPPER_STATUS_CLOSED && IsAcceptedConnection(sw))
+		{
+			RemoveSocketWrapperLocked(s, i);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	return CONNECTION_CHANGED;
+}
+
+/** A connection to one of our bound SOCK_SEQPACKET sockets, as made by AcceptConnection() */
+static int IsAcceptedConnection(SocketWrapper *sw)
+{
+	return sw->type == SOCK_SEQPACKET && ParseFlags(sw->flags, BIND) && !IsConnectionListener(sw);
+}
+
+/**
+Put connection in the slot of a dropped connection with the same name, so that however
+many connections come and go the table only grows to as many as were ever open at once.
+The name index already has the slot under that name. Returns the slot, or -1 if there
+isn't one free. Must be called with the lock held, on a table that hasn't been published.
+*/
+static int ReuseClosedConnection(Supersocket *s, SupersocketTable *table, SocketWrapper *connection)
+{
+	for(int n = 0; n < table->nSockets; n++)
+	{
+		SocketWrapper *sw = &table->socketWrapper[n];
+		if(sw->status != SOCKETWRAPPER_STATUS_CLOSED || !IsAcceptedConnection(sw) || strcmp(sw->name, connection->name) != 0)
+			continue;
+
+		int m = table->nBoundSockets;
+		table->boundSocketsList[m] 				= n;
+		table->boundSocketsStruct[m].fd 		= connection->socket;
+		table->boundSocketsStruct[m].events 	= POLLIN;
+		table->boundSocketsStruct[m].revents 	= 0;
+		table->nBoundSockets++;
+
+		*sw 					= *connection;
+		s->lastHeard[n] 		= NowMilliseconds();
+		s->heartbeatPeriod[n] 	= 0;
+		return n;
+	}
+
+	return -1;
+}
+
+/**
+The poll and the receive have to look at the same table, since it's the table's
+pollfd array that poll() fills in. Returns 0 if nothing arrived in time.
+*/
+static int PollAndReceiveSupersocket(Supersocket *s, int milliseconds, int receiveMessageFlag, Message *m, struct iovec *data, int nVec, MessagingOptions *options)
+{
+	double deadline = NowMilliseconds() + milliseconds;
+	int wait 		= milliseconds;
+	int room 		= options != NULL ? options->nFds : 0;
+	while(1)
+	{
+		int epoch;
+		SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+
+		// A connection closing is read as well, and that sets nFds to how many came with it
+		if(options != NULL)
+			options->nFds = room;
+
+		int val = poll(table->boundSocketsStruct, table->nBoundSockets, wait);
+		if(val < 0)
+			DisplayError("Unable to poll socket: %s", strerror(errno));		
+		else if(val > 0)
+			val = ReceiveFromSocketWrapper(s, FindReadySocketWrapper(s, table), receiveMessageFlag, m, data, nVec, options);
+
+		ReleaseSupersocketTable(s, epoch);
+		if(val != CONNECTION_CHANGED)
+			return val < 0 ? -1 : val;
+
+		// A local connection came or went, which is nothing to hand back, so wait on
+		// the table with it in (or out) for whatever time is left
+		if(milliseconds >= 0)
+		{
+			wait = (int) (deadline - NowMilliseconds());
+			if(wait <= 0)
+				return 0;
+		}
+	}
+}
+
+/**
+Messages that should be compressed are compressed into the thread's scratch buffer,
+which only holds one at a time, so those go out on their own. Everything in
+between is sent in batches.
+*/
+static int SendMessageBatchToSocketWrapper(Supersocket *s, SocketWrapper *sw, Message *m, int nMessages)
+{
+	int start = 0;
+	for(int i = 0; i < nMessages; i++)
+	{
+		Message compressed;
+		if(ShouldCompress(s, sw, &m[i]) && CompressMessage(&m[i], &compressed))
+		{
+			if(SendMessagesToSocketWrapper(sw, &m[start], i - start) < 0)
+				return -1;
+			if(SendMessageToSocketWrapper(sw, &compressed) < 0)
+				return -1;
+			start = i + 1;
+		}	
+	}
+
+	return SendMessagesToSocketWrapper(sw, &m[start], nMessages - start);
+}
+
+static double NowMilliseconds(void)
 {
-	int temp = *b;
-	*b = *a;
-	*a = temp;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
 }
 
 /*
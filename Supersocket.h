@@ -66,6 +66,34 @@ comes in to any of the sockets, it'll copy the data to Message r.
 #include <pthread.h> // For thread locking
 #include <poll.h> // for sturct pollfd
 
+/** Most sockets the AF_INET port can be shared between. See SetSupersocketReceiveShards(). */
+#define SUPERSOCKET_MAX_SHARDS 64
+
+/**
+@brief One published version of the contact table
+
+Everything a send or a receive needs to look at. Once a SupersocketTable has been
+published, nothing in it changes apart from the status of a contact and the revents
+that poll() fills in, so it can be read without the lock. Each table has its own
+copy of every array.
+*/
+typedef struct SupersocketTable
+{
+	int nSockets;
+	SocketWrapper *socketWrapper;
+
+	int nBoundSockets;
+	int *boundSocketsList;
+	struct pollfd *boundSocketsStruct;
+
+	int nConnectedSockets;
+	int *connectedSocketsList;
+
+	int *nameIndex;
+	int nameIndexSize;
+
+} SupersocketTable;
+
 /**
 @brief Definition of the Supersocket structure
 
@@ -74,6 +102,35 @@ for which of the socketWrapper[] arrays is a bound socket and a connected socket
 in order to speed up the receiving and sending messages, accordingly. It also contains
 a pthread_mutex_lock to prevent racing. This mostly comes into when SupersocketListener
 wants to modify the Supersocket as its being used.
+
+The compressionThreshold is the payload size, in bytes, above which outgoing
+Messages get compressed. It is 0 (off) by default; see SetSupersocketCompression().
+
+listener belongs to the SupersocketListener, if one has been started for this
+Supersocket. It keeps track of discoveries that are still waiting for a reply.
+
+nameIndex is a hash table from SocketWrapper names to their place in socketWrapper[],
+kept up to date by AddSocketWrapper(), so that FindSocketWrapperByName() doesn't have
+to look through every socket. It has nameIndexSize slots, a power of two, and empty
+slots hold -1.
+
+lastHeard and heartbeatPeriod run alongside socketWrapper[]. lastHeard is when we last
+got anything from that contact, in milliseconds on CLOCK_MONOTONIC. heartbeatPeriod is
+how often the contact said it would send a heartbeat, or 0 if it never has, in which
+case nobody keeps an eye on whether it's still there. They are only touched with the lock held.
+watchingHeartbeats is set, for good, once any contact has a heartbeatPeriod, and until
+then receiving a Message doesn't have to look up who it came from to note it was heard.
+
+table is the contact table as it was last published (see SupersocketTable). Anything
+that adds, removes or replaces a contact builds a new table under the lock and swaps it
+in, and nSockets, socketWrapper[], the bound and connected lists and nameIndex are kept
+pointing at the newest one. Sends and receives don't use those: they go through
+ReadSupersocketTable(), which never takes the lock. Tables that have been swapped out
+wait in retired until nobody can be reading them any more, which epoch and readers[]
+keep track of. tableGeneration goes up every time a table is published, which is how
+anyone who built something from an earlier table can tell it's out of date. Comparing
+table pointers doesn't do for that, since a new table is often allocated right where
+an old one was freed. nextReady is where GetReadySocketWrapper() starts looking next time.
 */
 typedef struct
 {
@@ -88,21 +145,89 @@ typedef struct
 	int nConnectedSockets;
 	int *connectedSocketsList;
 
+	int compressionThreshold;
+
 	pthread_mutex_t lock;
 
+	struct SupersocketListenerState *listener;
+
+	int *nameIndex;
+	int nameIndexSize;
+
+	double *lastHeard;
+	int *heartbeatPeriod;
+	int watchingHeartbeats;
+
+	SupersocketTable *table;
+	unsigned int tableGeneration;
+	unsigned int epoch;
+	int readers[2];
+	struct RetiredSupersocketTable *retired;
+
+	int nextReady;
 
 } Supersocket;
 
 /**
 @brief InitializeSupersocket is a wrapper for a BIND call for AF_INET and AF_UNIX
+
+The AF_UNIX socket is made the way SetSupersocketLocalTransport() last said to, and the
+AF_INET one advertises how, so that processes on the same computer reach it the right way.
 */
 int InitializeSupersocket(Supersocket *s, char *name, char *ip, int port);
 
+/**
+ * @brief Choose how every Supersocket initialized from now on is reached from the same computer
+ *
+ * type is SOCK_DGRAM (the default) or SOCK_SEQPACKET, and flags is 0 (the default) or ABSTRACT.
+ *
+ * ABSTRACT binds the AF_UNIX socket in the abstract namespace rather than at AF_UNIX_FILENAME,
+ * so starting up doesn't have to check for and unlink an old file, and a file left behind by a
+ * process that crashed can't fool DiscoverSupersocket() into thinking it's still there.
+ *
+ * SOCK_SEQPACKET is reliable and ordered, and tells the sender straight away if the other end
+ * has gone. Each local contact connects once and keeps its connection; the receiving
+ * Supersocket accepts it and polls it along with its other bound sockets, and forgets it
+ * when it closes. Contacts reconnect by themselves if the other process is restarted.
+ *
+ * Applies to the whole process, since that's what discovery advertises. Tools/LocalTransportBenchmark.c
+ * compares the choices.
+ */
+int SetSupersocketLocalTransport(int type, int flags);
+
+/**
+ * @brief Let every Supersocket initialized from now on receive on nShards threads
+ *
+ * With more than one shard, the AF_INET socket is bound with REUSEPORT, so that a
+ * ShardedReceiver (see ShardedReceiver.h) can bind nShards - 1 more sockets to the same
+ * port and give each its own thread. Until one is started, everything still arrives on
+ * the one socket. nShards is at most SUPERSOCKET_MAX_SHARDS, and 1 (the default) turns it off.
+ *
+ * The kernel keeps Messages from the same sending socket on the same shard. With
+ * steerBySender, the shard is picked from the name in the Message header instead, so a
+ * sender stays on one shard however many sockets it sends from.
+ */
+int SetSupersocketReceiveShards(int nShards, int steerBySender);
+
+/**
+ * @brief What SetSupersocketReceiveShards() last said. Returns nShards, and steerBySender if it isn't NULL.
+ */
+int GetSupersocketReceiveShards(int *steerBySender);
+
 /**
  * @brief Close a Supersocket freeing heap memory and closing sockets as appropriate
+ *
+ * Stop any BackgroundReceiver or ShardedReceiver on s first. If a listener callback
+ * closes s, the listener thread frees what s holds at the end of its round, so s itself
+ * can't be freed or initialized again until then.
  */
 int CloseSupersocket(Supersocket *s);
 
+/**
+ * @brief Free the contact tables of a closed Supersocket, retired ones and all. CloseSupersocket() calls it.
+ */
+void FreeSupersocketTables(Supersocket *s);
+
 /**
  * @brief Add a socket to the Supersocket
  *
@@ -120,6 +245,10 @@ int AddSocket(Supersocket *s, char *name, char *ip, int port, int domain, int ty
  * @brief Add a SocketWrapper structure to the Supersocket
  */ 
 int AddSocketWrapper(Supersocket *s, SocketWrapper *sw);
+/**
+ * @brief Add n SocketWrapper structures at once. indices[i] is set to where sw[i] went, or -1. Returns how many were added.
+ */
+int AddSocketWrappers(Supersocket *s, SocketWrapper *sw, int n, int *indices);
 /**
  * @brief Poll all of the SocketWrapper structures within the Supersocket
   Importantly, this function returns the number of polled sockets, as per the default behavior
@@ -136,11 +265,139 @@ int SendDataToAll(Supersocket *s, void *data, int dlen, MessagingOptions *option
 int SendMessage(Supersocket *s, int target, Message *m);
 /** Send message to all sockets in Supersocket. */
 int SendMessageToAll(Supersocket *s, Message *m);
+/** Send data buffer to the most recently added CONNECT socket called name. */
+int SendDataByName(Supersocket *s, char *name, void *data, int dlen, MessagingOptions *options);
+/** Send message to the most recently added CONNECT socket called name. */
+int SendMessageByName(Supersocket *s, char *name, Message *m);
+
+/**
+ * @brief Get the current contact table, without taking the lock
+ *
+ * The table, and every socket in it, stays valid until the matching call to
+ * ReleaseSupersocketTable() with the same epoch, even if contacts are added, removed or
+ * replaced in the meantime. Nothing that is swapped out while you hold a table can be
+ * freed, so don't hold on to one for longer than you need to. Blocking in poll() is fine.
+ */
+SupersocketTable *ReadSupersocketTable(Supersocket *s, int *epoch);
+/**
+ * @brief Say that you are done with the table you got from ReadSupersocketTable()
+ */
+void ReleaseSupersocketTable(Supersocket *s, int epoch);
+
+/**
+ * @brief Find the most recently added socket called name that has all of flags set
+ *
+ * domain is AF_INET or AF_UNIX, or 0 for either. Returns the target (i.e. for SendMessage),
+ * or -1 if there isn't one. This is a hash table lookup, so it's fine to do for every send.
+ */
+int FindSocketWrapperByName(Supersocket *s, char *name, int flags, int domain);
+
+/** A contact is disabled after this many heartbeat periods without hearing from it */
+#define LIVENESS_DISABLE_PERIODS 3
 
+/** ... and closed after this many */
+#define LIVENESS_CLOSE_PERIODS 10
+
+/**
+ * @brief Have SendDataToAll() and SendMessageToAll() skip target until it's enabled again
+ */
+int DisableSocketWrapper(Supersocket *s, int target);
+/**
+ * @brief Undo DisableSocketWrapper()
+ */
+int EnableSocketWrapper(Supersocket *s, int target);
+/**
+ * @brief Close target's socket and take it out of the bound and connected lists
+ *
+ * The entry itself stays in socketWrapper[], with a status of SOCKETWRAPPER_STATUS_CLOSED,
+ * so every other target keeps its number. The socket is only actually closed once no send
+ * that might still be using it is left.
+ */
+int RemoveSocketWrapper(Supersocket *s, int target);
+/**
+ * @brief Point target at a new address, keeping its number
+ *
+ * The new socket is set up first and then swapped in under the lock, so other threads
+ * see either the old contact or the new one. It's enabled and counts as just heard from.
+ */
+int ReplaceSocketWrapper(Supersocket *s, int target, SocketWrapper *sw);
+/**
+ * @brief Note that we've just heard from the contact called name
+ *
+ * heartbeatPeriod is how often it has promised to be heard from, or -1 to leave that as is.
+ * Returns the contact's target, or -1 if there's no contact called name. With -1, which
+ * is what receiving a Message does, it returns -1 straight away if no contact has ever
+ * promised heartbeats, since then nobody needs to know.
+ */
+int RefreshSocketWrapper(Supersocket *s, char *name, int heartbeatPeriod);
+/**
+ * @brief Disable, enable or close contacts according to how long it's been since we heard from them
+ *
+ * Only contacts that send heartbeats are looked at. Up to maxChanges of the targets whose
+ * status changed are put in targets[], with their new status in statuses[].
+ * Returns how many there were.
+ */
+int CheckSocketWrapperLiveness(Supersocket *s, int *targets, int *statuses, int maxChanges);
+/**
+ * @brief Send an array of nMessages Messages to target, in order
+  Datagram targets get them in batches of up to SOCKETWRAPPER_MAX_BATCH per system call,
+  which is a lot cheaper than calling SendMessage() in a loop for many small Messages.
+*/
+int SendMessageBatch(Supersocket *s, int target, Message *m, int nMessages);
+
+/**
+ * @brief Compress outgoing Messages whose data is at least threshold bytes long
+ *
+ * A Message is only compressed when the contact advertised SOCKETWRAPPER_CAPABILITY_COMPRESSION
+ * (which DiscoverSupersocket() records from the other process' reply) and when compressing
+ * actually makes it smaller. Everything else goes out untouched, so it's safe to turn on
+ * for a Supersocket that talks to a mix of peers. A threshold of 0 turns compression off.
+ *
+ * Only SendMessage() and SendMessageToAll() compress: SendData() has no header in which to
+ * flag the encoding. Call this after InitializeSupersocket().
+ */
+int SetSupersocketCompression(Supersocket *s, int threshold);
+
+
+/**
+ * @brief After PollSockets(), get a bound SocketWrapper that is ready to be read, or NULL
+ *
+ * This looks at the current table without protecting it, so it's only safe if nobody
+ * else is changing the contacts at the same time. ReceiveSupersocket() doesn't have that problem.
+ */
+SocketWrapper *GetReadySocketWrapper(Supersocket *s);
 
 int ReceiveSupersocket(Supersocket *s, int receiveMessageFlag, Message *m, void *data, int dlen, MessagingOptions *options);
+/**
+ * @brief After PollSockets(), scatter whatever is ready into the nVec buffers of data
+ *
+ * For anything that isn't exactly a Message or a byte buffer (see ReceiveArray()). Returns 0
+ * if the socket that was ready was a local connection opening or closing rather than
+ * anything to read, in which case poll again. options is as for ReceiveIOvecFromSocketWrapper(),
+ * and may be NULL.
+ */
+int ReceiveIOvecSupersocket(Supersocket *s, struct iovec *data, int nVec, MessagingOptions *options);
+/**
+ * @brief Wait up to milliseconds for something to arrive, and scatter it into the nVec buffers of data
+ *
+ * The poll and the receive look at the same contact table, which calling PollSockets() and
+ * then ReceiveIOvecSupersocket() doesn't. Local connections opening or closing are dealt
+ * with along the way. Returns 0 if nothing arrived in time, and a negative timeout waits forever.
+ */
+int ReceiveIOvecSupersocketTimeout(Supersocket *s, struct iovec *data, int nVec, int milliseconds, MessagingOptions *options);
 int ReceiveData(Supersocket *s, void *data, int dlen, MessagingOptions *options);
 int ReceiveMessage(Supersocket *s, Message *m);
+/**
+ * @brief Same as ReceiveData(), but give up after milliseconds
+  Returns 0 if nothing arrived in time. A negative timeout waits forever.
+*/
+int ReceiveDataTimeout(Supersocket *s, void *data, int dlen, int milliseconds, MessagingOptions *options);
+/**
+ * @brief Same as ReceiveMessage(), but give up after milliseconds
+  Returns 0 if nothing arrived in time, which can't be confused with a Message since
+  those are always at least MESSAGE_HEADER_LENGTH bytes. A negative timeout waits forever.
+*/
+int ReceiveMessageTimeout(Supersocket *s, Message *m, int milliseconds);
 /**
 
 */
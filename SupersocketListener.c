@@ -3,16 +3,243 @@
  *
  * David Brandman and Ben Shanahan, 2018
  */
+#define _GNU_SOURCE // For clock_gettime() under -std=c11
 #include "SupersocketListener.h"
+#include "PeerCache.h"
 #include <unistd.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h> // For making the wake pipe non-blocking
+
+/** Size of the table the listener counts the other listeners in. Two that land in the same slot count once. */
+#define LISTENER_PEER_SLOTS 1024
+
+/**
+A discovery started by DiscoverSupersocketAsync() that hasn't been answered yet.
+Times are in milliseconds on CLOCK_MONOTONIC.
+*/
+typedef struct PendingDiscovery
+{
+	char name[PROCESS_MAX_CHARS];
+	DiscoveryCallback callback;
+	void *userData;
+
+	double deadline; // Negative for never
+	double nextSend;
+	int backoff;
+	int nSent;
+
+	struct PendingDiscovery *next;
+
+} PendingDiscovery;
+
+/** A SocketWrapper that someone announced, and until when we believe them */
+typedef struct
+{
+	SocketWrapper socketWrapper;
+	double expires;
+
+} DirectoryEntry;
+
+/**
+What the listener thread shares with everyone else using the Supersocket.
+registered is set while the listener is serving the Supersocket, and published
+once its bound sockets have been put in the PeerCache. publishedGeneration is the
+tableGeneration they were taken from, so that names bound later are put there too.
+*/
+typedef struct SupersocketListenerState
+{
+	pthread_mutex_t lock;
+	PendingDiscovery *pending;
+	unsigned int seed;
+	int registered;
+	int published;
+	unsigned int publishedGeneration;
+
+	int announcePeriod; // 0 for not announcing
+	double nextAnnounce;
+
+	double nextRegistration; // With the directory server, if there is one
+
+	int nUpdatesLeft; // How many more times to tell everyone where we are now
+	double nextUpdate;
+
+	int heartbeatPeriod; // 0 for not sending heartbeats
+	double nextHeartbeat;
+	int watchingLiveness; // Set once anyone has sent us a heartbeat
+	double nextLivenessCheck;
+	LivenessCallback livenessCallback;
+	void *livenessUserData;
+
+} SupersocketListenerState;
+
+/** An answer to a request that asked for them to be spread out, waiting for its turn */
+typedef struct
+{
+	DiscoveryRecord record;
+	struct sockaddr_in replyTo;
+	uint32_t nonce;
+	int maxReplies;
+	int overheard; // Answers to the same request we've heard from everyone else
+	double due;
+
+} DelayedReply;
+
+/** One of the bound names the listener answers requests for, and whose it is */
+typedef struct
+{
+	char name[PROCESS_MAX_CHARS];
+	Supersocket *s;
+
+} ListenerName;
+
+/**
+The one listener of this process, and the Supersockets it is serving.
+
+lock covers the list of Supersockets, running, busy and the wake pipe. Writing a byte
+to wakePipe gets the thread to look up from poll() straight away. busy is set while
+the thread is working on the Supersockets, and StopSupersocketListener() waits for it
+to clear before it lets go of one. generation goes up every time the list changes.
+
+The name index is a hash table from every bound AF_INET name of every Supersocket to
+whose it is, so that a request is only handed to whoever has the name. Only the thread
+uses it, and it's built again whenever the list or any of their tables has changed.
+
+The directory is everything learned from other listeners' announcements, and from the
+directory server's answers. It's shared by all of the Supersockets and looked at from
+any thread, so it has its own lock, which also covers where the directory server is.
+
+The answers being held back, and when each of the other listeners was last heard
+from, are only ever touched by the thread.
+
+closing are Supersockets a callback closed from the thread. The round it was in may
+still look at them, so their memory is only freed at the end of the round, before
+busy clears.
+*/
+typedef struct
+{
+	pthread_mutex_t lock;
+	pthread_cond_t idle;
+	pthread_t thread;
+	int running;
+	int joinable; // We started the thread and nobody has joined it yet
+	int alive; // Some thread is in RunListenerService(), maybe on its way out
+	int busy;
+	int wakePipe[2];
+
+	int nSupersockets;
+	Supersocket *supersockets[SUPERSOCKET_LISTENER_MAX_SUPERSOCKETS];
+	unsigned int generation;
+	int nClosing;
+	Supersocket *closing[SUPERSOCKET_LISTENER_MAX_SUPERSOCKETS];
+
+	unsigned int indexedGeneration;
+	unsigned int indexedTableGenerations[SUPERSOCKET_LISTENER_MAX_SUPERSOCKETS];
+	ListenerName *names;
+	int namesSize;
+
+	pthread_mutex_t directoryLock;
+	int nDirectory;
+	DirectoryEntry directory[SUPERSOCKET_DIRECTORY_SIZE];
+	int useDirectoryServer;
+	struct sockaddr_in directoryServer;
+
+	int nDelayed;
+	DelayedReply delayed[DISCOVERY_MAX_DELAYED_REPLIES];
+	double peerLastHeard[LISTENER_PEER_SLOTS];
+	unsigned int seed;
+
+} ListenerService;
+
+static ListenerService service = {
+	.lock 			= PTHREAD_MUTEX_INITIALIZER,
+	.idle 			= PTHREAD_COND_INITIALIZER,
+	.wakePipe 		= {-1, -1},
+	.directoryLock 	= PTHREAD_MUTEX_INITIALIZER
+};
+
+static pthread_once_t forkHandlersOnce = PTHREAD_ONCE_INIT;
+
+static pthread_once_t hostIdOnce = PTHREAD_ONCE_INIT;
+static uint32_t hostId;
+
+static pthread_once_t instanceOnce = PTHREAD_ONCE_INIT;
+static uint32_t instanceNonce;
 
 static int InitializeMulticastSocketWrapper(SocketWrapper *sw, int flags);
+static int CreateListenerState(Supersocket *s);
+static int StartListenerService(void);
+static void WaitForListenerService(void);
+static void RegisterForkHandlers(void);
+static void LockListenerService(void);
+static void UnlockListenerService(void);
+static void ResetListenerService(void);
+static int RunListenerService(void);
+static void HandleListenerMessage(Supersocket **supersockets, int n, Message *incomingMessage, int outgoingSocket, SocketWrapper *multicastSocketWrapper);
+static void IndexListenerNames(Supersocket **supersockets, int n);
+static void IndexListenerName(char *name, Supersocket *s, uint32_t mask);
+static int IsPublishedTopic(SocketWrapper *sw);
+static int FindListenerSupersockets(char *name, Supersocket **found);
+static void ForgetSupersocket(Supersocket *s);
+static void FreeListenerState(Supersocket *s);
+static void FreeClosedSupersockets(void);
+static int NextPendingTimeout(SupersocketListenerState *state, int registering);
+static void SendPendingDiscoveries(Supersocket *s, SocketWrapper *requestSocketWrapper, SocketWrapper *replySocketWrapper, SocketWrapper *unicastSocketWrapper);
+static void CompletePendingDiscoveries(Supersocket *s, SocketWrapper *sw);
+static void CompleteKnownDiscoveries(Supersocket *s);
+static void SendAnnouncements(Supersocket *s, SocketWrapper *requestSocketWrapper);
+static void SendRecords(Supersocket *s, int soc, SocketWrapper *target, uint32_t lifetime);
+static void LearnFromAnnouncement(Message *incomingMessage);
+static void LearnFromReply(Message *incomingMessage, SocketWrapper *sw);
+static void RememberInDirectory(SocketWrapper *sw, uint32_t lifetime);
+static void RegisterWithDirectoryServer(Supersocket *s, int soc);
+static int GetDirectoryServer(struct sockaddr_in *server);
+static uint32_t LocalAddressTowards(struct sockaddr_in *target);
+static void OpenDiscoverySockets(char *name, SocketWrapper *requestSocketWrapper, SocketWrapper *dataPayload);
+static DirectoryEntry *FindInDirectory(char *name, double now);
+static int CreateNameList(Supersocket *s, char *payload, uint32_t period);
+static int ParseNameList(Message *incomingMessage, uint32_t *period, char **names);
+static void SendHeartbeat(Supersocket *s, SocketWrapper *requestSocketWrapper);
+static void ParseHeartbeat(Supersocket *s, Message *incomingMessage);
+static void CheckLiveness(Supersocket *s);
+static void WakeListener(void);
+static int PublishSupersocket(Supersocket *s, SocketWrapper *unicastSocketWrapper);
+static int SendDiscoveryRequest(Supersocket *s, int soc, SocketWrapper *target, SocketWrapper *dataPayload, char **names, int n, DiscoveryRequestOptions *options);
+static int ReceiveDiscoveryReplies(Supersocket *s, char **names, int n, int *indices, SocketWrapper *dataPayload, Message *messageReply, int milliseconds);
+static int CollectDiscoveryReplies(Supersocket *s, char *pattern, SocketWrapper *found, int maxFound, int maxReplies, int repeat, int milliseconds);
+static int AddDiscoveredSocketWrapper(Supersocket *s, SocketWrapper *sw);
+static void PrepareDiscoveredSocketWrapper(SocketWrapper *sw);
+static void CreateDiscoveryRecord(SocketWrapper *sw, DiscoveryRecord *record);
+static int ParseDiscoveryRecord(void *data, size_t dlen, SocketWrapper *sw);
+static uint32_t HostId(void);
+static void FindHostId(void);
+static uint32_t Instance(void);
+static void MakeInstanceNonce(void);
+static int FindContactForInstance(Supersocket *s, char *name, uint32_t instance, int any);
+static void SendUpdates(Supersocket *s, SocketWrapper *requestSocketWrapper);
+static double ElapsedMilliseconds(struct timespec *start);
+static double NowMilliseconds(void);
+static int Jitter(int milliseconds, unsigned int *seed);
+static int NextBackoff(int milliseconds);
+static uint32_t HashListenerName(char *name);
 
-static int ReplyToDiscoverBindRequest(int soc, SocketWrapper *multicastSocketWrapper, Supersocket *s, Message *incomingMessage);
-// static int ParseDisable(Supersocket  *s, Message *incomingMessage); 
-// static int ParseUpdate(Supersocket   *s, Message *incomingMessage);
-// static int ParseClose(Supersocket    *s, Message *incomingMessage); 
+static int ReplyToDiscoverBindRequest(int soc, SocketWrapper *multicastSocketWrapper, Message *incomingMessage);
+static int ReplyToDiscoverBindManyRequest(int soc, Message *incomingMessage);
+static int ReplyIfBound(int soc, Supersocket *s, SocketWrapper *replyTo, char *nameRequested, char *from, DiscoveryRequestOptions *options);
+static int ReplyForName(int soc, SocketWrapper *replyTo, char *nameRequested, char *from, DiscoveryRequestOptions *options);
+static int IsPrefix(char *name);
+static int ParseRequestOptions(Message *incomingMessage, size_t offset, DiscoveryRequestOptions *options);
+static int SendReply(int soc, struct sockaddr_in *replyTo, DiscoveryRecord *record, DiscoveryRequestOptions *options);
+static void DelayReply(int soc, DiscoveryRecord *record, SocketWrapper *replyTo, DiscoveryRequestOptions *options);
+static void SendDelayedReplies(int soc, SocketWrapper *requestSocketWrapper);
+static void OverhearReply(Message *incomingMessage);
+static int NextDelayedTimeout(void);
+static void NotePeer(char *name);
+static int EstimateGroupSize(void);
+// static int ParseDisable(Supersocket  *s, Message *incomingMessage);
+static int ParseUpdate(Supersocket   *s, Message *incomingMessage);
+static int ParseClose(Supersocket    *s, Message *incomingMessage);
 
 #define DEFAULT_ESPA_MULTICAST_IP  	"239.0.0.1"
 #define DEFAULT_ESPA_MULTICAST_PORT 5000
@@ -20,211 +247,2424 @@ static int ReplyToDiscoverBindRequest(int soc, SocketWrapper *multicastSocketWra
 
 
 
-/** Call the supersocketListener() function as a thread */
+/**
+Hand s to this process' listener, and start the listener thread if it isn't running
+already. Every Supersocket in the process shares the one thread and its sockets.
+*/
 int InitializeSupersocketListener(Supersocket *s)
 {
-    pthread_t supersocketListenerThread;
-    pthread_create(&supersocketListenerThread, NULL, &SupersocketListener, s);
+    // Made here rather than in the thread, so DiscoverSupersocketAsync() can be used right away
+    if(CreateListenerState(s) < 0)
+        return -1;
+
+    SupersocketListenerState *state = s->listener;
+
+    pthread_mutex_lock(&service.lock);
+    int found = 0;
+    for(int i = 0; i < service.nSupersockets; i++)
+        found |= (service.supersockets[i] == s);
+
+    if(found == 0 && service.nSupersockets == SUPERSOCKET_LISTENER_MAX_SUPERSOCKETS)
+    {
+        pthread_mutex_unlock(&service.lock);
+        DisplayError("[%s] The SupersocketListener is already serving %d Supersockets", s->name, SUPERSOCKET_LISTENER_MAX_SUPERSOCKETS);
+        return -1;
+    }
+
+    if(found == 0)
+    {
+        // We may have been running before, somewhere else. Anyone who still has the old
+        // address gets told the new one, a few times over in case one goes missing.
+        pthread_mutex_lock(&state->lock);
+        state->registered 	= 1;
+        state->published 	= 0;
+        state->nUpdatesLeft = UPDATE_REPEATS;
+        state->nextUpdate 	= NowMilliseconds();
+        state->nextRegistration = NowMilliseconds();
+        pthread_mutex_unlock(&state->lock);
+
+        service.supersockets[service.nSupersockets++] = s;
+        service.generation++;
+    }
+
+    int output = service.running ? 0 : StartListenerService();
+    pthread_mutex_unlock(&service.lock);
+
+    WakeListener();
+    return output;
+}
+
+/**
+Take s off the listener's hands. Unless we are the listener thread ourselves (a callback
+calling CloseSupersocket(), say), we wait until the thread is between rounds, so that
+once we return it won't touch s again. The last one out stops the thread.
+*/
+int StopSupersocketListener(Supersocket *s)
+{
+	int inListener = 0;
+	int last 		= 0;
+	pthread_t thread;
+
+	pthread_mutex_lock(&service.lock);
+	int found = -1;
+	for(int i = 0; i < service.nSupersockets; i++)
+		if(service.supersockets[i] == s)
+			found = i;
+
+	if(found < 0)
+	{
+		pthread_mutex_unlock(&service.lock);
+		return -1;
+	}
+
+	service.supersockets[found] = service.supersockets[--service.nSupersockets];
+	service.generation++;
+
+	inListener = service.running && pthread_equal(service.thread, pthread_self());
+	while(service.busy && inListener == 0)
+		pthread_cond_wait(&service.idle, &service.lock);
+
+	if(service.nSupersockets == 0 && service.running)
+	{
+		service.running = 0;
+		last 			= (service.joinable && inListener == 0);
+		thread 			= service.thread;
+		if(last)
+			service.joinable = 0;
+	}
+	pthread_mutex_unlock(&service.lock);
+
+	ForgetSupersocket(s);
+
+	WakeListener();
+	if(last)
+		pthread_join(thread, NULL);
 
-    return 0;
+	Display("[%s] SupersocketListener stopped", s->name);
+	return 0;
 }
 
-/** Main function for listening to requests from other procesess */
+/**
+Run the listener in this thread. If it's already running somewhere, s is just handed
+to it, and we return straight away. Otherwise this returns once the listener is stopped.
+*/
 void *SupersocketListener(void *voidInput)
 {
-	// Cast the input as a Supersocket structure
-	Supersocket *inputSupersocketPointer = (Supersocket *) voidInput;
+	if(voidInput != NULL)
+	{
+		Supersocket *s = (Supersocket *) voidInput;
+		if(CreateListenerState(s) < 0)
+			return NULL;
+
+		pthread_mutex_lock(&service.lock);
+		int running = service.running;
+		if(running == 0)
+		{
+			// Registering now won't start a thread of its own
+			WaitForListenerService();
+			service.running 	= 1;
+			service.alive 		= 1;
+			service.thread 		= pthread_self();
+		}
+		pthread_mutex_unlock(&service.lock);
+
+		if(InitializeSupersocketListener(s) < 0)
+		{
+			pthread_mutex_lock(&service.lock);
+			service.running = running;
+			service.alive 	= running;
+			pthread_mutex_unlock(&service.lock);
+			return NULL;
+		}
+		if(running)
+			return NULL;
+	}
+
+	RunListenerService();
+	return NULL;
+}
+
+/** Must be called with service.lock held */
+static int StartListenerService(void)
+{
+	// A callback that stopped the last Supersocket and then started another is
+	// still inside the loop, which can simply carry on
+	if(service.alive && pthread_equal(service.thread, pthread_self()))
+	{
+		service.running = 1;
+		return 0;
+	}
+
+	WaitForListenerService();
+	service.running = 1;
+	service.alive 	= 1;
+	if(pthread_create(&service.thread, NULL, &SupersocketListener, NULL) != 0)
+	{
+		DisplayError("Unable to start the SupersocketListener thread");
+		service.running = 0;
+		service.alive 	= 0;
+		return -1;
+	}
+
+	service.joinable = 1;
+	return 0;
+}
+
+/**
+Wait for the last listener thread to be gone, so that a new one doesn't start while
+the old one is still cleaning up. Must be called with service.lock held.
+*/
+static void WaitForListenerService(void)
+{
+	// Whoever stopped the last listener from inside it couldn't wait for it to finish
+	if(service.joinable)
+	{
+		pthread_t old 		= service.thread;
+		service.joinable 	= 0;
+		pthread_mutex_unlock(&service.lock);
+		pthread_join(old, NULL);
+		pthread_mutex_lock(&service.lock);
+	}
+
+	// Otherwise someone else is joining it
+	while(service.alive)
+		pthread_cond_wait(&service.idle, &service.lock);
+}
 
+/** The listener thread itself. Returns once the last Supersocket has been taken away. */
+static int RunListenerService(void)
+{
 	// Initialize a new Socketwrapper that we are going to be using to
 	// listen to new messages. This is a multicast address
 	SocketWrapper multicastSocketWrapper = {0};
 	InitializeMulticastSocketWrapper(&multicastSocketWrapper, BIND | MULTICAST);
-	
+
+	// We also take requests sent straight to us, rather than to the whole network.
+	// This is how DiscoverSupersocket() checks on the entries in the PeerCache, and
+	// where the directory server answers us if there is one.
+	SocketWrapper unicastSocketWrapper = {0};
+	PopulateSocketWrapper(&unicastSocketWrapper, "Listener", "0.0.0.0", 0, AF_INET, SOCK_DGRAM, BIND);
+	InitializeSocketWrapper(&unicastSocketWrapper);
+
+	// For DiscoverSupersocketAsync(), we send requests of our own out on the multicast
+	// and take the replies on a socket of our own, just as DiscoverSupersocket() does
+	SocketWrapper requestSocketWrapper = {0};
+	InitializeMulticastSocketWrapper(&requestSocketWrapper, CONNECT | MULTICAST);
+
+	SocketWrapper replySocketWrapper = {0};
+	PopulateSocketWrapper(&replySocketWrapper, "Listener", DEFAULT_ESPA_MULTICAST_IP, 0, AF_INET, SOCK_DGRAM, BIND | MULTICAST);
+	InitializeSocketWrapper(&replySocketWrapper);
+
+	pthread_mutex_lock(&service.lock);
+	if(pipe(service.wakePipe) < 0)
+		DisplayWarning("Unable to make the SupersocketListener wake pipe: %s", strerror(errno));
+	fcntl(service.wakePipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(service.wakePipe[1], F_SETFL, O_NONBLOCK);
+	pthread_mutex_unlock(&service.lock);
+
+	struct pollfd listenerSockets[4] = {
+		{.fd = multicastSocketWrapper.socket, .events = POLLIN},
+		{.fd = unicastSocketWrapper.socket,   .events = POLLIN},
+		{.fd = replySocketWrapper.socket,     .events = POLLIN},
+		{.fd = service.wakePipe[0],           .events = POLLIN}
+	};
+	SocketWrapper *listenerSocketWrappers[3] = {&multicastSocketWrapper, &unicastSocketWrapper, &replySocketWrapper};
+
 	// The ReplyToSocketWrapper() function requires an already created
 	// socket explicitly for sending messages.
 	int outgoingSocket = socket(AF_INET, SOCK_DGRAM, 0);
-	
-	// Initialize the message we are going to be writing to!
-	Message incomingMessage = CreateMessageBuffer(1024);
+	service.seed = getpid() ^ (unsigned int) NowMilliseconds();
 
-	Display("[%s] Initializing Multicast Receiver...", inputSupersocketPointer->name);
+	// Initialize the message we are going to be writing to!
+	Message incomingMessage = CreateMessageBuffer(DISCOVERY_REQUEST_BUFFER_SIZE);
 
-	/** TODO: Turn this while(1) into while(enabled) based on a Status.h definition */
+	Display("Initializing Multicast Receiver...");
 
+	Supersocket *supersockets[SUPERSOCKET_LISTENER_MAX_SUPERSOCKETS];
 	while (1)
 	{
-		// We sit and block on multicastSocketWrapper until a new message arrives
-		ReceiveMessageFromSocketWrapper(&multicastSocketWrapper, &incomingMessage);
+		// In between rounds, nobody's Supersocket is being used, so anyone
+		// waiting in StopSupersocketListener() can go ahead
+		pthread_mutex_lock(&service.lock);
+		service.busy = 0;
+		pthread_cond_broadcast(&service.idle);
+		if(service.running == 0)
+		{
+			pthread_mutex_unlock(&service.lock);
+			break;
+		}
 
-		
-		switch (incomingMessage.id)
+		// We sit and block until a new message arrives on any socket, or it's time
+		// to do something for one of the Supersockets
+		struct sockaddr_in server;
+		int registering = (GetDirectoryServer(&server) == 0);
+		int timeout 	= NextDelayedTimeout();
+		for(int i = 0; i < service.nSupersockets; i++)
 		{
-			case ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND:
+			int t = NextPendingTimeout(service.supersockets[i]->listener, registering);
+			if(t >= 0 && (timeout < 0 || t < timeout))
+				timeout = t;
+		}
+		pthread_mutex_unlock(&service.lock);
 
-				ReplyToDiscoverBindRequest(outgoingSocket,
-											&multicastSocketWrapper, 
-											inputSupersocketPointer, 
-											&incomingMessage); 
-				break;
+		if(poll(listenerSockets, 4, timeout) < 0)
+			continue;
+
+		if(listenerSockets[3].revents & POLLIN)
+		{
+			char wake[64];
+			while(read(service.wakePipe[0], wake, sizeof(wake)) > 0);
+		}
+
+		pthread_mutex_lock(&service.lock);
+		service.busy = 1;
+		int n = service.nSupersockets;
+		memcpy(supersockets, service.supersockets, n * sizeof(Supersocket *));
+		IndexListenerNames(supersockets, n);
+		pthread_mutex_unlock(&service.lock);
+
+		for(int i = 0; i < n; i++)
+		{
+			// Read before the table, so anything bound in between gets published next time round
+			unsigned int generation = __atomic_load_n(&supersockets[i]->tableGeneration, __ATOMIC_SEQ_CST);
 
+			SupersocketListenerState *state = supersockets[i]->listener;
+			pthread_mutex_lock(&state->lock);
+			int publish 				= (state->published == 0 || state->publishedGeneration != generation);
+			state->published 			= 1;
+			state->publishedGeneration 	= generation;
+			pthread_mutex_unlock(&state->lock);
+
+			if(publish)
+				PublishSupersocket(supersockets[i], &unicastSocketWrapper);
+		}
+
+		for(int i = 0; i < 3; i++)
+		{
+			if((listenerSockets[i].revents & POLLIN) == 0)
+				continue;
+
+			incomingMessage.dlen = DISCOVERY_REQUEST_BUFFER_SIZE;
+			if(ReceiveMessageFromSocketWrapper(listenerSocketWrappers[i], &incomingMessage) < 0)
+				continue;
+
+			// Whoever we hear on the multicast is one of the group
+			if(i == 0)
+				NotePeer(incomingMessage.from);
+
+			HandleListenerMessage(supersockets, n, &incomingMessage, outgoingSocket, &multicastSocketWrapper);
+		}
+
+		SendDelayedReplies(outgoingSocket, &requestSocketWrapper);
+
+		for(int i = 0; i < n; i++)
+		{
+			Supersocket *s = supersockets[i];
+			CompleteKnownDiscoveries(s);
+			SendPendingDiscoveries(s, &requestSocketWrapper, &replySocketWrapper, &unicastSocketWrapper);
+			SendAnnouncements(s, &requestSocketWrapper);
+			RegisterWithDirectoryServer(s, outgoingSocket);
+			SendHeartbeat(s, &requestSocketWrapper);
+			SendUpdates(s, &requestSocketWrapper);
+			CheckLiveness(s);
 		}
+
+		// Still busy, so that whoever waits for the round to be over also waits for this
+		FreeClosedSupersockets();
 	}
+
+	DestroyMessageBuffer(&incomingMessage);
+	close(outgoingSocket);
+	CloseSocketWrapper(&replySocketWrapper);
+	CloseSocketWrapper(&requestSocketWrapper);
+	CloseSocketWrapper(&unicastSocketWrapper);
 	CloseSocketWrapper(&multicastSocketWrapper);
 
-}
+	pthread_mutex_lock(&service.lock);
+	close(service.wakePipe[0]);
+	close(service.wakePipe[1]);
+	service.wakePipe[0] = -1;
+	service.wakePipe[1] = -1;
+	free(service.names);
+	service.names 				= NULL;
+	service.namesSize 			= 0;
+	service.indexedGeneration 	= service.generation - 1;
+	service.nDelayed 			= 0;
+	service.alive 				= 0;
+	pthread_cond_broadcast(&service.idle);
+	pthread_mutex_unlock(&service.lock);
 
+	Display("Multicast Receiver stopped");
+	return 0;
+}
 
-static int ReplyToDiscoverBindRequest(int soc, SocketWrapper *multicastSupersocket, Supersocket *s, Message *incomingMessage)
+/**
+Requests go only to whoever has the name, through the name index. Everything else is
+about someone else's contacts or our own pending discoveries, so every Supersocket
+gets to look at it. Announcements go in the directory once, for everyone.
+*/
+static void HandleListenerMessage(Supersocket **supersockets, int n, Message *incomingMessage, int outgoingSocket, SocketWrapper *multicastSocketWrapper)
 {
-	// This function responds to ID_SUPERSOCKET_SOCKETWRAPPER_REPLY_DISCOVERBIND as the ID input
-	// from the Message. If that is the case, then it expects that the contents of the message
-	// are a SocketWrapper, which contains:
-	// 	1. The "name" field is the name of the process being requested
-	// 	2. All other information within the SocketWrapper refers to how to reply to the sender
+	switch (incomingMessage->id)
+	{
+		case ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND:
 
-	// receivedSocketWrapper is the contents of the data field, which is the information required
-	// for sending back a message
-	SocketWrapper *receivedSocketWrapper = (SocketWrapper *) incomingMessage->data;
-	char *nameRequested = receivedSocketWrapper->name;
+			ReplyToDiscoverBindRequest(outgoingSocket, multicastSocketWrapper, incomingMessage);
+			break;
 
-	Display("[%s] Received Request for %s", s->name, nameRequested);
+		case ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND_MANY:
 
-	// Now we iterate through each of the sockets that are currently bound on Supersocket s.
-	// A match occurs if:
-	// 	1. The requested name matches the name of the socketWrapper
-	// 	2. The domain is AF_INET. This is because the discovery is assumed to work on AF_UNIX.
-	
-	
-	for(int i = 0; i < s->nBoundSockets; i++)
-	{
-		int socketWrapperIndex 		= s->boundSocketsList[i];
+			ReplyToDiscoverBindManyRequest(outgoingSocket, incomingMessage);
+			break;
 
-		char *thisSocketWrapperName = s->socketWrapper[socketWrapperIndex].name;
-		int thisSocketWrapperDomain = s->socketWrapper[socketWrapperIndex].domain;
-		
-		int condition1 = (strcmp(nameRequested, thisSocketWrapperName) == 0);
-		int condition2 = (thisSocketWrapperDomain == AF_INET);
-		
-		if (condition1 && condition2)
+		case ID_SUPERSOCKET_SOCKETWRAPPER_REPLY_DISCOVERBIND:
 		{
-			// If a match occurs, then we are going to reply using the SocketWrapper information
-			// from the match! We populate our reply message as follows:
-			Display("[%s] I am %s! Replying to [%s]...", s->name, nameRequested, incomingMessage->from);
+			SocketWrapper reply;
+			if(ParseDiscoveryRecord(incomingMessage->data, incomingMessage->dlen, &reply) < 0)
+				break;
+
+			OverhearReply(incomingMessage);
+			LearnFromReply(incomingMessage, &reply);
+
+			// Each gets its own copy, since adding a contact changes it
+			for(int i = 0; i < n; i++)
+			{
+				SocketWrapper copy = reply;
+				CompletePendingDiscoveries(supersockets[i], &copy);
+			}
+			break;
+		}
+
+		case ID_SUPERSOCKET_SOCKETWRAPPER_ANNOUNCE:
+
+			LearnFromAnnouncement(incomingMessage);
+			break;
+
+		case ID_SUPERSOCKET_SOCKETWRAPPER_HEARTBEAT:
+
+			for(int i = 0; i < n; i++)
+				ParseHeartbeat(supersockets[i], incomingMessage);
+			break;
 
-			Message replyMessage = CreateMessage(thisSocketWrapperName, 
-					ID_SUPERSOCKET_SOCKETWRAPPER_REPLY_DISCOVERBIND ,
-					&s->socketWrapper[socketWrapperIndex], 
-					sizeof(SocketWrapper));
+		case ID_SUPERSOCKET_SOCKETWRAPPER_CLOSE:
 
+			for(int i = 0; i < n; i++)
+				ParseClose(supersockets[i], incomingMessage);
+			break;
 
-			ReplyToSocketWrapper(soc, receivedSocketWrapper, &replyMessage);
+		case ID_SUPERSOCKET_SOCKETWRAPPER_UDPATE:
 
-			return 0;
+			for(int i = 0; i < n; i++)
+				ParseUpdate(supersockets[i], incomingMessage);
+			break;
+	}
+}
+
+/**
+Build the name index again if the list of Supersockets, or any of their contact tables,
+has changed since last time. Only the thread calls this, with service.lock held.
+*/
+static void IndexListenerNames(Supersocket **supersockets, int n)
+{
+	int changed = (service.indexedGeneration != service.generation);
+	for(int i = 0; i < n; i++)
+		changed |= (service.indexedTableGenerations[i] != __atomic_load_n(&supersockets[i]->tableGeneration, __ATOMIC_SEQ_CST));
+
+	if(changed == 0)
+		return;
+
+	// The generation is read before the table, so a table published in between is indexed again next time
+	int epochs[SUPERSOCKET_LISTENER_MAX_SUPERSOCKETS];
+	SupersocketTable *tables[SUPERSOCKET_LISTENER_MAX_SUPERSOCKETS];
+	int nNames = 0;
+	for(int i = 0; i < n; i++)
+	{
+		service.indexedTableGenerations[i] = __atomic_load_n(&supersockets[i]->tableGeneration, __ATOMIC_SEQ_CST);
+		tables[i] = ReadSupersocketTable(supersockets[i], &epochs[i]);
+		nNames += tables[i]->nSockets;
+	}
+
+	int size = 16;
+	while(size < 2 * nNames)
+		size *= 2;
+
+	free(service.names);
+	service.names 		= calloc(size, sizeof(ListenerName));
+	service.namesSize 	= service.names != NULL ? size : 0;
+	if(service.names == NULL)
+		DisplayError("Unable to allocate the SupersocketListener name index");
+
+	uint32_t mask = size - 1;
+	for(int i = 0; i < n && service.names != NULL; i++)
+	{
+		SupersocketTable *table = tables[i];
+		for(int j = 0; j < table->nBoundSockets; j++)
+		{
+			SocketWrapper *sw = &table->socketWrapper[table->boundSocketsList[j]];
+			if(sw->domain == AF_INET && ParseFlags(sw->flags, MULTICAST) == 0)
+				IndexListenerName(sw->name, supersockets[i], mask);
 		}
+
+		// Topics we publish aren't bound, but we answer for them all the same
+		for(int j = 0; j < table->nSockets; j++)
+			if(IsPublishedTopic(&table->socketWrapper[j]))
+				IndexListenerName(table->socketWrapper[j].name, supersockets[i], mask);
 	}
-	return 1;
+
+	for(int i = 0; i < n; i++)
+		ReleaseSupersocketTable(supersockets[i], epochs[i]);
+
+	// Otherwise we try again next time round
+	if(service.names != NULL)
+		service.indexedGeneration = service.generation;
 }
 
+static void IndexListenerName(char *name, Supersocket *s, uint32_t mask)
+{
+	uint32_t slot = HashListenerName(name) & mask;
+	while(service.names[slot].s != NULL)
+		slot = (slot + 1) & mask;
 
-/////////////////////////////////////////////////////////////////////////////////
-/////////////////////////////////////////////////////////////////////////////////
-/////////////////////////////////////////////////////////////////////////////////
-/////////////////////////////////////////////////////////////////////////////////
-/////////////////////////////////////////////////////////////////////////////////
+	strncpy(service.names[slot].name, name, PROCESS_MAX_CHARS - 1);
+	service.names[slot].s = s;
+}
 
-int DiscoverSupersocket(Supersocket *s, char *name)
+/** The SocketWrapper PublishTopic() sends a topic's Messages to the group with */
+static int IsPublishedTopic(SocketWrapper *sw)
 {
-	// We first create a SocketWrapper that we are going to use for sending
-	// messages out on the multicast. This is the multicastSocketWrapper
-	//
-	// Next we are going to create a socketWrapper that we are going to BIND
-	// and listen to. This is the dataPayload. It's called this because
-	// it's exactly the same SocketWrapper that is going to be sent out
-	// on the Multicast network as the .data portion of the Message
-	SocketWrapper multicastSocketWrapper = {0};
-	InitializeMulticastSocketWrapper(&multicastSocketWrapper, CONNECT | MULTICAST);
+	return sw->status != SOCKETWRAPPER_STATUS_CLOSED
+		&& sw->domain == AF_INET
+		&& ParseFlags(sw->flags, MULTICAST)
+		&& ParseFlags(sw->flags, BIND) == 0
+		&& (sw->capabilities & SOCKETWRAPPER_CAPABILITY_TOPIC);
+}
 
-	SocketWrapper dataPayload = {0};
-	PopulateSocketWrapper(&dataPayload, 
-						  name, 
-						  DEFAULT_ESPA_MULTICAST_IP,
-						  0,
-						  AF_INET,
-						  SOCK_DGRAM,
-						  BIND | MULTICAST);
-	InitializeSocketWrapper(&dataPayload);
+/** Everyone in this process with name bound. found needs room for SUPERSOCKET_LISTENER_MAX_SUPERSOCKETS. */
+static int FindListenerSupersockets(char *name, Supersocket **found)
+{
+	int nFound = 0;
+	if(service.namesSize == 0)
+		return 0;
 
-	// messageRequest is the message sent out to the Network.
-	// messageReply is a buffer fora new message we will be receiving
-	Message messageRequest 	= CreateMessage(s->name, ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND, &dataPayload, sizeof(SocketWrapper));
-	Message messageReply 	= CreateMessageBuffer(2000);
-
-	/* Display("MESSAGE REQUEST:"); */
-	/* PrintMessage(&messageRequest); */
-
-
-	int nMessages = 0;
-	int socketFound = 0;
-	int integerOfNewSocketWrapper;
-	
-	while (socketFound == 0)
-	{
-		// We begin by sending out a mesage on the Multicast network contaiing messageRequest
-		Display("[%s] Sending out a request for: %s", s->name, name);
-		SendMessageToSocketWrapper(&multicastSocketWrapper, &messageRequest);
-
-		// Now we sit and poll whether there are any new messages. We timeout based on
-		// the definition set in SupersocketListener.h
-		// When there is at least one new message, we parse it. If it matches the
-		// ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND then we check to see if it's
-		// in fact the name we want. If so, then we add it to the Supersocket s and then 
-		// exit this function.
-		// If we continue not receiving messages, then the nMessages == 0 and then we exit
-		// the innter while() loop, which means we then resend the message to the network
-		//
-		// One of the things to consider is if there is a lot of traffic on the network,
-		// then nMessages will constantly not be 0... Worth thinking about this a bit
-		// TODO: Consider changing this code in case of busy multicast traffic
-		while((nMessages = PollSocketWrapper(&dataPayload, POLL_TIME_FOR_DISCOVERY)) != 0)
-		{
-			if(nMessages < 0)
-			{
-				DisplayError("[%s] Unable to poll SocketWrapper: %s",  s->name, strerror(errno));		
-				return -1;
-			}	
+	uint32_t mask = service.namesSize - 1;
+	for(uint32_t slot = HashListenerName(name) & mask; service.names[slot].s != NULL; slot = (slot + 1) & mask)
+	{
+		ListenerName *entry = &service.names[slot];
+		if(strcmp(entry->name, name) != 0)
+			continue;
 
-			ReceiveMessageFromSocketWrapper(&dataPayload, &messageReply);
-			if(messageReply.id == ID_SUPERSOCKET_SOCKETWRAPPER_REPLY_DISCOVERBIND)
-			{
-				Display("[%s] Received a reply to the Discovery from %s", s->name, messageReply.from);
-				SocketWrapper *sw = messageReply.data;
+		// The same Supersocket can have the name bound more than once
+		int seen = 0;
+		for(int i = 0; i < nFound; i++)
+			seen |= (found[i] == entry->s);
+		if(seen == 0 && nFound < SUPERSOCKET_LISTENER_MAX_SUPERSOCKETS)
+			found[nFound++] = entry->s;
+	}
+	return nFound;
+}
+
+/**
+Give up on s's pending discoveries, telling whoever was waiting, and take its names out
+of the PeerCache and the directory server, since nobody is going to answer for them any more.
+The thread is done with s by now, so it can't renew them with the server behind our back.
+*/
+static void ForgetSupersocket(Supersocket *s)
+{
+	SupersocketListenerState *state = s->listener;
 
-				/* PrintMessage(&messageReply); */
+	pthread_mutex_lock(&state->lock);
+	PendingDiscovery *pending 	= state->pending;
+	int published 				= state->published;
+	state->pending 				= NULL;
+	state->registered 			= 0;
+	state->published 			= 0;
+	pthread_mutex_unlock(&state->lock);
 
-				if(strcmp(sw->name, name) == 0)
-				{
-					// If we've come this far, then we are going to add the new information
-					// to the Supersocket. At this point we check if the other process
-					// is local or not, by asking if the file exists at the expected AF_UNIX
-					// address, as defined by SocketWrapper.h
-					sw->domain = DoesFileExist(sw->unixStruct.sun_path) ? AF_UNIX : AF_INET;
-					sw->flags  = CONNECT;
-					Display("[%s] Attempting to add %s to the Supersocket!", s->name, sw->name);
-					integerOfNewSocketWrapper = AddSocketWrapper(s, sw);
-					Display("[%s] Added %s to the Supersocket!", s->name, sw->name);
+	while(pending != NULL)
+	{
+		PendingDiscovery *p = pending;
+		pending = p->next;
 
-					socketFound = 1; // This will cause the outer while loop to break
-					break;
-				}
-			}					
-		}
+		if(p->callback != NULL)
+			p->callback(s, p->name, -1, p->userData);
+		free(p);
 	}
 
+	// The directory server lets go of our names as soon as it hears a lease of 0 for them
+	SocketWrapper server = {0};
+	int soc = socket(AF_INET, SOCK_DGRAM, 0);
+	if(soc >= 0 && GetDirectoryServer(&server.inetStruct) == 0)
+		SendRecords(s, soc, &server, 0);
+	if(soc >= 0)
+		close(soc);
 
-	DestroyMessageBuffer(&messageReply);
-	CloseSocketWrapper(&multicastSocketWrapper);
-	CloseSocketWrapper(&dataPayload);
-	return integerOfNewSocketWrapper;
+	if(published == 0)
+		return;
+
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+	for(int i = 0; i < table->nBoundSockets; i++)
+	{
+		SocketWrapper *sw = &table->socketWrapper[table->boundSocketsList[i]];
+		if(sw->domain == AF_INET && ParseFlags(sw->flags, MULTICAST) == 0)
+			RemoveFromPeerCache(sw->name, getpid());
+	}
+	ReleaseSupersocketTable(s, epoch);
+}
+
+/**
+Once s is closed, the listener has no more use for its state. If we are the thread
+ourselves, though, the round we are in may still look at s, so it goes on the closing
+list for the thread to free, tables and all, once the round is over, and this returns 1.
+*/
+int ReleaseSupersocketListener(Supersocket *s)
+{
+	if(s->listener == NULL)
+		return 0;
+
+	pthread_mutex_lock(&service.lock);
+	int inListener = service.alive && pthread_equal(service.thread, pthread_self());
+	if(inListener && service.nClosing < SUPERSOCKET_LISTENER_MAX_SUPERSOCKETS)
+	{
+		service.closing[service.nClosing++] = s;
+		pthread_mutex_unlock(&service.lock);
+		return 1;
+	}
+	pthread_mutex_unlock(&service.lock);
+
+	if(inListener)
+	{
+		DisplayWarning("[%s] Too many Supersockets closed in one round, so this one's memory is left behind", s->name);
+		return 1;
+	}
+
+	FreeListenerState(s);
+	return 0;
+}
+
+static void FreeListenerState(Supersocket *s)
+{
+	SupersocketListenerState *state = s->listener;
+
+	while(state->pending != NULL)
+	{
+		PendingDiscovery *p = state->pending;
+		state->pending = p->next;
+		free(p);
+	}
+
+	pthread_mutex_destroy(&state->lock);
+	free(state);
+	s->listener = NULL;
+}
+
+static void FreeClosedSupersockets(void)
+{
+	Supersocket *closing[SUPERSOCKET_LISTENER_MAX_SUPERSOCKETS];
+
+	pthread_mutex_lock(&service.lock);
+	int n = service.nClosing;
+	memcpy(closing, service.closing, n * sizeof(Supersocket *));
+	service.nClosing = 0;
+	pthread_mutex_unlock(&service.lock);
+
+	for(int i = 0; i < n; i++)
+	{
+		FreeListenerState(closing[i]);
+		FreeSupersocketTables(closing[i]);
+	}
+}
+
+static int CreateListenerState(Supersocket *s)
+{
+	if(s->listener != NULL)
+		return 0;
+
+	SupersocketListenerState *state = calloc(1, sizeof(SupersocketListenerState));
+	if(state == NULL)
+	{
+		DisplayError("[%s] Unable to set up the SupersocketListener: %s", s->name, strerror(errno));
+		return -1;
+	}
+
+	pthread_mutex_init(&state->lock, NULL);
+	state->seed = getpid() ^ (unsigned int) (uintptr_t) s;
+
+	s->listener = state;
+	pthread_once(&forkHandlersOnce, RegisterForkHandlers);
+	return 0;
+}
+
+/**
+The listener thread doesn't come along into a forked child, so the child starts over
+with no listener at all. Whatever it wants served, it has to hand over again.
+*/
+static void RegisterForkHandlers(void)
+{
+	pthread_atfork(LockListenerService, UnlockListenerService, ResetListenerService);
+}
+
+static void LockListenerService(void)
+{
+	pthread_mutex_lock(&service.lock);
+	pthread_mutex_lock(&service.directoryLock);
+}
+
+static void UnlockListenerService(void)
+{
+	pthread_mutex_unlock(&service.directoryLock);
+	pthread_mutex_unlock(&service.lock);
+}
+
+static void ResetListenerService(void)
+{
+	for(int i = 0; i < service.nSupersockets; i++)
+		service.supersockets[i]->listener->registered = 0;
+
+	if(service.wakePipe[0] >= 0)
+		close(service.wakePipe[0]);
+	if(service.wakePipe[1] >= 0)
+		close(service.wakePipe[1]);
+	free(service.names);
+
+	service.running 			= 0;
+	service.joinable 			= 0;
+	service.alive 				= 0;
+	service.busy 				= 0;
+	service.wakePipe[0] 		= -1;
+	service.wakePipe[1] 		= -1;
+	service.nSupersockets 		= 0;
+	service.nClosing 			= 0;
+	service.names 				= NULL;
+	service.namesSize 			= 0;
+	service.indexedGeneration 	= service.generation - 1;
+	service.nDelayed 			= 0;
+
+	pthread_cond_init(&service.idle, NULL);
+	UnlockListenerService();
+}
+
+/**
+How long poll() can sleep before something on the pending list needs doing. Renewing
+our registrations only counts if we're registering with a directory server.
+*/
+static int NextPendingTimeout(SupersocketListenerState *state, int registering)
+{
+	double next = -1;
+	#define EARLIEST(t) next = (next < 0 || (t) < next) ? (t) : next
+
+	pthread_mutex_lock(&state->lock);
+	for(PendingDiscovery *p = state->pending; p != NULL; p = p->next)
+	{
+		EARLIEST(p->nextSend);
+		if(p->deadline >= 0)
+			EARLIEST(p->deadline);
+	}
+	if(state->announcePeriod > 0)
+		EARLIEST(state->nextAnnounce);
+	if(state->heartbeatPeriod > 0)
+		EARLIEST(state->nextHeartbeat);
+	if(state->nUpdatesLeft > 0)
+		EARLIEST(state->nextUpdate);
+	if(registering)
+		EARLIEST(state->nextRegistration);
+	if(state->watchingLiveness)
+		EARLIEST(state->nextLivenessCheck);
+	pthread_mutex_unlock(&state->lock);
+
+	#undef EARLIEST
+	if(next < 0)
+		return -1;
+
+	double timeLeft = next - NowMilliseconds();
+	return timeLeft > 0 ? (int) timeLeft + 1 : 0;
+}
+
+/**
+Ask again for every pending discovery whose backoff has run out, and give up on the
+ones whose deadline has passed. The first time a name is asked for, its owner is
+also asked directly if it's in the PeerCache. With a directory server, it's the
+server we ask rather than the multicast, and it answers on our unicast socket.
+*/
+static void SendPendingDiscoveries(Supersocket *s, SocketWrapper *requestSocketWrapper, SocketWrapper *replySocketWrapper, SocketWrapper *unicastSocketWrapper)
+{
+	SupersocketListenerState *state = s->listener;
+	PendingDiscovery *expired 		= NULL;
+	double now 						= NowMilliseconds();
+
+	SocketWrapper server 	= {0};
+	SocketWrapper *target 	= requestSocketWrapper;
+	SocketWrapper replyTo 	= *replySocketWrapper;
+	if(GetDirectoryServer(&server.inetStruct) == 0)
+	{
+		target 	= &server;
+		replyTo = *unicastSocketWrapper;
+	}
+
+	pthread_mutex_lock(&state->lock);
+	PendingDiscovery **link = &state->pending;
+	while(*link != NULL)
+	{
+		PendingDiscovery *p = *link;
+		if(p->deadline >= 0 && now >= p->deadline)
+		{
+			*link 		= p->next;
+			p->next 	= expired;
+			expired 	= p;
+			continue;
+		}
+
+		if(now >= p->nextSend)
+		{
+			char *names[1] = {p->name};
+			PeerCacheEntry cached;
+			if(p->nSent == 0 && LookUpPeerCache(p->name, &cached) == 0)
+			{
+				SocketWrapper cachedListener = {0};
+				cachedListener.inetStruct = cached.listener;
+				SendDiscoveryRequest(s, requestSocketWrapper->socket, &cachedListener, replySocketWrapper, names, 1, NULL);
+			}
+
+			// Our unicast socket is bound to every interface, so the server is told the one it can reach
+			if(target == &server && replyTo.inetStruct.sin_addr.s_addr == htonl(INADDR_ANY))
+				replyTo.inetStruct.sin_addr.s_addr = LocalAddressTowards(&server.inetStruct);
+
+			Display("[%s] Sending out a request for %s", s->name, p->name);
+			SendDiscoveryRequest(s, requestSocketWrapper->socket, target, &replyTo, names, 1, NULL);
+
+			p->nSent++;
+			p->nextSend = now + Jitter(p->backoff, &state->seed);
+			p->backoff 	= NextBackoff(p->backoff);
+		}
+		link = &p->next;
+	}
+	pthread_mutex_unlock(&state->lock);
+
+	while(expired != NULL)
+	{
+		PendingDiscovery *p = expired;
+		expired = p->next;
+
+		DisplayWarning("[%s] Gave up discovering %s", s->name, p->name);
+		if(p->callback != NULL)
+			p->callback(s, p->name, -1, p->userData);
+		free(p);
+	}
+}
+
+/**
+We've found out where a name is, from a reply or an announcement. If anyone is waiting
+on it, add it to the Supersocket and let each of them know. Replies nobody is waiting
+for (the second answer to the same request, say) are ignored.
+*/
+static void CompletePendingDiscoveries(Supersocket *s, SocketWrapper *sw)
+{
+	SupersocketListenerState *state = s->listener;
+	sw->name[PROCESS_MAX_CHARS - 1] = '\0';
+
+	PendingDiscovery *completed = NULL;
+	pthread_mutex_lock(&state->lock);
+	PendingDiscovery **link = &state->pending;
+	while(*link != NULL)
+	{
+		PendingDiscovery *p = *link;
+		if(strcmp(p->name, sw->name) != 0)
+		{
+			link = &p->next;
+			continue;
+		}
+		*link 		= p->next;
+		p->next 	= completed;
+		completed 	= p;
+	}
+	pthread_mutex_unlock(&state->lock);
+
+	if(completed == NULL)
+		return;
+
+	Display("[%s] Found %s for DiscoverSupersocketAsync()", s->name, sw->name);
+	int target = AddDiscoveredSocketWrapper(s, sw);
+
+	while(completed != NULL)
+	{
+		PendingDiscovery *p = completed;
+		completed = p->next;
+
+		if(p->callback != NULL)
+			p->callback(s, p->name, target < 0 ? -1 : target, p->userData);
+		free(p);
+	}
+}
+
+/** Anything DiscoverSupersocketAsync() was asked for that's already in the directory is done */
+static void CompleteKnownDiscoveries(Supersocket *s)
+{
+	SupersocketListenerState *state = s->listener;
+	double now = NowMilliseconds();
+
+	while(1)
+	{
+		SocketWrapper known;
+		DirectoryEntry *entry = NULL;
+
+		pthread_mutex_lock(&state->lock);
+		pthread_mutex_lock(&service.directoryLock);
+		for(PendingDiscovery *p = state->pending; p != NULL && entry == NULL; p = p->next)
+			if(p->nSent == 0)
+				entry = FindInDirectory(p->name, now);
+		if(entry != NULL)
+			known = entry->socketWrapper;
+		pthread_mutex_unlock(&service.directoryLock);
+		pthread_mutex_unlock(&state->lock);
+
+		if(entry == NULL)
+			return;
+		CompletePendingDiscoveries(s, &known);
+	}
+}
+
+/**
+Every announcePeriod, tell everyone listening on the multicast about each of our
+bound AF_INET SocketWrappers, and how long to remember them for.
+*/
+static void SendAnnouncements(Supersocket *s, SocketWrapper *requestSocketWrapper)
+{
+	SupersocketListenerState *state = s->listener;
+	double now = NowMilliseconds();
+
+	pthread_mutex_lock(&state->lock);
+	int announce = (state->announcePeriod > 0 && now >= state->nextAnnounce);
+	uint32_t lifetime = ANNOUNCE_LIFETIME_PERIODS * state->announcePeriod;
+	if(announce)
+		state->nextAnnounce = now + Jitter(state->announcePeriod, &state->seed);
+	pthread_mutex_unlock(&state->lock);
+
+	if(announce == 0)
+		return;
+
+	SendRecords(s, requestSocketWrapper->socket, requestSocketWrapper, lifetime);
+}
+
+/**
+Send target an announcement for each of our bound AF_INET SocketWrappers: its
+DiscoveryRecord, followed by lifetime. A socket bound to every interface goes out
+with the address of the one target is reached through, since 0.0.0.0 is no use
+to anyone else.
+*/
+static void SendRecords(Supersocket *s, int soc, SocketWrapper *target, uint32_t lifetime)
+{
+	uint32_t local = htonl(INADDR_ANY);
+
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+
+	char payload[sizeof(DiscoveryRecord) + sizeof(lifetime)];
+	for(int i = 0; i < table->nBoundSockets; i++)
+	{
+		SocketWrapper *sw = &table->socketWrapper[table->boundSocketsList[i]];
+		if(sw->domain != AF_INET || ParseFlags(sw->flags, MULTICAST))
+			continue;
+
+		DiscoveryRecord record;
+		CreateDiscoveryRecord(sw, &record);
+		if(record.address == htonl(INADDR_ANY))
+		{
+			if(local == htonl(INADDR_ANY))
+				local = LocalAddressTowards(&target->inetStruct);
+			record.address = local;
+		}
+
+		memcpy(payload, &record, sizeof(DiscoveryRecord));
+		memcpy(payload + sizeof(DiscoveryRecord), &lifetime, sizeof(lifetime));
+
+		Message announcement = CreateMessage(s->name, ID_SUPERSOCKET_SOCKETWRAPPER_ANNOUNCE, payload, sizeof(payload));
+		ReplyToSocketWrapper(soc, target, &announcement);
+	}
+
+	ReleaseSupersocketTable(s, epoch);
+}
+
+/**
+Remember, or refresh, a SocketWrapper another listener has announced. Our own
+announcements go in as well, so that the other Supersockets in this process
+can find us from the directory.
+*/
+static void LearnFromAnnouncement(Message *incomingMessage)
+{
+	uint32_t lifetime;
+	SocketWrapper sw;
+	if(incomingMessage->dlen < sizeof(DiscoveryRecord) + sizeof(lifetime)
+		|| ParseDiscoveryRecord(incomingMessage->data, incomingMessage->dlen, &sw) < 0)
+		return;
+
+	memcpy(&lifetime, (char *) incomingMessage->data + sizeof(DiscoveryRecord), sizeof(lifetime));
+	RememberInDirectory(&sw, lifetime);
+}
+
+/**
+Answers from the directory server have the nonce and then how much longer the server
+will vouch for them after the DiscoveryRecord, and we remember them for that long.
+Answers from listeners don't, so they're left alone.
+*/
+static void LearnFromReply(Message *incomingMessage, SocketWrapper *sw)
+{
+	uint32_t lease;
+	size_t offset = sizeof(DiscoveryRecord) + sizeof(uint32_t);
+	if(incomingMessage->dlen < offset + sizeof(lease))
+		return;
+
+	memcpy(&lease, (char *) incomingMessage->data + offset, sizeof(lease));
+	RememberInDirectory(sw, lease);
+}
+
+static void RememberInDirectory(SocketWrapper *sw, uint32_t lifetime)
+{
+	double now = NowMilliseconds();
+	pthread_mutex_lock(&service.directoryLock);
+	DirectoryEntry *entry = FindInDirectory(sw->name, now);
+	if(entry == NULL && service.nDirectory < SUPERSOCKET_DIRECTORY_SIZE)
+		entry = &service.directory[service.nDirectory++];
+
+	if(entry != NULL)
+	{
+		entry->socketWrapper 	= *sw;
+		entry->expires 			= now + lifetime;
+	}
+	pthread_mutex_unlock(&service.directoryLock);
+
+	if(entry == NULL)
+		DisplayWarning("Directory is full, not remembering %s", sw->name);
+}
+
+/**
+Every so often, renew the leases on our bound AF_INET SocketWrappers with the directory
+server, if there is one. We ask for DIRECTORY_SERVER_LEASE each time, and renew about
+ANNOUNCE_LIFETIME_PERIODS times over before it runs out, so one lost renewal doesn't matter.
+*/
+static void RegisterWithDirectoryServer(Supersocket *s, int soc)
+{
+	SocketWrapper server = {0};
+	if(GetDirectoryServer(&server.inetStruct) < 0)
+		return;
+
+	SupersocketListenerState *state = s->listener;
+	double now = NowMilliseconds();
+
+	pthread_mutex_lock(&state->lock);
+	int renew = (now >= state->nextRegistration);
+	if(renew)
+		state->nextRegistration = now + Jitter(DIRECTORY_SERVER_LEASE / ANNOUNCE_LIFETIME_PERIODS, &state->seed);
+	pthread_mutex_unlock(&state->lock);
+
+	if(renew)
+	{
+		Display("[%s] Renewing our registrations with the directory server", s->name);
+		SendRecords(s, soc, &server, DIRECTORY_SERVER_LEASE);
+	}
+}
+
+/** Copy where the directory server is into server. Returns 0 if there is one, otherwise -1. */
+static int GetDirectoryServer(struct sockaddr_in *server)
+{
+	pthread_mutex_lock(&service.directoryLock);
+	int useDirectoryServer = service.useDirectoryServer;
+	if(useDirectoryServer)
+		*server = service.directoryServer;
+	pthread_mutex_unlock(&service.directoryLock);
+
+	return useDirectoryServer ? 0 : -1;
+}
+
+/**
+The address of the interface that datagrams to target leave from. Connecting a UDP socket
+doesn't send anything, it just picks the route. Returns INADDR_ANY if there isn't one.
+*/
+static uint32_t LocalAddressTowards(struct sockaddr_in *target)
+{
+	struct sockaddr_in local = {0};
+	int soc = socket(AF_INET, SOCK_DGRAM, 0);
+	if(soc < 0 || connect(soc, (struct sockaddr *) target, sizeof(struct sockaddr_in)) < 0
+		|| PopulateSockaddr_inFromSocket(&local, soc) < 0)
+		local.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if(soc >= 0)
+		close(soc);
+	return local.sin_addr.s_addr;
+}
+
+/**
+Find a live entry for name, throwing out any that have expired on the way.
+Must be called with service.directoryLock held.
+*/
+static DirectoryEntry *FindInDirectory(char *name, double now)
+{
+	for(int i = 0; i < service.nDirectory; i++)
+	{
+		DirectoryEntry *entry = &service.directory[i];
+		if(entry->expires <= now)
+		{
+			*entry = service.directory[--service.nDirectory];
+			i--;
+			continue;
+		}
+		if(strcmp(entry->socketWrapper.name, name) == 0)
+			return entry;
+	}
+	return NULL;
+}
+
+/**
+Heartbeats and closing notices carry a uint32_t heartbeat period, then a uint32_t count
+and that many names of PROCESS_MAX_CHARS: those of our bound AF_INET SocketWrappers,
+which are what everyone else has us as a contact under. Returns the payload length.
+payload needs room for DISCOVERY_MAX_NAMES_PER_REQUEST names.
+*/
+static int CreateNameList(Supersocket *s, char *payload, uint32_t period)
+{
+	uint32_t nNames = 0;
+	char *names = payload + 2 * sizeof(uint32_t);
+
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+	for(int i = 0; i < table->nBoundSockets && nNames < DISCOVERY_MAX_NAMES_PER_REQUEST; i++)
+	{
+		SocketWrapper *sw = &table->socketWrapper[table->boundSocketsList[i]];
+		if(sw->domain != AF_INET || ParseFlags(sw->flags, MULTICAST))
+			continue;
+
+		memset(&names[nNames * PROCESS_MAX_CHARS], 0, PROCESS_MAX_CHARS);
+		strncpy(&names[nNames * PROCESS_MAX_CHARS], sw->name, PROCESS_MAX_CHARS - 1);
+		nNames++;
+	}
+	ReleaseSupersocketTable(s, epoch);
+
+	memcpy(payload, &period, sizeof(period));
+	memcpy(payload + sizeof(period), &nNames, sizeof(nNames));
+	return 2 * sizeof(uint32_t) + nNames * PROCESS_MAX_CHARS;
+}
+
+/** The other way around. Returns how many names there are, or -1 if it doesn't make sense. */
+static int ParseNameList(Message *incomingMessage, uint32_t *period, char **names)
+{
+	uint32_t nNames;
+	if(incomingMessage->dlen < 2 * sizeof(uint32_t))
+		return -1;
+
+	memcpy(period, incomingMessage->data, sizeof(*period));
+	memcpy(&nNames, (char *) incomingMessage->data + sizeof(*period), sizeof(nNames));
+	*names = (char *) incomingMessage->data + 2 * sizeof(uint32_t);
+
+	if(nNames > (incomingMessage->dlen - 2 * sizeof(uint32_t)) / PROCESS_MAX_CHARS)
+		return -1;
+
+	for(uint32_t i = 0; i < nNames; i++)
+		(*names)[(i + 1) * PROCESS_MAX_CHARS - 1] = '\0';
+
+	return nNames;
+}
+
+/**
+Every heartbeatPeriod, tell everyone we're still here. It's one small multicast however
+many peers there are, and any Message a peer gets from us counts as well.
+*/
+static void SendHeartbeat(Supersocket *s, SocketWrapper *requestSocketWrapper)
+{
+	SupersocketListenerState *state = s->listener;
+	double now = NowMilliseconds();
+
+	pthread_mutex_lock(&state->lock);
+	uint32_t period = state->heartbeatPeriod;
+	int send = (period > 0 && now >= state->nextHeartbeat);
+	if(send)
+		state->nextHeartbeat = now + Jitter(period, &state->seed);
+	pthread_mutex_unlock(&state->lock);
+
+	if(send == 0)
+		return;
+
+	char payload[2 * sizeof(uint32_t) + DISCOVERY_MAX_NAMES_PER_REQUEST * PROCESS_MAX_CHARS];
+	int length = CreateNameList(s, payload, period);
+
+	Message heartbeat = CreateMessage(s->name, ID_SUPERSOCKET_SOCKETWRAPPER_HEARTBEAT, payload, length);
+	ReplyToSocketWrapper(requestSocketWrapper->socket, requestSocketWrapper, &heartbeat);
+}
+
+static void ParseHeartbeat(Supersocket *s, Message *incomingMessage)
+{
+	SupersocketListenerState *state = s->listener;
+	uint32_t period;
+	char *names;
+
+	int nNames = ParseNameList(incomingMessage, &period, &names);
+	if(nNames < 0 || strcmp(incomingMessage->from, s->name) == 0)
+		return;
+
+	int watching = 0;
+	for(int i = 0; i < nNames; i++)
+		watching |= (RefreshSocketWrapper(s, &names[i * PROCESS_MAX_CHARS], period) >= 0);
+
+	if(watching)
+	{
+		pthread_mutex_lock(&state->lock);
+		if(state->watchingLiveness == 0)
+			state->nextLivenessCheck = NowMilliseconds();
+		state->watchingLiveness = 1;
+		pthread_mutex_unlock(&state->lock);
+	}
+}
+
+/**
+Send each of our bound AF_INET SocketWrappers out as an ID_SUPERSOCKET_SOCKETWRAPPER_UDPATE,
+UPDATE_REPEATS times, UPDATE_REPEAT_TIME apart
+*/
+static void SendUpdates(Supersocket *s, SocketWrapper *requestSocketWrapper)
+{
+	SupersocketListenerState *state = s->listener;
+	double now = NowMilliseconds();
+
+	pthread_mutex_lock(&state->lock);
+	int send = (state->nUpdatesLeft > 0 && now >= state->nextUpdate);
+	if(send)
+	{
+		state->nUpdatesLeft--;
+		state->nextUpdate = now + UPDATE_REPEAT_TIME;
+	}
+	pthread_mutex_unlock(&state->lock);
+
+	if(send == 0)
+		return;
+
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+
+	for(int i = 0; i < table->nBoundSockets; i++)
+	{
+		SocketWrapper *sw = &table->socketWrapper[table->boundSocketsList[i]];
+		if(sw->domain != AF_INET || ParseFlags(sw->flags, MULTICAST))
+			continue;
+
+		DiscoveryRecord record;
+		CreateDiscoveryRecord(sw, &record);
+
+		Message update = CreateMessage(s->name, ID_SUPERSOCKET_SOCKETWRAPPER_UDPATE, &record, sizeof(DiscoveryRecord));
+		ReplyToSocketWrapper(requestSocketWrapper->socket, requestSocketWrapper, &update);
+	}
+
+	ReleaseSupersocketTable(s, epoch);
+}
+
+/**
+Someone has come back at a new address. If we have them as a contact, swap the new
+address in, so that whatever we send them goes to the right place from now on. Only
+a contact for the same instance is theirs, or one we don't know the instance of. One
+known to be another instance's is a replica that is still there, even if it's our
+only contact of that name, so it's left alone.
+*/
+static int ParseUpdate(Supersocket *s, Message *incomingMessage)
+{
+	SocketWrapper update;
+	if(strcmp(incomingMessage->from, s->name) == 0
+		|| ParseDiscoveryRecord(incomingMessage->data, incomingMessage->dlen, &update) < 0)
+		return -1;
+
+	// Whatever was announced under the old address is out of date as well
+	pthread_mutex_lock(&service.directoryLock);
+	DirectoryEntry *entry = FindInDirectory(update.name, NowMilliseconds());
+	if(entry != NULL && (entry->socketWrapper.instance == 0 || entry->socketWrapper.instance == update.instance))
+		entry->socketWrapper = update;
+	pthread_mutex_unlock(&service.directoryLock);
+
+	PrepareDiscoveredSocketWrapper(&update);
+
+	int target = FindContactForInstance(s, update.name, update.instance, 0);
+	if(target < 0)
+		return 0;
+
+	// A connected AF_INET socket to the same address and port still works. An AF_UNIX
+	// one doesn't, because it's connected to the old socket file even if the path is the same.
+	// A SOCK_SEQPACKET connection that hasn't hung up is to whoever is there now, though,
+	// and swapping in a second one would let Messages on the two overtake each other.
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+	SocketWrapper *old = &table->socketWrapper[target];
+	struct pollfd connection = {.fd = old->socket, .events = 0};
+	int unchanged = (update.domain == AF_INET && old->domain == AF_INET
+		&& old->inetStruct.sin_port == update.inetStruct.sin_port
+		&& old->inetStruct.sin_addr.s_addr == update.inetStruct.sin_addr.s_addr)
+		|| (update.type == SOCK_SEQPACKET && old->type == SOCK_SEQPACKET && poll(&connection, 1, 0) == 0);
+	ReleaseSupersocketTable(s, epoch);
+
+	if(unchanged)
+		return 0;
+
+	return ReplaceSocketWrapper(s, target, &update);
+}
+
+/**
+Someone is shutting down, so close every contact we have for them. Replicas with the
+same name are someone else, unless the notice is too old to say which instance it's from.
+*/
+static int ParseClose(Supersocket *s, Message *incomingMessage)
+{
+	SupersocketListenerState *state = s->listener;
+	uint32_t period;
+	char *names;
+
+	int nNames = ParseNameList(incomingMessage, &period, &names);
+	if(nNames < 0 || strcmp(incomingMessage->from, s->name) == 0)
+		return -1;
+
+	uint32_t instance 	= 0;
+	size_t instanceAt 	= 2 * sizeof(uint32_t) + nNames * PROCESS_MAX_CHARS;
+	if(incomingMessage->dlen >= instanceAt + sizeof(instance))
+		memcpy(&instance, (char *) incomingMessage->data + instanceAt, sizeof(instance));
+	instance = ntohl(instance);
+
+	for(int i = 0; i < nNames; i++)
+	{
+		char *name = &names[i * PROCESS_MAX_CHARS];
+		Display("[%s] %s is closing", s->name, name);
+
+		// Forget any announcement too, so that nobody rediscovers it from the directory
+		pthread_mutex_lock(&service.directoryLock);
+		DirectoryEntry *entry = FindInDirectory(name, NowMilliseconds());
+		if(entry != NULL && (instance == 0 || entry->socketWrapper.instance == 0 || entry->socketWrapper.instance == instance))
+			entry->expires = 0;
+		pthread_mutex_unlock(&service.directoryLock);
+
+		int target;
+		while((target = FindContactForInstance(s, name, instance, 1)) >= 0)
+		{
+			RemoveSocketWrapper(s, target);
+			if(state->livenessCallback != NULL)
+				state->livenessCallback(s, target, SOCKETWRAPPER_STATUS_CLOSED, state->livenessUserData);
+		}
+	}
+	return 0;
+}
+
+/**
+Of our contacts called name, the one for instance, or failing that one whose instance
+we don't know, because it was added by hand or by a listener too old to say. With any
+set, a notice that doesn't say its instance is for every contact called name. One
+known to be another instance's never is. Returns -1 if there's none.
+*/
+static int FindContactForInstance(Supersocket *s, char *name, uint32_t instance, int any)
+{
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+
+	int found 	= -1;
+	int unknown = -1;
+	for(int i = 0; i < table->nSockets && found < 0; i++)
+	{
+		SocketWrapper *sw = &table->socketWrapper[i];
+		if(sw->status == SOCKETWRAPPER_STATUS_CLOSED || ParseFlags(sw->flags, CONNECT) == 0 || strcmp(sw->name, name) != 0)
+			continue;
+
+		if(instance != 0 && sw->instance == instance)
+			found = i;
+		else if(unknown < 0 && (sw->instance == 0 || (any && instance == 0)))
+			unknown = i;
+	}
+	ReleaseSupersocketTable(s, epoch);
+
+	return found >= 0 ? found : unknown;
+}
+
+/** Disable, enable and close contacts that send heartbeats, and tell whoever asked to know */
+static void CheckLiveness(Supersocket *s)
+{
+	SupersocketListenerState *state = s->listener;
+	double now = NowMilliseconds();
+
+	pthread_mutex_lock(&state->lock);
+	int check = (state->watchingLiveness && now >= state->nextLivenessCheck);
+	if(check)
+		state->nextLivenessCheck = now + LIVENESS_CHECK_PERIOD;
+	pthread_mutex_unlock(&state->lock);
+
+	if(check == 0)
+		return;
+
+	int targets[64];
+	int statuses[64];
+	int nChanges;
+	do
+	{
+		nChanges = CheckSocketWrapperLiveness(s, targets, statuses, 64);
+		for(int i = 0; i < nChanges; i++)
+		{
+			int epoch;
+			SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+			Display("[%s] %s is now %s", s->name, table->socketWrapper[targets[i]].name, 
+				statuses[i] == SOCKETWRAPPER_STATUS_DISABLED ? "disabled" : 
+				statuses[i] == SOCKETWRAPPER_STATUS_CLOSED   ? "closed"   : "back");
+			ReleaseSupersocketTable(s, epoch);
+
+			if(state->livenessCallback != NULL)
+				state->livenessCallback(s, targets[i], statuses[i], state->livenessUserData);
+		}
+	} while(nChanges == 64);
+}
+
+static void WakeListener(void)
+{
+	char wake = 0;
+	pthread_mutex_lock(&service.lock);
+	if(service.wakePipe[1] >= 0 && write(service.wakePipe[1], &wake, 1) < 0 && errno != EAGAIN)
+		DisplayWarning("Unable to wake the SupersocketListener: %s", strerror(errno));
+	pthread_mutex_unlock(&service.lock);
+}
+
+/**
+Put each of our bound AF_INET SocketWrappers in the PeerCache, so that other processes
+on this computer can find them without asking the network. The cache is local, so the
+listener is advertised on the loopback address. This is done again whenever the table
+changes; names that are already there just have their entries written over.
+*/
+static int PublishSupersocket(Supersocket *s, SocketWrapper *unicastSocketWrapper)
+{
+	struct sockaddr_in listener = unicastSocketWrapper->inetStruct;
+	listener.sin_addr.s_addr 	= htonl(INADDR_LOOPBACK);
+
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+	for(int i = 0; i < table->nBoundSockets; i++)
+	{
+		SocketWrapper *sw = &table->socketWrapper[table->boundSocketsList[i]];
+		if(sw->domain == AF_INET && ParseFlags(sw->flags, MULTICAST) == 0)
+			PublishToPeerCache(sw, &listener);
+	}
+	ReleaseSupersocketTable(s, epoch);
+
+	return 0;
+}
+
+
+
+static int ReplyToDiscoverBindRequest(int soc, SocketWrapper *multicastSupersocket, Message *incomingMessage)
+{
+	// This function responds to ID_SUPERSOCKET_SOCKETWRAPPER_REPLY_DISCOVERBIND as the ID input
+	// from the Message. If that is the case, then it expects that the contents of the message
+	// are a DiscoveryRecord, which contains:
+	// 	1. The "name" field is the name of the process being requested
+	// 	2. The address and port are where to send the reply
+
+	// receivedSocketWrapper is made from the record, and is the information required
+	// for sending back a message
+	SocketWrapper receivedSocketWrapper;
+	if(ParseDiscoveryRecord(incomingMessage->data, incomingMessage->dlen, &receivedSocketWrapper) < 0)
+		return -1;
+
+	char *nameRequested = receivedSocketWrapper.name;
+
+	DiscoveryRequestOptions options;
+	int hasOptions = ParseRequestOptions(incomingMessage, sizeof(DiscoveryRecord), &options);
+
+	Display("Received Request for %s", nameRequested);
+
+	return ReplyForName(soc, &receivedSocketWrapper, nameRequested, incomingMessage->from, hasOptions ? &options : NULL) > 0 ? 0 : 1;
+}
+
+/**
+Same as ReplyToDiscoverBindRequest(), except the DiscoveryRecord is followed by a uint32_t
+count and that many names, each PROCESS_MAX_CHARS long. We answer for every one of them
+that we have, each with its own ordinary reply.
+*/
+static int ReplyToDiscoverBindManyRequest(int soc, Message *incomingMessage)
+{
+	uint32_t nNames;
+	size_t headerLength = sizeof(DiscoveryRecord) + sizeof(nNames);
+	SocketWrapper receivedSocketWrapper;
+	if(incomingMessage->dlen < headerLength
+		|| ParseDiscoveryRecord(incomingMessage->data, incomingMessage->dlen, &receivedSocketWrapper) < 0)
+		return -1;
+
+	char *names = (char *) incomingMessage->data + headerLength;
+	memcpy(&nNames, (char *) incomingMessage->data + sizeof(DiscoveryRecord), sizeof(nNames));
+
+	if(nNames > (incomingMessage->dlen - headerLength) / PROCESS_MAX_CHARS)
+		return -1;
+
+	DiscoveryRequestOptions options;
+	int hasOptions = ParseRequestOptions(incomingMessage, headerLength + nNames * PROCESS_MAX_CHARS, &options);
+
+	Display("Received Request for %u names", nNames);
+
+	int nReplies = 0;
+	for(uint32_t i = 0; i < nNames; i++)
+	{
+		char *nameRequested = &names[i * PROCESS_MAX_CHARS];
+		nameRequested[PROCESS_MAX_CHARS - 1] = '\0';
+
+		nReplies += ReplyForName(soc, &receivedSocketWrapper, nameRequested, incomingMessage->from, hasOptions ? &options : NULL);
+	}
+	return nReplies;
+}
+
+/**
+Answer for nameRequested from every Supersocket in this process that has it bound.
+A name ending in '*' is a prefix, and we answer for every bound name that starts
+with it. Only the Supersockets that have the name are asked about it, through the
+name index, except for a prefix, which has to look at all of the names in it.
+Returns how many answers went out, or were queued to go out.
+*/
+static int ReplyForName(int soc, SocketWrapper *replyTo, char *nameRequested, char *from, DiscoveryRequestOptions *options)
+{
+	int nReplies = 0;
+	if(IsPrefix(nameRequested) == 0)
+	{
+		Supersocket *found[SUPERSOCKET_LISTENER_MAX_SUPERSOCKETS];
+		int nFound = FindListenerSupersockets(nameRequested, found);
+		for(int i = 0; i < nFound; i++)
+			nReplies += (ReplyIfBound(soc, found[i], replyTo, nameRequested, from, options) == 0);
+		return nReplies;
+	}
+
+	size_t length = strlen(nameRequested) - 1;
+	uint32_t mask = service.namesSize - 1;
+	for(int i = 0; i < service.namesSize; i++)
+	{
+		ListenerName *entry = &service.names[i];
+		if(entry->s == NULL || strncmp(entry->name, nameRequested, length) != 0)
+			continue;
+
+		// The same Supersocket can have the name bound more than once. We answer for the
+		// copy that comes first along the name's probe sequence, so that's all we look at.
+		int seen = 0;
+		for(uint32_t slot = HashListenerName(entry->name) & mask; slot != (uint32_t) i; slot = (slot + 1) & mask)
+			seen |= (service.names[slot].s == entry->s && strcmp(service.names[slot].name, entry->name) == 0);
+
+		if(seen == 0)
+			nReplies += (ReplyIfBound(soc, entry->s, replyTo, entry->name, from, options) == 0);
+	}
+	return nReplies;
+}
+
+/** Whether name is a prefix, like "Decoder*", rather than a name */
+static int IsPrefix(char *name)
+{
+	size_t length = strlen(name);
+	return length > 0 && name[length - 1] == '*';
+}
+
+static int ReplyIfBound(int soc, Supersocket *s, SocketWrapper *replyTo, char *nameRequested, char *from, DiscoveryRequestOptions *options)
+{
+	// Now we look up whether Supersocket s has a socket bound with the requested name.
+	// It has to be AF_INET, because the discovery is assumed to work on AF_INET.
+	// Every process on the network gets every request, so this is a hash lookup
+	// rather than a search through all of the bound sockets.
+	int socketWrapperIndex = FindSocketWrapperByName(s, nameRequested, BIND, AF_INET);
+
+	// Otherwise it may be a topic we publish, in which case the answer is its group
+	if(socketWrapperIndex < 0)
+		socketWrapperIndex = FindSocketWrapperByName(s, nameRequested, MULTICAST, AF_INET);
+	if(socketWrapperIndex < 0)
+		return 1;
+
+	// If a match occurs, then we are going to reply using the SocketWrapper information
+	// from the match! We populate our reply message as follows:
+	Display("[%s] I am %s! Replying to [%s]...", s->name, nameRequested, from);
+
+	DiscoveryRecord record;
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+	CreateDiscoveryRecord(&table->socketWrapper[socketWrapperIndex], &record);
+	ReleaseSupersocketTable(s, epoch);
+
+	// If the requester expects a crowd, we wait our turn
+	if(options != NULL && options->spread != 0)
+		DelayReply(soc, &record, replyTo, options);
+	else
+		SendReply(soc, &replyTo->inetStruct, &record, options);
+
+	return 0;
+}
+
+/** Read the DiscoveryRequestOptions at offset, if there are any. Returns 1 if there were, otherwise 0. */
+static int ParseRequestOptions(Message *incomingMessage, size_t offset, DiscoveryRequestOptions *options)
+{
+	if(incomingMessage->dlen < offset + sizeof(DiscoveryRequestOptions))
+		return 0;
+
+	memcpy(options, (char *) incomingMessage->data + offset, sizeof(DiscoveryRequestOptions));
+	return 1;
+}
+
+/** The record, and the nonce of the request it answers if it had one */
+static int SendReply(int soc, struct sockaddr_in *replyTo, DiscoveryRecord *record, DiscoveryRequestOptions *options)
+{
+	char payload[sizeof(DiscoveryRecord) + sizeof(uint32_t)];
+	memcpy(payload, record, sizeof(DiscoveryRecord));
+	if(options != NULL)
+		memcpy(payload + sizeof(DiscoveryRecord), &options->nonce, sizeof(uint32_t));
+
+	SocketWrapper target = {0};
+	target.inetStruct = *replyTo;
+
+	Message replyMessage = CreateMessage(record->name, ID_SUPERSOCKET_SOCKETWRAPPER_REPLY_DISCOVERBIND, 
+		payload, sizeof(DiscoveryRecord) + (options != NULL ? sizeof(uint32_t) : 0));
+	return ReplyToSocketWrapper(soc, &target, &replyMessage);
+}
+
+/**
+Hold on to an answer for a random while, up to DISCOVERY_REPLY_SPREAD_PER_PEER for every
+listener we've heard lately. If the requester asks again before then, it's the same
+answer, so it isn't queued twice. If there's no room, it goes straight away.
+*/
+static void DelayReply(int soc, DiscoveryRecord *record, SocketWrapper *replyTo, DiscoveryRequestOptions *options)
+{
+	for(int i = 0; i < service.nDelayed; i++)
+		if(service.delayed[i].nonce == options->nonce && strcmp(service.delayed[i].record.name, record->name) == 0
+			&& service.delayed[i].record.port == record->port && service.delayed[i].record.address == record->address)
+			return;
+
+	if(service.nDelayed == DISCOVERY_MAX_DELAYED_REPLIES)
+	{
+		SendReply(soc, &replyTo->inetStruct, record, options);
+		return;
+	}
+
+	int spread = EstimateGroupSize() * DISCOVERY_REPLY_SPREAD_PER_PEER / 1000;
+	if(spread > DISCOVERY_MAX_REPLY_SPREAD)
+		spread = DISCOVERY_MAX_REPLY_SPREAD;
+
+	DelayedReply *d = &service.delayed[service.nDelayed++];
+	d->record 		= *record;
+	d->replyTo 		= replyTo->inetStruct;
+	d->nonce 		= options->nonce;
+	d->maxReplies 	= ntohs(options->maxReplies);
+	d->overheard 	= 0;
+	d->due 			= NowMilliseconds() + rand_r(&service.seed) % (spread + 1);
+}
+
+/**
+Send every held back answer whose time has come, unless enough of the others have
+answered already. The copy that goes to the other listeners is what lets them know.
+*/
+static void SendDelayedReplies(int soc, SocketWrapper *requestSocketWrapper)
+{
+	double now = NowMilliseconds();
+	for(int i = 0; i < service.nDelayed; i++)
+	{
+		DelayedReply *d = &service.delayed[i];
+		if(d->due > now)
+			continue;
+
+		if(d->maxReplies == 0 || d->overheard < d->maxReplies)
+		{
+			DiscoveryRequestOptions options = {.nonce = d->nonce};
+			SendReply(soc, &d->replyTo, &d->record, &options);
+			SendReply(soc, &requestSocketWrapper->inetStruct, &d->record, &options);
+		}
+		else
+			Display("%s already has enough answers, not sending ours", d->record.name);
+
+		service.delayed[i--] = service.delayed[--service.nDelayed];
+	}
+}
+
+/** Someone else answered a request. If we're holding back an answer to the same one, count it. */
+static void OverhearReply(Message *incomingMessage)
+{
+	uint32_t nonce;
+	if(incomingMessage->dlen < sizeof(DiscoveryRecord) + sizeof(nonce))
+		return;
+
+	DiscoveryRecord *record = incomingMessage->data;
+	memcpy(&nonce, (char *) incomingMessage->data + sizeof(DiscoveryRecord), sizeof(nonce));
+
+	for(int i = 0; i < service.nDelayed; i++)
+		if(service.delayed[i].nonce == nonce && strncmp(service.delayed[i].record.name, record->name, PROCESS_MAX_CHARS) == 0)
+			service.delayed[i].overheard++;
+}
+
+/** How long until the next held back answer is due, or -1 if there isn't one */
+static int NextDelayedTimeout(void)
+{
+	double next = -1;
+	for(int i = 0; i < service.nDelayed; i++)
+		if(next < 0 || service.delayed[i].due < next)
+			next = service.delayed[i].due;
+
+	if(next < 0)
+		return -1;
+
+	double wait = next - NowMilliseconds();
+	return wait > 0 ? (int) wait + 1 : 0;
+}
+
+/** Remember that we've heard from name on the multicast just now */
+static void NotePeer(char *name)
+{
+	service.peerLastHeard[HashListenerName(name) % LISTENER_PEER_SLOTS] = NowMilliseconds();
+}
+
+/** About how many listeners we've heard from lately, ourselves included */
+static int EstimateGroupSize(void)
+{
+	double since = NowMilliseconds() - DISCOVERY_GROUP_LIFETIME;
+	int n = 0;
+	for(int i = 0; i < LISTENER_PEER_SLOTS; i++)
+		n += (service.peerLastHeard[i] > since);
+	return n > 0 ? n : 1;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+
+int DiscoverSupersocket(Supersocket *s, char *name)
+{
+	int integerOfNewSocketWrapper = -1;
+	DiscoverSupersockets(s, &name, 1, &integerOfNewSocketWrapper, -1);
+
+	return integerOfNewSocketWrapper;
+}
+
+int DiscoverSupersockets(Supersocket *s, char **names, int n, int *indices, int milliseconds)
+{
+	// We first create a SocketWrapper that we are going to use for sending
+	// requests out on the multicast, or to the directory server if there is one.
+	// This is the requestSocketWrapper
+	//
+	// Next we are going to create a socketWrapper that we are going to BIND
+	// and listen to. This is the dataPayload. It's called this because
+	// it's exactly the same SocketWrapper that is going to be sent out
+	// on the Multicast network as the .data portion of the Message
+	SocketWrapper requestSocketWrapper = {0};
+	SocketWrapper dataPayload = {0};
+	OpenDiscoverySockets(names[0], &requestSocketWrapper, &dataPayload);
+
+	// messageReply is a buffer fora new message we will be receiving
+	Message messageReply = CreateMessageBuffer(2000);
+
+	for(int i = 0; i < n; i++)
+		indices[i] = -1;
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// Anything our listener has heard announced doesn't need asking for at all
+	int nFound = 0;
+	for(int i = 0; i < n; i++)
+	{
+		SocketWrapper known;
+		if(LookUpSupersocketDirectory(s, names[i], &known) < 0)
+			continue;
+
+		Display("[%s] %s has been announced, no need to ask for it", s->name, names[i]);
+		indices[i] = AddDiscoveredSocketWrapper(s, &known);
+		if(indices[i] < 0)
+			indices[i] = -2;
+		nFound++;
+	}
+
+	// If a process on this computer has published a name, ask its listener directly.
+	// This takes one round trip on the loopback interface instead of a multicast, and
+	// all of the cached names are asked for at once.
+	pid_t *cachedPid = calloc(n, sizeof(pid_t));
+	int nCached = 0;
+	for(int i = 0; i < n && cachedPid != NULL; i++)
+	{
+		PeerCacheEntry cached;
+		if(indices[i] != -1 || LookUpPeerCache(names[i], &cached) < 0)
+			continue;
+
+		Display("[%s] Found %s in the peer cache, checking it's still there", s->name, names[i]);
+		SocketWrapper cachedListener = {0};
+		cachedListener.inetStruct = cached.listener;
+		SendDiscoveryRequest(s, requestSocketWrapper.socket, &cachedListener, &dataPayload, &names[i], 1, NULL);
+
+		cachedPid[i] = cached.pid;
+		nCached++;
+	}
+
+	if(nCached > 0)
+	{
+		int found = ReceiveDiscoveryReplies(s, names, n, indices, &dataPayload, &messageReply, PEER_CACHE_PROBE_TIME);
+		nFound += found > 0 ? found : 0;
+
+		for(int i = 0; i < n; i++)
+			if(cachedPid[i] != 0 && indices[i] == -1)
+			{
+				Display("[%s] %s did not answer, forgetting the cached entry", s->name, names[i]);
+				RemoveFromPeerCache(names[i], cachedPid[i]);
+			}
+	}
+	free(cachedPid);
+
+	// Everyone we haven't heard from yet gets asked for on the multicast network (or of
+	// the directory server), in a single request, until they've all answered or we run
+	// out of time. Each time nobody answers we wait about twice as long before asking again.
+	unsigned int seed 	= getpid() ^ (unsigned int) start.tv_nsec;
+	int backoff 		= POLL_TIME_FOR_DISCOVERY;
+	char **remaining 	= calloc(n, sizeof(char *));
+	while (nFound < n && remaining != NULL)
+	{
+		int wait = Jitter(backoff, &seed);
+		backoff  = NextBackoff(backoff);
+		if(milliseconds >= 0)
+		{
+			int timeLeft = milliseconds - (int) ElapsedMilliseconds(&start);
+			if(timeLeft <= 0)
+				break;
+			wait = timeLeft < wait ? timeLeft : wait;
+		}
+
+		int nRemaining = 0;
+		for(int i = 0; i < n; i++)
+			if(indices[i] == -1)
+				remaining[nRemaining++] = names[i];
+
+		Display("[%s] Sending out a request for %d names, starting with %s", s->name, nRemaining, remaining[0]);
+		SendDiscoveryRequest(s, requestSocketWrapper.socket, &requestSocketWrapper, &dataPayload, remaining, nRemaining, NULL);
+
+		int found = ReceiveDiscoveryReplies(s, names, n, indices, &dataPayload, &messageReply, wait);
+		if(found < 0)
+			break;
+		nFound += found;
+	}
+	free(remaining);
+
+	// Names that answered but couldn't be added were only marked -2 to stop us asking again
+	int nAdded = 0;
+	for(int i = 0; i < n; i++)
+	{
+		if(indices[i] < 0)
+			indices[i] = -1;
+		else
+			nAdded++;
+	}
+
+	DestroyMessageBuffer(&messageReply);
+	CloseSocketWrapper(&requestSocketWrapper);
+	CloseSocketWrapper(&dataPayload);
+	return nAdded;
+}
+
+int DiscoverSupersocketTimeout(Supersocket *s, char *name, int milliseconds)
+{
+	int integerOfNewSocketWrapper = -1;
+	DiscoverSupersockets(s, &name, 1, &integerOfNewSocketWrapper, milliseconds);
+
+	return integerOfNewSocketWrapper < 0 ? -1 : integerOfNewSocketWrapper;
+}
+
+int DiscoverSupersocketReplicas(Supersocket *s, char *name, int *indices, int maxReplies, int milliseconds)
+{
+	if(maxReplies < 1 || maxReplies > UINT16_MAX)
+	{
+		DisplayError("[%s] Can't ask for %d replicas of %s", s->name, maxReplies, name);
+		return -1;
+	}
+
+	SocketWrapper *found = calloc(maxReplies, sizeof(SocketWrapper));
+	if(found == NULL)
+	{
+		DisplayError("[%s] Unable to allocate room for %d replicas of %s", s->name, maxReplies, name);
+		return -1;
+	}
+
+	for(int i = 0; i < maxReplies; i++)
+		indices[i] = -1;
+
+	// Everyone answering for the name counts towards maxReplies, so we keep asking until
+	// we have them all. Replicas on the same computer would all have the one AF_UNIX
+	// path between them, so they're reached over AF_INET.
+	int nFound = CollectDiscoveryReplies(s, name, found, maxReplies, maxReplies, 1, milliseconds);
+	for(int i = 0; i < nFound; i++)
+	{
+		found[i].domain = AF_INET;
+		PrepareDiscoveredSocketWrapper(&found[i]);
+	}
+	if(nFound > 0)
+		AddSocketWrappers(s, found, nFound, indices);
+
+	free(found);
+	return nFound;
+}
+
+int DiscoverSupersocketsByPrefix(Supersocket *s, char *prefix, SocketWrapper *found, int *indices, int maxFound, int milliseconds)
+{
+	if(IsPrefix(prefix) == 0 || strlen(prefix) >= PROCESS_MAX_CHARS || maxFound < 1 || milliseconds < 0)
+	{
+		DisplayError("[%s] Can't look for %d names starting with %s in %d ms", s->name, maxFound, prefix, milliseconds);
+		return -1;
+	}
+
+	// We can't know when everyone has answered, so we ask once and listen for as long as we're allowed
+	int nFound = CollectDiscoveryReplies(s, prefix, found, maxFound, 0, 0, milliseconds);
+	if(indices == NULL || nFound <= 0)
+		return nFound;
+
+	SocketWrapper *contacts = malloc(nFound * sizeof(SocketWrapper));
+	if(contacts == NULL)
+	{
+		DisplayError("[%s] Unable to allocate room for %d contacts", s->name, nFound);
+		return -1;
+	}
+
+	memcpy(contacts, found, nFound * sizeof(SocketWrapper));
+	for(int i = 0; i < nFound; i++)
+		PrepareDiscoveredSocketWrapper(&contacts[i]);
+	AddSocketWrappers(s, contacts, nFound, indices);
+
+	free(contacts);
+	return nFound;
+}
+
+int DiscoverSupersocketAsync(Supersocket *s, char *name, int milliseconds, DiscoveryCallback callback, void *userData)
+{
+	SupersocketListenerState *state = s->listener;
+	if(state == NULL)
+	{
+		DisplayError("[%s] DiscoverSupersocketAsync() needs the SupersocketListener to be running", s->name);
+		return -1;
+	}
+
+	PendingDiscovery *p = calloc(1, sizeof(PendingDiscovery));
+	if(p == NULL)
+	{
+		DisplayError("[%s] Unable to allocate a pending discovery for %s", s->name, name);
+		return -1;
+	}
+
+	double now 		= NowMilliseconds();
+	strncpy(p->name, name, PROCESS_MAX_CHARS - 1);
+	p->callback 	= callback;
+	p->userData 	= userData;
+	p->deadline 	= milliseconds < 0 ? -1 : now + milliseconds;
+	p->nextSend 	= now;
+	p->backoff 		= POLL_TIME_FOR_DISCOVERY;
+
+	// Once the listener has been stopped there is nobody left to complete it
+	pthread_mutex_lock(&state->lock);
+	if(state->registered == 0)
+	{
+		pthread_mutex_unlock(&state->lock);
+		free(p);
+		DisplayError("[%s] DiscoverSupersocketAsync() needs the SupersocketListener to be running", s->name);
+		return -1;
+	}
+	p->next 		= state->pending;
+	state->pending 	= p;
+	pthread_mutex_unlock(&state->lock);
+
+	// Wake the listener up, so that it sends the first request now rather than
+	// whenever it next looks up from poll()
+	WakeListener();
+
+	return 0;
+}
+
+int EnableSupersocketAnnouncements(Supersocket *s, int milliseconds)
+{
+	if(CreateListenerState(s) < 0)
+		return -1;
+
+	SupersocketListenerState *state = s->listener;
+	pthread_mutex_lock(&state->lock);
+	state->announcePeriod 	= milliseconds > 0 ? milliseconds : 0;
+	state->nextAnnounce 	= NowMilliseconds();
+	pthread_mutex_unlock(&state->lock);
+
+	WakeListener();
+
+	return 0;
+}
+
+int EnableSupersocketHeartbeats(Supersocket *s, int milliseconds)
+{
+	if(CreateListenerState(s) < 0)
+		return -1;
+
+	SupersocketListenerState *state = s->listener;
+	pthread_mutex_lock(&state->lock);
+	state->heartbeatPeriod 	= milliseconds > 0 ? milliseconds : 0;
+	state->nextHeartbeat 	= NowMilliseconds();
+	pthread_mutex_unlock(&state->lock);
+
+	WakeListener();
+	return 0;
+}
+
+int SetSupersocketLivenessCallback(Supersocket *s, LivenessCallback callback, void *userData)
+{
+	if(CreateListenerState(s) < 0)
+		return -1;
+
+	SupersocketListenerState *state = s->listener;
+	pthread_mutex_lock(&state->lock);
+	state->livenessCallback = callback;
+	state->livenessUserData = userData;
+	pthread_mutex_unlock(&state->lock);
+
+	return 0;
+}
+
+int AnnounceSupersocketClose(Supersocket *s)
+{
+	SocketWrapper multicastSocketWrapper = {0};
+	InitializeMulticastSocketWrapper(&multicastSocketWrapper, CONNECT | MULTICAST);
+
+	char payload[3 * sizeof(uint32_t) + DISCOVERY_MAX_NAMES_PER_REQUEST * PROCESS_MAX_CHARS];
+	int length = CreateNameList(s, payload, 0);
+
+	// So that replicas with the same names are left alone
+	uint32_t instance = htonl(Instance());
+	memcpy(payload + length, &instance, sizeof(instance));
+	length += sizeof(instance);
+
+	Message notice = CreateMessage(s->name, ID_SUPERSOCKET_SOCKETWRAPPER_CLOSE, payload, length);
+	int output = ReplyToSocketWrapper(multicastSocketWrapper.socket, &multicastSocketWrapper, &notice);
+
+	CloseSocketWrapper(&multicastSocketWrapper);
+	return output < 0 ? -1 : 0;
+}
+
+int SetSupersocketDirectoryServer(char *ip, int port)
+{
+	struct sockaddr_in server = {0};
+	if(ip != NULL && (PopulateSockaddr_in(&server, ip, port) < 0 || server.sin_addr.s_addr == INADDR_NONE))
+	{
+		DisplayError("Unable to use %s:%d as the directory server", ip, port);
+		return -1;
+	}
+
+	pthread_mutex_lock(&service.directoryLock);
+	service.useDirectoryServer 	= (ip != NULL);
+	service.directoryServer 	= server;
+	pthread_mutex_unlock(&service.directoryLock);
+
+	// Everyone we're serving registers with the new server straight away
+	pthread_mutex_lock(&service.lock);
+	double now = NowMilliseconds();
+	for(int i = 0; i < service.nSupersockets; i++)
+	{
+		SupersocketListenerState *state = service.supersockets[i]->listener;
+		pthread_mutex_lock(&state->lock);
+		state->nextRegistration = now;
+		pthread_mutex_unlock(&state->lock);
+	}
+	pthread_mutex_unlock(&service.lock);
+
+	WakeListener();
+	return 0;
+}
+
+int LookUpSupersocketDirectory(Supersocket *s, char *name, SocketWrapper *sw)
+{
+	pthread_mutex_lock(&service.directoryLock);
+	DirectoryEntry *entry = FindInDirectory(name, NowMilliseconds());
+	if(entry != NULL)
+		*sw = entry->socketWrapper;
+	pthread_mutex_unlock(&service.directoryLock);
+
+	return entry != NULL ? 0 : -1;
+}
+
+/**
+Send a request for names to the address in target. A single name goes out as an
+ordinary ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND, which every listener
+understands. Several names go out as ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND_MANY,
+split over as many datagrams as it takes. options, if there are any, go after the names.
+*/
+static int SendDiscoveryRequest(Supersocket *s, int soc, SocketWrapper *target, SocketWrapper *dataPayload, char **names, int n, DiscoveryRequestOptions *options)
+{
+	DiscoveryRecord request;
+	CreateDiscoveryRecord(dataPayload, &request);
+	size_t optionsLength = options != NULL ? sizeof(DiscoveryRequestOptions) : 0;
+
+	if(n == 1)
+	{
+		char payload[sizeof(DiscoveryRecord) + sizeof(DiscoveryRequestOptions)];
+		memset(request.name, 0, PROCESS_MAX_CHARS);
+		strncpy(request.name, names[0], PROCESS_MAX_CHARS - 1);
+		memcpy(payload, &request, sizeof(DiscoveryRecord));
+		if(options != NULL)
+			memcpy(payload + sizeof(DiscoveryRecord), options, optionsLength);
+
+		Message messageRequest = CreateMessage(s->name, ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND, payload, sizeof(DiscoveryRecord) + optionsLength);
+		return ReplyToSocketWrapper(soc, target, &messageRequest);
+	}
+
+	char payload[sizeof(DiscoveryRecord) + sizeof(uint32_t) + DISCOVERY_MAX_NAMES_PER_REQUEST * PROCESS_MAX_CHARS + sizeof(DiscoveryRequestOptions)];
+	for(int first = 0; first < n; first += DISCOVERY_MAX_NAMES_PER_REQUEST)
+	{
+		uint32_t nNames = (n - first < DISCOVERY_MAX_NAMES_PER_REQUEST) ? n - first : DISCOVERY_MAX_NAMES_PER_REQUEST;
+		char *names_ = payload + sizeof(DiscoveryRecord) + sizeof(nNames);
+
+		memset(payload, 0, sizeof(payload));
+		memcpy(payload, &request, sizeof(DiscoveryRecord));
+		memcpy(payload + sizeof(DiscoveryRecord), &nNames, sizeof(nNames));
+		for(uint32_t i = 0; i < nNames; i++)
+			strncpy(&names_[i * PROCESS_MAX_CHARS], names[first + i], PROCESS_MAX_CHARS - 1);
+		if(options != NULL)
+			memcpy(&names_[nNames * PROCESS_MAX_CHARS], options, optionsLength);
+
+		Message messageRequest = CreateMessage(s->name, ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND_MANY, 
+			payload, sizeof(DiscoveryRecord) + sizeof(nNames) + nNames * PROCESS_MAX_CHARS + optionsLength);
+		if(ReplyToSocketWrapper(soc, target, &messageRequest) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/**
+Wait on dataPayload for replies to our request for names, and add them to the Supersocket.
+
+Now we sit and poll whether there are any new messages, for at most milliseconds in
+total, however many unrelated messages turn up in the meantime.
+When there is at least one new message, we parse it. If it matches the
+ID_SUPERSOCKET_SOCKETWRAPPER_REPLY_DISCOVERBIND then we check to see if it's
+in fact one of the names we want. If so, then we add it to the Supersocket s and note
+its index in indices[]. We stop once every name has an index or nothing arrives in time.
+Returns how many names were found, or -1 if polling itself failed.
+*/
+static int ReceiveDiscoveryReplies(Supersocket *s, char **names, int n, int *indices, SocketWrapper *dataPayload, Message *messageReply, int milliseconds)
+{
+	int nMessages;
+	int nFound 	 = 0;
+	int capacity = messageReply->dlen;
+
+	int nWanted = 0;
+	for(int i = 0; i < n; i++)
+		nWanted += (indices[i] == -1);
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while(nFound < nWanted)
+	{
+		int timeLeft = milliseconds - (int) ElapsedMilliseconds(&start);
+		if(timeLeft <= 0 || (nMessages = PollSocketWrapper(dataPayload, timeLeft)) == 0)
+			break;
+
+		if(nMessages < 0)
+		{
+			DisplayError("[%s] Unable to poll SocketWrapper: %s",  s->name, strerror(errno));		
+			return -1;
+		}	
+
+		messageReply->dlen = capacity;
+		if(ReceiveMessageFromSocketWrapper(dataPayload, messageReply) < 0)
+			continue;
+
+		SocketWrapper sw;
+		if(messageReply->id != ID_SUPERSOCKET_SOCKETWRAPPER_REPLY_DISCOVERBIND
+			|| ParseDiscoveryRecord(messageReply->data, messageReply->dlen, &sw) < 0)
+			continue;
+
+		Display("[%s] Received a reply to the Discovery from %s", s->name, messageReply->from);
+		LearnFromReply(messageReply, &sw);
+
+		for(int i = 0; i < n; i++)
+		{
+			if(indices[i] != -1 || strcmp(sw.name, names[i]) != 0)
+				continue;
+
+			// Leave it at -2 if it can't be added, so that we don't keep asking for it
+			indices[i] = AddDiscoveredSocketWrapper(s, &sw);
+			if(indices[i] < 0)
+				indices[i] = -2;
+
+			nFound++;
+			break;
+		}
+	}
+
+	return nFound;
+}
+
+/**
+Ask for pattern, a name or a prefix, with the answers spread out, and put up to maxFound
+of the bound SocketWrappers that answer in found. maxReplies is how many answers each
+name should get (0 for everyone). If repeat is set we ask again, backing off, until we
+have maxFound or run out of time, and otherwise just the once. Anyone who answers twice
+is only counted once, and answers to anything but our request are ignored. Returns how
+many were found.
+*/
+static int CollectDiscoveryReplies(Supersocket *s, char *pattern, SocketWrapper *found, int maxFound, int maxReplies, int repeat, int milliseconds)
+{
+	SocketWrapper requestSocketWrapper = {0};
+	SocketWrapper dataPayload = {0};
+	OpenDiscoverySockets(pattern, &requestSocketWrapper, &dataPayload);
+
+	Message messageReply = CreateMessageBuffer(2000);
+	int capacity 		 = messageReply.dlen;
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// The same nonce every time we ask, so that listeners who overheard an answer
+	// the first time around still count it
+	unsigned int seed 				= getpid() ^ (unsigned int) start.tv_nsec;
+	DiscoveryRequestOptions options = {
+		.nonce 		= rand_r(&seed),
+		.maxReplies = htons(maxReplies),
+		.spread 	= 1
+	};
+
+	// Answers take up to DISCOVERY_MAX_REPLY_SPREAD to arrive, so we never ask again sooner than that
+	int backoff 	= POLL_TIME_FOR_DISCOVERY > 2 * DISCOVERY_MAX_REPLY_SPREAD ? POLL_TIME_FOR_DISCOVERY : 2 * DISCOVERY_MAX_REPLY_SPREAD;
+	double nextSend = 0;
+	size_t length 	= IsPrefix(pattern) ? strlen(pattern) - 1 : PROCESS_MAX_CHARS;
+	int nFound 		= 0;
+	while(nFound < maxFound)
+	{
+		double elapsed = ElapsedMilliseconds(&start);
+		if(milliseconds >= 0 && elapsed >= milliseconds)
+			break;
+
+		if(nextSend >= 0 && elapsed >= nextSend)
+		{
+			Display("[%s] Sending out a request for %s", s->name, pattern);
+			SendDiscoveryRequest(s, requestSocketWrapper.socket, &requestSocketWrapper, &dataPayload, &pattern, 1, &options);
+			nextSend = repeat ? elapsed + backoff : -1;
+			backoff  = NextBackoff(backoff);
+		}
+
+		int wait = nextSend < 0 ? -1 : (int) (nextSend - elapsed) + 1;
+		if(milliseconds >= 0 && (wait < 0 || wait > milliseconds - (int) elapsed))
+			wait = milliseconds - (int) elapsed;
+
+		int nMessages = PollSocketWrapper(&dataPayload, wait);
+		if(nMessages < 0)
+		{
+			DisplayError("[%s] Unable to poll SocketWrapper: %s",  s->name, strerror(errno));		
+			break;
+		}
+		if(nMessages == 0)
+			continue;
+
+		messageReply.dlen = capacity;
+		if(ReceiveMessageFromSocketWrapper(&dataPayload, &messageReply) < 0)
+			continue;
+
+		uint32_t nonce;
+		SocketWrapper sw;
+		if(messageReply.id != ID_SUPERSOCKET_SOCKETWRAPPER_REPLY_DISCOVERBIND
+			|| messageReply.dlen < sizeof(DiscoveryRecord) + sizeof(nonce)
+			|| ParseDiscoveryRecord(messageReply.data, messageReply.dlen, &sw) < 0)
+			continue;
+
+		memcpy(&nonce, (char *) messageReply.data + sizeof(DiscoveryRecord), sizeof(nonce));
+		if(nonce != options.nonce || strncmp(sw.name, pattern, length) != 0)
+			continue;
+
+		int seen = 0;
+		for(int i = 0; i < nFound; i++)
+			seen |= (strcmp(found[i].name, sw.name) == 0
+				&& found[i].inetStruct.sin_addr.s_addr == sw.inetStruct.sin_addr.s_addr
+				&& found[i].inetStruct.sin_port == sw.inetStruct.sin_port);
+		if(seen)
+			continue;
+
+		Display("[%s] %s answered for %s", s->name, sw.name, pattern);
+		LearnFromReply(&messageReply, &sw);
+		found[nFound++] = sw;
+	}
+
+	DestroyMessageBuffer(&messageReply);
+	CloseSocketWrapper(&requestSocketWrapper);
+	CloseSocketWrapper(&dataPayload);
+	return nFound;
+}
+
+/**
+Set up requestSocketWrapper for sending discovery requests, and dataPayload to take the
+answers on. Normally requests go out on the multicast and the answers come back on
+it. With a directory server, requests go to the server and the answers come back
+over unicast, to the address of the interface that reaches the server.
+*/
+static void OpenDiscoverySockets(char *name, SocketWrapper *requestSocketWrapper, SocketWrapper *dataPayload)
+{
+	struct sockaddr_in server;
+	if(GetDirectoryServer(&server) < 0)
+	{
+		InitializeMulticastSocketWrapper(requestSocketWrapper, CONNECT | MULTICAST);
+		PopulateSocketWrapper(dataPayload, name, DEFAULT_ESPA_MULTICAST_IP, 0, AF_INET, SOCK_DGRAM, BIND | MULTICAST);
+		InitializeSocketWrapper(dataPayload);
+		return;
+	}
+
+	PopulateSocketWrapper(requestSocketWrapper, DIRECTORY_SERVER_CLIENT_NAME, "0.0.0.0", 0, AF_INET, SOCK_DGRAM, 0);
+	InitializeSocketWrapper(requestSocketWrapper);
+	requestSocketWrapper->inetStruct = server;
+
+	PopulateSocketWrapper(dataPayload, name, "0.0.0.0", 0, AF_INET, SOCK_DGRAM, BIND);
+	InitializeSocketWrapper(dataPayload);
+	dataPayload->inetStruct.sin_addr.s_addr = LocalAddressTowards(&server);
+}
+
+static int AddDiscoveredSocketWrapper(Supersocket *s, SocketWrapper *sw)
+{
+	// If we've come this far, then we are going to add the new information
+	// to the Supersocket.
+	PrepareDiscoveredSocketWrapper(sw);
+	Display("[%s] Attempting to add %s to the Supersocket!", s->name, sw->name);
+
+	int integerOfNewSocketWrapper = AddSocketWrapper(s, sw);
+	if(integerOfNewSocketWrapper >= 0)
+		Display("[%s] Added %s to the Supersocket!", s->name, sw->name);
+
+	return integerOfNewSocketWrapper;
+}
+
+/**
+Turn a bound SocketWrapper that we've been told about into a contact. Whether it's
+reached over AF_UNIX was already settled when its DiscoveryRecord was parsed, and if
+it is, its capabilities say how (see SetSupersocketLocalTransport()). A topic's group
+is joined instead, so that whatever is published on it arrives with everything else.
+*/
+static void PrepareDiscoveredSocketWrapper(SocketWrapper *sw)
+{
+	if(sw->capabilities & SOCKETWRAPPER_CAPABILITY_TOPIC)
+	{
+		sw->domain 	= AF_INET;
+		sw->flags 	= BIND | MULTICAST;
+		return;
+	}
+
+	int abstract 	= sw->flags & ABSTRACT;
+	sw->flags 		= CONNECT;
+	if(sw->domain != AF_UNIX)
+		return;
+
+	sw->flags |= abstract;
+	if(sw->capabilities & SOCKETWRAPPER_CAPABILITY_SEQPACKET)
+		sw->type = SOCK_SEQPACKET;
+}
+
+/** Describe sw the way it goes out on the network */
+static void CreateDiscoveryRecord(SocketWrapper *sw, DiscoveryRecord *record)
+{
+	memset(record, 0, sizeof(DiscoveryRecord));
+	record->version 		= DISCOVERY_RECORD_VERSION;
+	record->type 			= sw->type;
+	record->port 			= sw->inetStruct.sin_port;
+	record->address 		= sw->inetStruct.sin_addr.s_addr;
+	record->capabilities 	= htonl(sw->capabilities);
+	record->hostId 			= htonl(HostId());
+	record->instance 		= htonl(Instance());
+	strncpy(record->name, sw->name, PROCESS_MAX_CHARS - 1);
+}
+
+/**
+Make the bound SocketWrapper described by the DiscoveryRecord at the start of data.
+If it's on this computer, we check if the other process is local or not by asking if
+the file exists at the expected AF_UNIX address, as defined by SocketWrapper.h, and
+if it does the SocketWrapper is AF_UNIX. An abstract AF_UNIX name has no file, but it
+only exists for as long as the process that bound it, so being on this computer is
+enough. Returns -1 for anything that isn't a record of the version we know.
+*/
+static int ParseDiscoveryRecord(void *data, size_t dlen, SocketWrapper *sw)
+{
+	DiscoveryRecord record;
+	if(dlen < sizeof(DiscoveryRecord))
+		return -1;
+
+	memcpy(&record, data, sizeof(DiscoveryRecord));
+	if(record.version != DISCOVERY_RECORD_VERSION || (record.type != SOCK_DGRAM && record.type != SOCK_STREAM))
+		return -1;
+
+	record.name[PROCESS_MAX_CHARS - 1] = '\0';
+	int abstract = (ntohl(record.capabilities) & SOCKETWRAPPER_CAPABILITY_ABSTRACT_UNIX) != 0;
+
+	memset(sw, 0, sizeof(SocketWrapper));
+	PopulateSocketWrapper(sw, record.name, "0.0.0.0", 0, AF_INET, record.type, abstract ? BIND | ABSTRACT : BIND);
+	sw->inetStruct.sin_addr.s_addr 	= record.address;
+	sw->inetStruct.sin_port 		= record.port;
+	sw->capabilities 				= ntohl(record.capabilities);
+	sw->instance 					= ntohl(record.instance);
+
+	int topic = (sw->capabilities & SOCKETWRAPPER_CAPABILITY_TOPIC) != 0;
+	if(ntohl(record.hostId) == HostId() && topic == 0 && (abstract || DoesFileExist(sw->unixStruct.sun_path)))
+		sw->domain = AF_UNIX;
+
+	return 0;
+}
+
+static uint32_t HostId(void)
+{
+	pthread_once(&hostIdOnce, FindHostId);
+	return hostId;
+}
+
+/**
+Something that is the same for every process on this computer and different on every
+other: a hash of /etc/machine-id, or of gethostid() where there isn't one.
+*/
+static void FindHostId(void)
+{
+	char id[64] = {0};
+	FILE *file = fopen("/etc/machine-id", "r");
+	if(file == NULL || fgets(id, sizeof(id), file) == NULL)
+		snprintf(id, sizeof(id), "%ld", gethostid());
+	if(file != NULL)
+		fclose(file);
+
+	uint32_t hash = 2166136261u;
+	for(int i = 0; id[i] != '\0'; i++)
+		hash = (hash ^ (uint8_t) id[i]) * 16777619u;
+	hostId = hash;
+}
+
+/**
+Which process this is, as far as peers are concerned. A process made by fork() gets its
+own, since the pid is part of it, and so does one that's restarted with an old pid.
+*/
+static uint32_t Instance(void)
+{
+	pthread_once(&instanceOnce, MakeInstanceNonce);
+	uint32_t instance = instanceNonce ^ (uint32_t) getpid();
+	return instance != 0 ? instance : 1;
+}
+
+static void MakeInstanceNonce(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	instanceNonce = ((uint32_t) now.tv_nsec * 2654435761u) ^ (uint32_t) now.tv_sec;
+}
+
+static double ElapsedMilliseconds(struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static double NowMilliseconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+/** FNV-1a, the same as the Supersocket's own name index uses */
+static uint32_t HashListenerName(char *name)
+{
+	uint32_t hash = 2166136261u;
+	for(int i = 0; i < PROCESS_MAX_CHARS && name[i] != '\0'; i++)
+		hash = (hash ^ (uint8_t) name[i]) * 16777619u;
+	return hash;
+}
+
+/** Somewhere between half and all of milliseconds, so that peers drift out of step */
+static int Jitter(int milliseconds, unsigned int *seed)
+{
+	return milliseconds / 2 + rand_r(seed) % (milliseconds / 2 + 1);
+}
+
+static int NextBackoff(int milliseconds)
+{
+	return (2 * milliseconds < DISCOVERY_MAX_BACKOFF) ? 2 * milliseconds : DISCOVERY_MAX_BACKOFF;
 }
 
 /////////////////////////////////////////////////////////////////////////////////
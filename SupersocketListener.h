@@ -26,6 +26,48 @@
  * "Alice" receives Bob's information, it will get added as a CONNECT socket
  * to the Supersocket.
  *
+ * Processes on the same computer don't need the network to find each other: a running
+ * listener publishes its bound addresses to the PeerCache (see PeerCache.h), which
+ * DiscoverSupersocket() checks with a single unicast request before using multicast.
+ *
+ * Requests that go unanswered are repeated with exponential backoff: the first wait is
+ * POLL_TIME_FOR_DISCOVERY, doubling up to DISCOVERY_MAX_BACKOFF, each picked at random
+ * between half and all of that so that processes started together don't ask in step.
+ * DiscoverSupersocketTimeout() gives up after a while, and DiscoverSupersocketAsync()
+ * doesn't wait at all: the listener thread does the asking and calls you back.
+ *
+ * Names don't have to be unique, and DiscoverSupersocketReplicas() finds several
+ * processes with the same one. DiscoverSupersocketsByPrefix() finds everyone whose
+ * name starts with something, without knowing who they are in advance. So that
+ * hundreds of them don't all answer at the same moment, each listener waits a random
+ * while first, longer the more listeners it has heard on the multicast, and doesn't
+ * answer at all if it overhears that enough of the others already have.
+ *
+ * Listeners can also announce themselves, unasked, when they start and every so often
+ * afterwards (see EnableSupersocketAnnouncements()). Every listener keeps a directory
+ * of what it has heard announced, and DiscoverSupersocket() for a name that's in it
+ * returns straight away, without sending anything.
+ *
+ * To find out when contacts go away, turn on heartbeats everywhere with
+ * EnableSupersocketHeartbeats(). A contact that hasn't been heard from, by heartbeat or
+ * by any Message, for LIVENESS_DISABLE_PERIODS of its heartbeat periods is disabled,
+ * and SendMessageToAll() skips it. If it's heard from again it's enabled again; after
+ * LIVENESS_CLOSE_PERIODS it's closed and taken out of the Supersocket for good.
+ * CloseSupersocket() tells everyone straight away. SetSupersocketLivenessCallback()
+ * hears about all of it.
+ *
+ * However many Supersockets a process has, there is only one listener: one thread and
+ * one multicast socket, shared by all of them. A request is only handed to the
+ * Supersockets that have the name asked for. StopSupersocketListener(), which
+ * CloseSupersocket() calls, takes a Supersocket off its hands, and the thread
+ * is stopped and joined once the last one is gone.
+ *
+ * Where multicast doesn't get through, point every process at a DirectoryServer (see
+ * DirectoryServer.h) with SetSupersocketDirectoryServer(). The listener then registers
+ * our bound sockets with the server, renewing the lease every so often, and discovery
+ * asks the server instead of the network: one unicast round trip. Whatever the server
+ * answers goes in the directory for as long as the lease has left, so asking again is free.
+ *
  *
 	
 @authors David Brandman and Benjamin Shanahan
@@ -35,12 +77,103 @@
 
 #include "Supersocket.h"
 
+/** How long the directory server is asked to remember our bound sockets for. They're renewed well before then. */
+#define DIRECTORY_SERVER_LEASE 30000 //Milliseconds
+
+/** The name of the socket discovery requests to the directory server are sent from */
+#define DIRECTORY_SERVER_CLIENT_NAME "DirectoryClient"
+
 /** Define how many microseconds between Multicast sends to find a Supersocket */
 #define WAIT_TIME_BETWEEN_DISCOVERY_MULTICAST_REQUESTS 1000000 //microseconds
 
 /** Define how long a process polls the BIND sockets before sending out another request */
 #define POLL_TIME_FOR_DISCOVERY 500 //Milliseconds
 
+/** The longest the wait between requests is allowed to grow to */
+#define DISCOVERY_MAX_BACKOFF 8000 //Milliseconds
+
+/** How many announced names a listener remembers */
+#define SUPERSOCKET_DIRECTORY_SIZE 256
+
+/** Announcements are remembered for this many announcement periods, so one lost datagram doesn't matter */
+#define ANNOUNCE_LIFETIME_PERIODS 3
+
+/** How many times a starting listener tells everyone where its sockets are now, and how far apart */
+#define UPDATE_REPEATS 3
+#define UPDATE_REPEAT_TIME 100 //Milliseconds
+
+/** How often the listener looks at whether the contacts sending heartbeats are still there */
+#define LIVENESS_CHECK_PERIOD 100 //Milliseconds
+
+/** Most names asked for in one multicast request. More than this are split over several. */
+#define DISCOVERY_MAX_NAMES_PER_REQUEST 64
+
+/** How many Supersockets one process' listener can serve at once */
+#define SUPERSOCKET_LISTENER_MAX_SUPERSOCKETS 64
+
+/** Size of the buffer the listener receives requests into. It fits the largest request. */
+#define DISCOVERY_REQUEST_BUFFER_SIZE 4096
+
+/** When answers are to be spread out, each listener waits up to this long for every listener it has heard */
+#define DISCOVERY_REPLY_SPREAD_PER_PEER 100 //Microseconds
+
+/** ...but never longer than this in all */
+#define DISCOVERY_MAX_REPLY_SPREAD 250 //Milliseconds
+
+/** Everyone heard on the multicast within this long counts as part of the group */
+#define DISCOVERY_GROUP_LIFETIME 10000 //Milliseconds
+
+/** How many answers a listener holds back at once. Any more are sent straight away. */
+#define DISCOVERY_MAX_DELAYED_REPLIES 256
+
+/** Bump this whenever DiscoveryRecord changes. Records of any other version are ignored. */
+#define DISCOVERY_RECORD_VERSION 2
+
+/**
+ * @brief Where a bound socket is, as it goes out on the network
+ *
+ * This is all a peer needs to know to reach one of our SocketWrappers, and none of
+ * it depends on how structs are laid out in memory. address and port are in network
+ * byte order, as they are in a sockaddr_in, and so are capabilities and hostId.
+ *
+ * hostId is the same for every process on a computer (see /etc/machine-id), so
+ * a peer can tell whether we're on the same one and use AF_UNIX to reach us instead.
+ * instance is different for every process, even one restarted with the same pid, so
+ * replicas that share a name can be told apart. It's never 0.
+ * version comes first, and it is never a printable character, so anything sent by a
+ * listener too old to know about records is told apart by its first byte.
+ */
+typedef struct
+{
+	uint8_t version;
+	uint8_t type; // SOCK_DGRAM or SOCK_STREAM
+	uint16_t port;
+	uint32_t address;
+	uint32_t capabilities;
+	uint32_t hostId;
+	uint32_t instance;
+	char name[PROCESS_MAX_CHARS];
+
+} DiscoveryRecord;
+
+/**
+ * @brief How a requester wants its request answered
+ *
+ * These are sent after the names asked for. Without them, or with spread 0, everyone
+ * who has a name answers straight away. With spread set, each listener waits a random
+ * while first, and sends a copy of its answer to the other listeners. Once a listener
+ * has overheard maxReplies answers to the same nonce, it keeps its own to itself
+ * (0 for no limit). Answers carry the nonce after their DiscoveryRecord, so the
+ * requester can tell them apart from answers to an earlier request.
+ */
+typedef struct
+{
+	uint32_t nonce;
+	uint16_t maxReplies; // Network byte order
+	uint16_t spread;
+
+} DiscoveryRequestOptions;
+
 /**
  * @brief List of the various ID for the Messages past between Supersocket Listeners
  * 
@@ -50,7 +183,47 @@
  * ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND
  * 	
  * 	A message is being sent out, where any Listener that has a matching name
- * 	and a BIND, respond to the message
+ * 	and a BIND, respond to the message. It's a DiscoveryRecord with the name
+ * 	asked for and the address to reply to.
+ *
+ * ID_SUPERSOCKET_SOCKETWRAPPER_REPLY_DISCOVERBIND
+ *
+ * 	The DiscoveryRecord of the bound socket that was asked for, and the nonce of the
+ * 	request if it had DiscoveryRequestOptions. Answers that were spread out are also
+ * 	sent to the other listeners on the multicast. The directory server's answers always
+ * 	have the nonce (0 for none), then a uint32_t of how many milliseconds its lease has left.
+ *
+ * ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND_MANY
+ *
+ * 	The same, but the DiscoveryRecord is followed by a uint32_t count and that many
+ * 	names of PROCESS_MAX_CHARS each. Listeners send one ordinary reply per name they have.
+ *
+ * ID_SUPERSOCKET_SOCKETWRAPPER_ANNOUNCE
+ *
+ * 	Sent out on the multicast, unasked, by a listener with announcements enabled: the
+ * 	DiscoveryRecord of one of its bound sockets, followed by a uint32_t of how many
+ * 	milliseconds to remember it for. The same, sent to the directory server, registers
+ * 	the socket there, and 0 milliseconds takes it away.
+ *
+ * ID_SUPERSOCKET_SOCKETWRAPPER_UDPATE
+ *
+ * 	Sent out on the multicast by a listener when it starts, a DiscoveryRecord for each
+ * 	of its bound AF_INET SocketWrappers. A process that has been restarted usually comes
+ * 	back on a different port, so anyone with a contact of that name swaps the new address in.
+ * 	They only swap it into a contact for the same instance, or one they don't know the
+ * 	instance of. A contact for another instance is a replica that is still running.
+ *
+ * ID_SUPERSOCKET_SOCKETWRAPPER_HEARTBEAT
+ *
+ * 	Sent out on the multicast every so often by a listener with heartbeats enabled:
+ * 	a uint32_t heartbeat period in milliseconds, then a uint32_t count and that many
+ * 	names of PROCESS_MAX_CHARS, which are the process' bound AF_INET SocketWrappers.
+ *
+ * ID_SUPERSOCKET_SOCKETWRAPPER_CLOSE
+ *
+ * 	The same, sent once by CloseSupersocket(), followed by the sender's instance (see
+ * 	DiscoveryRecord). Everyone closes their contacts with those names and that instance,
+ * 	and any they don't know the instance of.
  *
  */
 typedef enum 
@@ -60,22 +233,129 @@ typedef enum
 	ID_SUPERSOCKET_SOCKETWRAPPER_REPLY_DISCOVERBIND,
 	ID_SUPERSOCKET_SOCKETWRAPPER_DISABLE,
 	ID_SUPERSOCKET_SOCKETWRAPPER_UDPATE,
-	ID_SUPERSOCKET_SOCKETWRAPPER_CLOSE
+	ID_SUPERSOCKET_SOCKETWRAPPER_CLOSE,
+	ID_SUPERSOCKET_SOCKETWRAPPER_REQUEST_DISCOVERBIND_MANY,
+	ID_SUPERSOCKET_SOCKETWRAPPER_ANNOUNCE,
+	ID_SUPERSOCKET_SOCKETWRAPPER_HEARTBEAT
 
 } ID_SUPERSOCKETLISTENER_LIST;
 
 
 
 /**
- * @brief Launch a thread that listens and responds to requests
+ * @brief Have the process' listener answer requests for s, launching its thread if it isn't running yet
 */
 int InitializeSupersocketListener(Supersocket *s);
 
+/**
+ * @brief Stop answering for s. Once the last Supersocket is stopped, so is the thread.
+ */
+int StopSupersocketListener(Supersocket *s);
+
+/**
+ * @brief Free what the listener kept for s, once s is closed. CloseSupersocket() calls it.
+ *
+ * Returns 0, or 1 if we are the listener thread, which then frees s's tables as well
+ * once it's done with s.
+ */
+int ReleaseSupersocketListener(Supersocket *s);
+
 /**
  * @brief In case you don't want to launch a thread, you can call the function directly
+ *
+ * It returns once the listener is stopped, unless the process' listener is already
+ * running, in which case s is handed to it and it returns straight away.
  */
 void *SupersocketListener(void *);
 /**
  * @brief Discover another socket. Simply specific a name and it'll be added to the Supersocket
  */
 int DiscoverSupersocket(Supersocket *s, char *name);
+/**
+ * @brief Discover n names at once, giving up after milliseconds (never, if negative)
+ *
+ * All of the names go out in one multicast request, and the replies are collected as
+ * they come, so this takes about as long as the slowest peer rather than the sum of them.
+ * indices[i] is set to where names[i] was added to the Supersocket, or -1 if it wasn't
+ * found in time or couldn't be added. Returns how many were added.
+ */
+int DiscoverSupersockets(Supersocket *s, char **names, int n, int *indices, int milliseconds);
+/**
+ * @brief Same as DiscoverSupersocket(), but give up and return -1 after milliseconds
+ */
+int DiscoverSupersocketTimeout(Supersocket *s, char *name, int milliseconds);
+/**
+ * @brief Add up to maxReplies different processes that have name bound, waiting at most milliseconds
+ *
+ * The answers are spread out over a short while, and once maxReplies of them have been
+ * sent the rest of the listeners stay quiet. indices needs room for maxReplies, and is
+ * filled in with where each was added. Returns how many were found.
+ */
+int DiscoverSupersocketReplicas(Supersocket *s, char *name, int *indices, int maxReplies, int milliseconds);
+/**
+ * @brief Find everyone with a bound AF_INET socket whose name starts with prefix
+ *
+ * prefix ends in '*', as in "Decoder*", and "*" on its own finds everyone. The request
+ * goes out once, the answers are spread out, and we listen for them for milliseconds.
+ * Up to maxFound of the bound SocketWrappers that answered are copied into found.
+ * If indices isn't NULL, they're all added to s as contacts in one go, and indices,
+ * which needs room for maxFound, says where. Returns how many were found.
+ */
+int DiscoverSupersocketsByPrefix(Supersocket *s, char *prefix, SocketWrapper *found, int *indices, int maxFound, int milliseconds);
+
+/**
+ * @brief Called by DiscoverSupersocketAsync() with where name was added, or -1 if it timed out
+ */
+typedef void (*DiscoveryCallback)(Supersocket *s, char *name, int target, void *userData);
+
+/**
+ * @brief Discover name in the background, calling callback once it's found
+ *
+ * Returns straight away. The SupersocketListener of s sends the requests and, as
+ * soon as it sees the reply, adds name to s and calls callback from its own thread,
+ * so callback should be quick and must take care with anything it shares.
+ * If name isn't found within milliseconds (never, if negative), callback is called
+ * with a target of -1. InitializeSupersocketListener() must have been called on s.
+ */
+int DiscoverSupersocketAsync(Supersocket *s, char *name, int milliseconds, DiscoveryCallback callback, void *userData);
+
+/**
+ * @brief Have the listener announce our bound AF_INET sockets about every milliseconds (0 stops it)
+ *
+ * Call it before InitializeSupersocketListener() to announce as soon as the listener starts.
+ */
+int EnableSupersocketAnnouncements(Supersocket *s, int milliseconds);
+
+/**
+ * @brief Register and discover through the DirectoryServer at ip and port, rather than on the multicast
+ *
+ * This is for every Supersocket in the process. Passing NULL for ip goes back to multicast.
+ */
+int SetSupersocketDirectoryServer(char *ip, int port);
+
+/**
+ * @brief Copy what the listener has heard announced for name into sw. Returns 0 if there was anything, otherwise -1.
+ */
+int LookUpSupersocketDirectory(Supersocket *s, char *name, SocketWrapper *sw);
+
+/**
+ * @brief Have the listener send a heartbeat about every milliseconds (0 stops it)
+ */
+int EnableSupersocketHeartbeats(Supersocket *s, int milliseconds);
+
+/**
+ * @brief Called from the listener thread when a contact is disabled, enabled or closed
+ *
+ * status is SOCKETWRAPPER_STATUS_DISABLED, SOCKETWRAPPER_STATUS_INITIALIZED or SOCKETWRAPPER_STATUS_CLOSED.
+ */
+typedef void (*LivenessCallback)(Supersocket *s, int target, int status, void *userData);
+
+/**
+ * @brief Have callback called whenever one of the contacts of s changes status
+ */
+int SetSupersocketLivenessCallback(Supersocket *s, LivenessCallback callback, void *userData);
+
+/**
+ * @brief Tell everyone on the network that the bound sockets of s are going away. CloseSupersocket() calls this.
+ */
+int AnnounceSupersocketClose(Supersocket *s);
@@ -0,0 +1,166 @@
+/**
+@file
+@brief Compare the ways two Supersockets on the same computer can reach each other
+
+	@code
+		$ ./LocalTransportBenchmark [nMessages]
+	@endcode
+
+For each choice of SetSupersocketLocalTransport() (SOCK_DGRAM at AF_UNIX_FILENAME, which
+is what you get unless you ask otherwise, SOCK_DGRAM in the abstract namespace, and
+SOCK_SEQPACKET both ways), this measures:
+
+- **startup:** how long InitializeSupersocket() takes when the name was last used by
+               somebody else, which for a file means unlinking it first
+- **round trip:** Alice sends Bob a Message and waits for him to send it back
+- **throughput:** Alice sends nMessages (default 200000) with SendMessageBatch(), and
+                  Bob receives every one of them
+
+Alice and Bob are in the same process, with Bob in a thread of his own, and only their
+AF_UNIX sockets are used. Messages carry 64 bytes of data.
+
+ gcc -std=c11 -fcommon -O2 -I.. LocalTransportBenchmark.c ../Supersocket.c ../SupersocketListener.c ../SocketWrapper.c ../Message.c ../Compression.c ../PeerCache.c ../TypedArray.c ../Display.c ../ManageHeapMemory.c -lpthread -o LocalTransportBenchmark
+
+@authors David Brandman and Benjamin Shanahan
+*/
+
+#define _GNU_SOURCE // For clock_gettime() under -std=c11
+#include "Supersocket.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#define BENCHMARK_DATA_SIZE 64
+#define BENCHMARK_STARTUPS 200
+#define BENCHMARK_ROUND_TRIPS 20000
+#define BENCHMARK_BATCH 64
+
+/** What Bob is told to do with each Message, by its id */
+enum {BENCHMARK_COUNT = 1, BENCHMARK_ECHO, BENCHMARK_STOP};
+
+typedef struct
+{
+	Supersocket bob;
+	int alice;
+	int nReceived;
+
+} Bob;
+
+static double NowMilliseconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+static void *ServeBob(void *arg)
+{
+	Bob *b 		= arg;
+	Message m 	= CreateMessageBuffer(BENCHMARK_DATA_SIZE);
+	while(1)
+	{
+		m.dlen = BENCHMARK_DATA_SIZE;
+		if(ReceiveMessage(&b->bob, &m) <= 0)
+			continue;
+
+		if(m.id == BENCHMARK_STOP)
+			break;
+
+		__atomic_add_fetch(&b->nReceived, 1, __ATOMIC_SEQ_CST);
+		if(m.id == BENCHMARK_ECHO)
+			SendMessage(&b->bob, b->alice, &m);
+	}
+
+	DestroyMessageBuffer(&m);
+	return NULL;
+}
+
+static double MeasureStartup(void)
+{
+	double start = NowMilliseconds();
+	for(int i = 0; i < BENCHMARK_STARTUPS; i++)
+	{
+		Supersocket s = {0};
+		InitializeSupersocket(&s, "BenchmarkStartup", "127.0.0.1", 0);
+		CloseSupersocket(&s);
+	}
+	return (NowMilliseconds() - start) / BENCHMARK_STARTUPS;
+}
+
+static void RunBenchmark(char *description, int type, int flags, int nMessages)
+{
+	SetSupersocketLocalTransport(type, flags);
+	double startup = MeasureStartup();
+
+	Bob b = {0};
+	Supersocket alice = {0};
+	InitializeSupersocket(&b.bob, "BenchmarkBob", "127.0.0.1", 0);
+	InitializeSupersocket(&alice, "BenchmarkAlice", "127.0.0.1", 0);
+
+	int connectFlags 	= CONNECT | flags;
+	int bob 			= AddSocket(&alice, "BenchmarkBob", NULL, 0, AF_UNIX, type, connectFlags);
+	b.alice 			= AddSocket(&b.bob, "BenchmarkAlice", NULL, 0, AF_UNIX, type, connectFlags);
+	if(bob < 0 || b.alice < 0)
+	{
+		DisplayError("Unable to set up %s", description);
+		return;
+	}
+
+	pthread_t thread;
+	pthread_create(&thread, NULL, ServeBob, &b);
+
+	char data[BENCHMARK_DATA_SIZE] = {0};
+	Message reply = CreateMessageBuffer(BENCHMARK_DATA_SIZE);
+	Message echo  = CreateMessage("BenchmarkAlice", BENCHMARK_ECHO, data, BENCHMARK_DATA_SIZE);
+
+	double start = NowMilliseconds();
+	for(int i = 0; i < BENCHMARK_ROUND_TRIPS; i++)
+	{
+		SendMessage(&alice, bob, &echo);
+		reply.dlen = BENCHMARK_DATA_SIZE;
+		ReceiveMessage(&alice, &reply);
+	}
+	double roundTrip = (NowMilliseconds() - start) / BENCHMARK_ROUND_TRIPS;
+
+	Message batch[BENCHMARK_BATCH];
+	for(int i = 0; i < BENCHMARK_BATCH; i++)
+		batch[i] = CreateMessage("BenchmarkAlice", BENCHMARK_COUNT, data, BENCHMARK_DATA_SIZE);
+
+	int expected = __atomic_load_n(&b.nReceived, __ATOMIC_SEQ_CST) + nMessages;
+	start = NowMilliseconds();
+	for(int sent = 0; sent < nMessages; sent += BENCHMARK_BATCH)
+	{
+		int n = nMessages - sent < BENCHMARK_BATCH ? nMessages - sent : BENCHMARK_BATCH;
+		SendMessageBatch(&alice, bob, batch, n);
+	}
+	while(__atomic_load_n(&b.nReceived, __ATOMIC_SEQ_CST) < expected)
+		;
+	double elapsed = NowMilliseconds() - start;
+
+	Message stop = CreateMessage("BenchmarkAlice", BENCHMARK_STOP, data, 0);
+	SendMessage(&alice, bob, &stop);
+	pthread_join(thread, NULL);
+
+	printf("%-28s %10.1f us %12.2f us %12.0f Messages/s\n", description, startup * 1e3, roundTrip * 1e3, nMessages / elapsed * 1e3);
+
+	DestroyMessageBuffer(&reply);
+	CloseSupersocket(&alice);
+	CloseSupersocket(&b.bob);
+}
+
+int main(int argc, char *argv[])
+{
+	InitializeDisplay(argc, argv);
+	SetVerbose(DISABLE);
+
+	int nMessages = argc > 1 ? atoi(argv[1]) : 200000;
+
+	printf("%-28s %13s %15s %23s\n", "", "startup", "round trip", "throughput");
+	RunBenchmark("SOCK_DGRAM", SOCK_DGRAM, 0, nMessages);
+	RunBenchmark("SOCK_DGRAM, abstract", SOCK_DGRAM, ABSTRACT, nMessages);
+	RunBenchmark("SOCK_SEQPACKET", SOCK_SEQPACKET, 0, nMessages);
+	RunBenchmark("SOCK_SEQPACKET, abstract", SOCK_SEQPACKET, ABSTRACT, nMessages);
+
+	return 0;
+}
@@ -0,0 +1,159 @@
+/**
+@file
+@brief Measure how the receive rate goes with the number of SO_REUSEPORT shards
+
+	@code
+		$ ./ShardedReceiveBenchmark [nSenders] [seconds]
+	@endcode
+
+nSenders threads (default 8), each a Supersocket of its own, send 64-byte Messages to
+Bob's AF_INET port as fast as they can for the given number of seconds (default 2).
+Bob receives them with a ShardedReceiver, and the callback does a little work on every
+one, the way a decoder would. This is repeated with 1, 2, 4 and 8 shards, and for each
+one it reports how many Messages Bob got through per second, and what share of those
+sent were dropped because nobody read them in time.
+
+It only shows anything on a computer with the cores to spare: with 4 cores, say, one
+goes to each shard and the senders share what's left. Everything is on 127.0.0.1, so
+on a real network the senders don't compete with Bob for cores and the gain is larger.
+
+ gcc -std=c11 -fcommon -O2 -I.. ShardedReceiveBenchmark.c ../ShardedReceiver.c ../Supersocket.c ../SupersocketListener.c ../SocketWrapper.c ../Message.c ../Compression.c ../PeerCache.c ../TypedArray.c ../Display.c ../ManageHeapMemory.c -lpthread -o ShardedReceiveBenchmark
+
+@authors David Brandman and Benjamin Shanahan
+*/
+
+#define _GNU_SOURCE // For clock_gettime() and usleep() under -std=c11
+#include "Supersocket.h"
+#include "ShardedReceiver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCHMARK_DATA_SIZE 64
+#define BENCHMARK_MAX_SENDERS 64
+#define BENCHMARK_WORK 2000 // Rounds of mixing per Message in the callback
+#define BENCHMARK_DRAIN_TIME 200000 // Microseconds
+
+typedef struct
+{
+	int port;
+	int index;
+	double seconds;
+	uint64_t nSent;
+
+} Sender;
+
+static volatile uint64_t checksum;
+static uint64_t nReceived;
+
+static double NowMilliseconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+/** Stand-in for decoding the Message, so that each one costs something to receive */
+static void HandleMessage(Message *m, int shard, void *arg)
+{
+	uint32_t hash = m->id;
+	for(int i = 0; i < BENCHMARK_WORK; i++)
+		hash = (hash ^ ((uint8_t *) m->data)[i % m->dlen]) * 16777619u;
+
+	checksum += hash;
+	__atomic_add_fetch(&nReceived, 1, __ATOMIC_RELAXED);
+}
+
+static void *RunSender(void *arg)
+{
+	Sender *sender = arg;
+
+	char name[PROCESS_MAX_CHARS];
+	snprintf(name, sizeof(name), "BenchmarkSender%d", sender->index);
+
+	Supersocket s = {0};
+	InitializeSupersocket(&s, name, "127.0.0.1", 0);
+	int bob = AddSocket(&s, "BenchmarkBob", "127.0.0.1", sender->port, AF_INET, SOCK_DGRAM, 0);
+
+	char data[BENCHMARK_DATA_SIZE] = {0};
+	Message m = CreateMessage(name, 1, data, BENCHMARK_DATA_SIZE);
+
+	double end = NowMilliseconds() + sender->seconds * 1e3;
+	while(NowMilliseconds() < end)
+	{
+		for(int i = 0; i < 64; i++)
+			if(SendMessage(&s, bob, &m) > 0)
+				sender->nSent++;
+	}
+
+	CloseSupersocket(&s);
+	return NULL;
+}
+
+static void RunBenchmark(int nShards, int nSenders, double seconds)
+{
+	SetSupersocketReceiveShards(nShards, 0);
+
+	Supersocket bob = {0};
+	InitializeSupersocket(&bob, "BenchmarkBob", "127.0.0.1", 0);
+
+	int target = FindSocketWrapperByName(&bob, "BenchmarkBob", BIND, AF_INET);
+	int port = ntohs(bob.socketWrapper[target].inetStruct.sin_port);
+
+	ShardedReceiver r = {0};
+	__atomic_store_n(&nReceived, 0, __ATOMIC_SEQ_CST);
+	if(StartShardedReceiver(&r, &bob, HandleMessage, NULL) < 0)
+	{
+		DisplayError("Unable to start %d shards", nShards);
+		CloseSupersocket(&bob);
+		return;
+	}
+
+	Sender senders[BENCHMARK_MAX_SENDERS] = {{0}};
+	pthread_t threads[BENCHMARK_MAX_SENDERS];
+	for(int i = 0; i < nSenders; i++)
+	{
+		senders[i] = (Sender) {.port = port, .index = i, .seconds = seconds};
+		pthread_create(&threads[i], NULL, RunSender, &senders[i]);
+	}
+
+	uint64_t nSent = 0;
+	for(int i = 0; i < nSenders; i++)
+	{
+		pthread_join(threads[i], NULL);
+		nSent += senders[i].nSent;
+	}
+
+	// What is still queued when the senders finish counts as received
+	usleep(BENCHMARK_DRAIN_TIME);
+	StopShardedReceiver(&r);
+	uint64_t received = __atomic_load_n(&nReceived, __ATOMIC_SEQ_CST);
+
+	printf("%6d %14.0f Messages/s %9.1f%% dropped\n", nShards, received / seconds,
+		nSent > 0 ? 100.0 * (nSent - received) / nSent : 0.0);
+
+	CloseSupersocket(&bob);
+}
+
+int main(int argc, char *argv[])
+{
+	InitializeDisplay(argc, argv);
+	SetVerbose(DISABLE);
+
+	int nSenders 	= argc > 1 ? atoi(argv[1]) : 8;
+	double seconds 	= argc > 2 ? atof(argv[2]) : 2;
+	if(nSenders < 1 || nSenders > BENCHMARK_MAX_SENDERS || seconds <= 0)
+	{
+		printf("Usage: %s [nSenders, 1 to %d] [seconds]\n", argv[0], BENCHMARK_MAX_SENDERS);
+		return 1;
+	}
+
+	printf("%d senders, %ld cores\n", nSenders, sysconf(_SC_NPROCESSORS_ONLN));
+	printf("%6s %25s\n", "shards", "received");
+	for(int nShards = 1; nShards <= 8; nShards *= 2)
+		RunBenchmark(nShards, nSenders, seconds);
+
+	return 0;
+}
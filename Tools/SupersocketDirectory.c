@@ -0,0 +1,37 @@
+/**
+@file
+@brief Run a DirectoryServer, for networks where the SupersocketListener's multicast doesn't get through
+
+	@code
+		$ ./SupersocketDirectory [ip] [port]
+	@endcode
+
+ip defaults to 0.0.0.0 and port to DIRECTORY_SERVER_DEFAULT_PORT. Every process that
+should use it calls SetSupersocketDirectoryServer() with the address of this computer.
+
+ gcc -std=c11 -fcommon -I.. SupersocketDirectory.c ../DirectoryServer.c ../Supersocket.c ../SupersocketListener.c ../SocketWrapper.c ../Message.c ../Compression.c ../PeerCache.c ../TypedArray.c ../Display.c ../ManageHeapMemory.c -lpthread -o SupersocketDirectory
+
+@authors David Brandman and Benjamin Shanahan
+*/
+
+#include "DirectoryServer.h"
+#include <stdlib.h>
+
+int main(int argc, char *argv[])
+{
+	InitializeDisplay(argc, argv);
+
+	char *ip = argc > 1 ? argv[1] : "0.0.0.0";
+	int port = argc > 2 ? atoi(argv[2]) : DIRECTORY_SERVER_DEFAULT_PORT;
+
+	DirectoryServer d;
+	if(InitializeDirectoryServer(&d, ip, port) < 0)
+		return 1;
+
+	// Anything that couldn't be read is just skipped
+	while(1)
+		ServeDirectory(&d, -1);
+
+	CloseDirectoryServer(&d);
+	return 0;
+}
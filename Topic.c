@@ -0,0 +1,156 @@
+#include "Topic.h"
+#include "SupersocketListener.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+static void TopicGroup(char *topic, char *group);
+static int ConfigurePublisher(SocketWrapper *sw, TopicOptions *options);
+static int JoinOnInterface(Supersocket *s, int target, char *interface);
+
+
+int PublishTopic(Supersocket *s, char *topic, TopicOptions *options)
+{
+	TopicOptions defaults = {0};
+	if(options == NULL)
+		options = &defaults;
+
+	int target = FindSocketWrapperByName(s, topic, MULTICAST, AF_INET);
+	if(target >= 0)
+	{
+		int epoch;
+		SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+		SocketWrapper *sw = &table->socketWrapper[target];
+		int publishing = ParseFlags(sw->flags, BIND) == 0 && (sw->capabilities & SOCKETWRAPPER_CAPABILITY_TOPIC);
+		ReleaseSupersocketTable(s, epoch);
+
+		if(publishing)
+			return target;
+	}
+
+	char group[INET_ADDRSTRLEN];
+	TopicGroup(topic, group);
+
+	SocketWrapper sw = {0};
+	PopulateSocketWrapper(&sw, topic, options->group != NULL ? options->group : group,
+		options->port > 0 ? options->port : TOPIC_DEFAULT_PORT, AF_INET, SOCK_DGRAM, MULTICAST);
+	sw.capabilities |= SOCKETWRAPPER_CAPABILITY_TOPIC;
+
+	// The SocketWrapper is initialized in place, so its socket can be set up afterwards
+	target = AddSocketWrapper(s, &sw);
+	if(target < 0)
+		return -1;
+
+	if(ConfigurePublisher(&sw, options) < 0)
+	{
+		RemoveSocketWrapper(s, target);
+		return -1;
+	}
+
+	Display("[%s] Publishing %s", s->name, topic);
+	return target;
+}
+
+int SubscribeTopic(Supersocket *s, char *topic, TopicOptions *options, int milliseconds)
+{
+	int target = FindSocketWrapperByName(s, topic, BIND | MULTICAST, AF_INET);
+	if(target >= 0)
+		return target;
+
+	target = DiscoverSupersocketTimeout(s, topic, milliseconds);
+	if(target < 0)
+	{
+		DisplayWarning("[%s] Nobody is publishing %s", s->name, topic);
+		return -1;
+	}
+
+	// Whoever answered may have been a Supersocket that happens to be called topic
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+	int isTopic = (table->socketWrapper[target].capabilities & SOCKETWRAPPER_CAPABILITY_TOPIC) != 0;
+	ReleaseSupersocketTable(s, epoch);
+
+	if(isTopic == 0)
+	{
+		DisplayError("[%s] %s is not a topic", s->name, topic);
+		RemoveSocketWrapper(s, target);
+		return -1;
+	}
+
+	if(options != NULL && options->interface != NULL && JoinOnInterface(s, target, options->interface) < 0)
+	{
+		RemoveSocketWrapper(s, target);
+		return -1;
+	}
+
+	Display("[%s] Subscribed to %s", s->name, topic);
+	return target;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+
+/** A group within TOPIC_GROUP_PREFIX, from an FNV-1a hash of the name */
+static void TopicGroup(char *topic, char *group)
+{
+	uint32_t hash = 2166136261u;
+	for(int i = 0; topic[i] != '\0'; i++)
+		hash = (hash ^ (uint8_t) topic[i]) * 16777619u;
+
+	hash ^= hash >> 16;
+	snprintf(group, INET_ADDRSTRLEN, "%s.%u.%u", TOPIC_GROUP_PREFIX, (hash >> 8) & 0xff, hash & 0xff);
+}
+
+static int ConfigurePublisher(SocketWrapper *sw, TopicOptions *options)
+{
+	unsigned char ttl 	= options->ttl > 0 ? options->ttl : TOPIC_DEFAULT_TTL;
+	unsigned char loop 	= options->disableLoopback ? 0 : 1;
+
+	if(setsockopt(sw->socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0
+		|| setsockopt(sw->socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0)
+	{
+		DisplayError("[%s] Unable to set up the multicast socket: %s", sw->name, strerror(errno));
+		return -1;
+	}
+
+	if(options->interface == NULL)
+		return 0;
+
+	struct in_addr interface;
+	if(inet_pton(AF_INET, options->interface, &interface) != 1
+		|| setsockopt(sw->socket, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) < 0)
+	{
+		DisplayError("[%s] Unable to publish on interface %s: %s", sw->name, options->interface, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/**
+InitializeSocketWrapper() joins the group on whichever interface the routing table
+picks. Swap that for the one we were asked for.
+*/
+static int JoinOnInterface(Supersocket *s, int target, char *interface)
+{
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+	SocketWrapper *sw = &table->socketWrapper[target];
+
+	struct ip_mreq mreq;
+	mreq.imr_multiaddr.s_addr = sw->inetStruct.sin_addr.s_addr;
+	mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+
+	int val = -1;
+	if(setsockopt(sw->socket, IPPROTO_IP, IP_DROP_MEMBERSHIP, &mreq, sizeof(mreq)) == 0
+		&& inet_pton(AF_INET, interface, &mreq.imr_interface) == 1
+		&& setsockopt(sw->socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == 0)
+		val = 0;
+	else
+		DisplayError("[%s] Unable to subscribe to %s on interface %s: %s", s->name, sw->name, interface, strerror(errno));
+
+	ReleaseSupersocketTable(s, epoch);
+	return val;
+}
@@ -0,0 +1,91 @@
+/**
+@file
+@brief Publish a stream of Messages to every subscriber with a single send
+
+SendMessageToAll() sends each contact a copy of its own, so with 40 subscribers a
+Message costs 40 sends and 40 times the bandwidth. A topic goes out on a multicast
+group instead: the publisher sends each Message once, and the network hands it to
+everyone who has joined the group.
+
+@code
+	int rawData = PublishTopic(&alice, "RawData", NULL);
+	Message m = CreateMessage("Alice", 0, samples, sizeof(samples));
+	SendMessage(&alice, rawData, &m);
+@endcode
+
+And on every subscriber:
+
+@code
+	SubscribeTopic(&bob, "RawData", NULL, 1000);
+	ReceiveMessage(&bob, &r);
+@endcode
+
+Subscribing is a discovery: the publisher's SupersocketListener answers for the topic
+as it would for a bound socket, and the answer is the group and port the topic is on,
+so subscribers never have to be told where to look. Once joined, the group is one of
+the subscriber's bound sockets, and what is published on it arrives through
+ReceiveMessage() and friends along with everything else. RemoveSocketWrapper() on the
+target SubscribeTopic() returned leaves the group again.
+
+Unless TopicOptions says otherwise, a topic's group is worked out from its name, within
+TOPIC_GROUP_PREFIX, and every topic uses TOPIC_DEFAULT_PORT. Two names can end up with
+the same group, in which case their subscribers get each other's Messages too; give
+one of them a group of its own if that matters. The publisher also has to be running
+a SupersocketListener, or nobody will find out where its topics are.
+
+@authors David Brandman and Benjamin Shanahan
+*/
+
+#pragma once
+
+#include "Supersocket.h"
+
+/** The port every topic is published on, unless it is given one */
+#define TOPIC_DEFAULT_PORT 5300
+
+/** Topics are given groups in 239.192.0.0/16, which is for use within an organization */
+#define TOPIC_GROUP_PREFIX "239.192"
+
+/** How many routers a topic's Messages cross, unless they are told otherwise. 1 keeps them on the local network. */
+#define TOPIC_DEFAULT_TTL 1
+
+/**
+@brief How a topic is published or subscribed to
+
+Passing NULL is the same as passing one that is all zeros.
+
+- **group, port:** where the publisher sends the topic. NULL and 0 are the group
+                   worked out from the name and TOPIC_DEFAULT_PORT. Subscribers don't
+                   need these, since discovery tells them.
+- **ttl:** how many routers the publisher's Messages may cross, or 0 for TOPIC_DEFAULT_TTL
+- **disableLoopback:** if set, subscribers on the publisher's own computer don't get its Messages
+- **interface:** the address of the network interface to publish or subscribe on, or
+                 NULL to leave it to the routing table
+*/
+typedef struct
+{
+	char *group;
+	int port;
+	int ttl;
+	int disableLoopback;
+	char *interface;
+
+} TopicOptions;
+
+/**
+@brief Start publishing topic from s
+
+Returns the target to send the topic's Messages to with SendMessage() or
+SendMessageBatch(), or -1. Publishing a topic that s already publishes returns the
+same target again. It only goes to the group, never to s's contacts.
+*/
+int PublishTopic(Supersocket *s, char *topic, TopicOptions *options);
+
+/**
+@brief Find a publisher of topic and join its group
+
+Waits up to milliseconds for a publisher to answer (forever if negative). Returns
+the target of the group, which is bound like any other socket of s, or -1 if nobody
+answered. If s is subscribed already, that target is returned straight away.
+*/
+int SubscribeTopic(Supersocket *s, char *topic, TopicOptions *options, int milliseconds);
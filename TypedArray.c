@@ -0,0 +1,218 @@
+#include "TypedArray.h"
+#include <errno.h>
+#include <string.h>
+
+static int HostEndianness(void);
+static void SwapElements(void *data, uint64_t nElements, int elementSize);
+
+
+int PopulateArrayHeader(ArrayHeader *h, int dtype, int order, int ndim, uint32_t *shape)
+{
+	if(ndim < 0 || ndim > ARRAY_MAX_DIMS)
+	{
+		DisplayError("Arrays can have at most %d dimensions, not %d", ARRAY_MAX_DIMS, ndim);
+		return -1;
+	}
+
+	memset(h, 0, sizeof(ArrayHeader));
+	h->dtype 		= dtype;
+	h->endianness 	= HostEndianness();
+	h->order 		= order;
+	h->ndim 		= ndim;
+	for(int i = 0; i < ndim; i++)
+		h->shape[i] = shape[i];
+
+	return 0;
+}
+
+int ArrayDtypeSize(int dtype)
+{
+	switch (dtype)
+	{
+		case ARRAY_DTYPE_INT8    : return 1;
+		case ARRAY_DTYPE_UINT8   : return 1;
+		case ARRAY_DTYPE_BOOL    : return 1;
+		case ARRAY_DTYPE_INT16   : return 2;
+		case ARRAY_DTYPE_UINT16  : return 2;
+		case ARRAY_DTYPE_INT32   : return 4;
+		case ARRAY_DTYPE_UINT32  : return 4;
+		case ARRAY_DTYPE_FLOAT32 : return 4;
+		case ARRAY_DTYPE_INT64   : return 8;
+		case ARRAY_DTYPE_UINT64  : return 8;
+		case ARRAY_DTYPE_FLOAT64 : return 8;
+	}
+	return 0;
+}
+
+/**
+The shape may have come off the network, so a product that doesn't fit is UINT64_MAX
+rather than whatever it wrapped around to. That is larger than any buffer, so it
+always fails the size checks.
+*/
+uint64_t ArrayNumberOfElements(ArrayHeader *h)
+{
+	int ndim = h->ndim < ARRAY_MAX_DIMS ? h->ndim : ARRAY_MAX_DIMS;
+	for(int i = 0; i < ndim; i++)
+		if(h->shape[i] == 0)
+			return 0;
+
+	uint64_t n = 1;
+	for(int i = 0; i < ndim; i++)
+	{
+		if(n > UINT64_MAX / h->shape[i])
+			return UINT64_MAX;
+		n *= h->shape[i];
+	}
+
+	return n;
+}
+
+uint64_t ArrayNumberOfBytes(ArrayHeader *h)
+{
+	uint64_t n 		= ArrayNumberOfElements(h);
+	int elementSize = ArrayDtypeSize(h->dtype);
+	if(elementSize > 0 && n > UINT64_MAX / elementSize)
+		return UINT64_MAX;
+
+	return n * elementSize;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+
+/**
+@brief Send a typed array
+
+The Message header, the ArrayHeader and the elements are three separate places in
+memory, and we hand all of them to the kernel at once with a struct iovec, so the
+array is never copied on our side.
+*/
+int SendArray(Supersocket *s, int target, uint8_t id, ArrayHeader *h, void *data)
+{
+	if(target < 0)
+	{
+		DisplayError("[%s] SendArray: Target %d is not a socket", s->name, target);
+		return -1;
+	}
+
+	uint64_t nBytes = ArrayNumberOfBytes(h);
+	if(ArrayDtypeSize(h->dtype) == 0 || nBytes > ARRAY_MAX_BYTES)
+	{
+		DisplayError("[%s] SendArray: Cannot send %llu bytes of dtype %d", s->name, (unsigned long long) nBytes, h->dtype);
+		return -1;
+	}
+
+	Message m = CreateMessage(s->name, id, NULL, sizeof(ArrayHeader) + nBytes);
+	m.flags = MESSAGE_FLAG_ARRAY;
+
+	struct iovec messageContents[MESSAGE_NUM_IOVECS + 1];
+	PopulateIOvec(messageContents, &m);
+	messageContents[MESSAGE_NUM_IOVECS - 1].iov_base 	= h;
+	messageContents[MESSAGE_NUM_IOVECS - 1].iov_len 	= sizeof(ArrayHeader);
+	messageContents[MESSAGE_NUM_IOVECS].iov_base 		= data;
+	messageContents[MESSAGE_NUM_IOVECS].iov_len 		= nBytes;
+
+	int epoch;
+	SupersocketTable *table = ReadSupersocketTable(s, &epoch);
+
+	int val = -1;
+	if (target < 0 || target >= table->nSockets)
+		DisplayError("SendArray: Target number exceeds number of sockets!");
+	else
+		val = SendIOvecToSocketWrapper(&table->socketWrapper[target], messageContents, MESSAGE_NUM_IOVECS + 1, NULL);
+
+	ReleaseSupersocketTable(s, epoch);
+	return val;
+}
+
+/**
+@brief Receive a typed array
+
+This mirrors SendArray(): the ArrayHeader is scattered into h and the elements into
+m->data, so they land at the start of the caller's buffer where they can be used
+directly (or handed to numpy or Matlab) without moving them.
+*/
+int ReceiveArray(Supersocket *s, Message *m, ArrayHeader *h)
+{
+	int capacity = m->dlen;
+
+	struct iovec messageContents[MESSAGE_NUM_IOVECS + 1];
+	PopulateIOvec(messageContents, m);
+	messageContents[MESSAGE_NUM_IOVECS - 1].iov_base 	= h;
+	messageContents[MESSAGE_NUM_IOVECS - 1].iov_len 	= sizeof(ArrayHeader);
+	messageContents[MESSAGE_NUM_IOVECS].iov_base 		= m->data;
+	messageContents[MESSAGE_NUM_IOVECS].iov_len 		= capacity;
+
+	// Nothing is read while a local connection is only being opened or closed
+	int bytesRead = 0;
+	while(bytesRead == 0)
+	{
+		if(PollSockets(s, -1) < 0)
+		{
+			DisplayError("Unable to poll socket: %s", strerror(errno));
+			return -1;
+		}
+
+		bytesRead = ReceiveIOvecSupersocket(s, messageContents, MESSAGE_NUM_IOVECS + 1, NULL);
+	}
+	if(bytesRead < 0)
+		return -1;
+
+	if((m->flags & MESSAGE_FLAG_ARRAY) == 0)
+	{
+		DisplayWarning("[%s] Message from %s is not a typed array", s->name, m->from);
+		return -1;
+	}
+
+	// The shape is in the sender's byte order too
+	int swapBytes = (h->endianness != HostEndianness());
+	if(swapBytes)
+		SwapElements(h->shape, ARRAY_MAX_DIMS, sizeof(uint32_t));
+
+	uint64_t nBytes = ArrayNumberOfBytes(h);
+	if(h->ndim > ARRAY_MAX_DIMS || ArrayDtypeSize(h->dtype) == 0
+		|| nBytes > capacity
+		|| nBytes + sizeof(ArrayHeader) != m->dlen
+		|| bytesRead != MESSAGE_HEADER_LENGTH + m->dlen)
+	{
+		DisplayWarning("[%s] Typed array from %s is malformed or does not fit (%llu bytes)", s->name, m->from, (unsigned long long) nBytes);
+		return -1;
+	}
+
+	if(swapBytes)
+	{
+		SwapElements(m->data, ArrayNumberOfElements(h), ArrayDtypeSize(h->dtype));
+		h->endianness = HostEndianness();
+	}
+
+	m->dlen 	= nBytes;
+	m->flags 	&= ~MESSAGE_FLAG_ARRAY;
+	return (int) nBytes;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////
+
+static int HostEndianness(void)
+{
+	uint16_t one = 1;
+	return *(uint8_t *) &one == 1 ? ARRAY_LITTLE_ENDIAN : ARRAY_BIG_ENDIAN;
+}
+
+static void SwapElements(void *data, uint64_t nElements, int elementSize)
+{
+	uint8_t *p = data;
+	for(uint64_t i = 0; i < nElements; i++, p += elementSize)
+		for(int j = 0; j < elementSize / 2; j++)
+		{
+			uint8_t temp 			= p[j];
+			p[j] 					= p[elementSize - 1 - j];
+			p[elementSize - 1 - j] 	= temp;
+		}
+}
@@ -0,0 +1,146 @@
+/**
+@file
+@brief Self-describing numeric array payloads
+
+A Message's data field is just bytes, which means whoever receives it has to
+know ahead of time what kind of numbers are in there, and how many, and in what
+shape. That's fine between two C processes that share a header file, but Python
+and Matlab end up receiving a string of bytes and then reinterpreting and
+reshaping it, which costs a copy each time.
+
+A typed array Message carries a small fixed-size ArrayHeader in front of the
+numbers that says what they are: the element type, the shape, whether it is
+stored row-major (C, numpy) or column-major (Matlab), and the byte order of the
+machine that sent it. The header and the numbers go out as separate pieces of
+one datagram, so neither side has to copy the array to glue them together.
+
+@code
+	double samples[96][30];
+	uint32_t shape[2] = {96, 30};
+
+	ArrayHeader h = {0};
+	PopulateArrayHeader(&h, ARRAY_DTYPE_FLOAT64, ARRAY_ORDER_ROW_MAJOR, 2, shape);
+	SendArray(&alice, aliceToBob, 0, &h, samples);
+@endcode
+
+And to receive it:
+
+@code
+	ArrayHeader h;
+	Message r = CreateMessageBuffer(ARRAY_MAX_BYTES);
+	int nBytes = ReceiveArray(&bob, &r, &h);
+@endcode
+
+After ReceiveArray() the numbers are in r.data, in the receiver's byte order,
+and h describes them.
+
+@authors David Brandman and Benjamin Shanahan
+*/
+
+#pragma once
+
+#include "Supersocket.h"
+
+/** Arrays can have at most this many dimensions */
+#define ARRAY_MAX_DIMS 8
+
+/** The largest array that fits in a single UDP datagram along with its headers */
+#define ARRAY_MAX_BYTES (65507 - MESSAGE_HEADER_LENGTH - sizeof(ArrayHeader))
+
+/**
+@brief List of the element types an array can hold
+
+The values are part of the wire format, so only ever add to the end of this list.
+*/
+typedef enum
+{
+	ARRAY_DTYPE_UNDEFINED,
+	ARRAY_DTYPE_INT8,
+	ARRAY_DTYPE_UINT8,
+	ARRAY_DTYPE_INT16,
+	ARRAY_DTYPE_UINT16,
+	ARRAY_DTYPE_INT32,
+	ARRAY_DTYPE_UINT32,
+	ARRAY_DTYPE_INT64,
+	ARRAY_DTYPE_UINT64,
+	ARRAY_DTYPE_FLOAT32,
+	ARRAY_DTYPE_FLOAT64,
+	ARRAY_DTYPE_BOOL
+
+} ArrayDtype;
+
+/**
+@brief How the elements of a multidimensional array are laid out
+
+Row-major is what C and numpy use by default: the last index changes fastest.
+Column-major is what Matlab and Fortran use: the first index changes fastest.
+*/
+typedef enum
+{
+	ARRAY_ORDER_ROW_MAJOR,
+	ARRAY_ORDER_COLUMN_MAJOR
+
+} ArrayOrder;
+
+/** Byte order of the machine that filled in the array */
+typedef enum
+{
+	ARRAY_LITTLE_ENDIAN,
+	ARRAY_BIG_ENDIAN
+
+} ArrayEndianness;
+
+/**
+@brief The header that travels in front of the elements of a typed array
+
+It has a fixed size so that it can be received into its own struct iovec, and the
+elements land at the start of the caller's buffer. Only the first ndim entries of
+shape mean anything.
+*/
+typedef struct
+{
+	uint8_t 	dtype;
+	uint8_t 	endianness;
+	uint8_t 	order;
+	uint8_t 	ndim;
+	uint32_t 	shape[ARRAY_MAX_DIMS];
+
+} ArrayHeader;
+
+/**
+@brief Fill in an ArrayHeader. The endianness is always that of this machine.
+*/
+int PopulateArrayHeader(ArrayHeader *h, int dtype, int order, int ndim, uint32_t *shape);
+
+/**
+@brief Size in bytes of one element of dtype, or 0 if dtype is not known
+*/
+int ArrayDtypeSize(int dtype);
+
+/**
+@brief Number of elements described by the header, or UINT64_MAX if that doesn't fit in 64 bits
+*/
+uint64_t ArrayNumberOfElements(ArrayHeader *h);
+
+/**
+@brief Number of bytes of elements described by the header, or UINT64_MAX if that doesn't fit in 64 bits
+*/
+uint64_t ArrayNumberOfBytes(ArrayHeader *h);
+
+/**
+@brief Send the array described by h, whose elements are at data, to target
+
+The .from field of the Message is the name of the Supersocket. Arrays go out
+uncompressed, whatever SetSupersocketCompression() says.
+*/
+int SendArray(Supersocket *s, int target, uint8_t id, ArrayHeader *h, void *data);
+
+/**
+@brief Receive a typed array into m
+
+Blocks until a Message arrives. The elements are written to the start of m->data,
+whose size is m->dlen, and h is filled in. If the sender's byte order is different
+from ours, the elements are swapped in place. Returns the number of bytes of elements,
+or -1 if what arrived wasn't a typed array or didn't fit.
+*/
+int ReceiveArray(Supersocket *s, Message *m, ArrayHeader *h);